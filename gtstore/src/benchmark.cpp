@@ -1,4 +1,7 @@
 #include "gtstore.hpp"
+#include "hash_ring.hpp"
+#include "workload.hpp"
+#include "trace.hpp"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -6,11 +9,45 @@
 #include <chrono>
 #include <fstream>
 #include <unordered_map>
+#include <map>
 #include <thread>
 #include <getopt.h>
 #include <iomanip>
 #include <limits>
 #include <atomic>
+#include <cmath>
+#include <algorithm>
+#include <mutex>
+#include <filesystem>
+#include <deque>
+#include <future>
+#include <cstring>
+#include <sstream>
+#include <functional>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Keys the rebalance test preloads and then reads and writes while a node joins
+#define REBALANCE_KEYS 50000
+// Workload runs are appended here, one JSON object per line
+#define WORKLOAD_RESULTS "workload_results.jsonl"
+// Records each loader thread writes per multi_put
+#define WORKLOAD_LOAD_BATCH 100
+// Metrics scraped from the manager and storage nodes are appended here, one server per line
+#define STATS_RESULTS "stats_results.jsonl"
+// Share of workload operations traced with --trace, unless --trace-sample says otherwise
+#define TRACE_DEFAULT_SAMPLE 0.01
+// Slowest traced operations broken down by --trace
+#define TRACE_SLOWEST 5
+// Values the compression test trains its dictionary on
+#define COMPRESSION_SAMPLES 500
+
+// Set with --results: the file benchmarks append their results to instead of their own
+std::string g_results_path;
+
+std::string results_path(const std::string& name) {
+    return g_results_path.empty() ? name : g_results_path;
+}
 
 // Helper function to generate random strings
 std::string random_string(int length) {
@@ -30,12 +67,48 @@ std::string random_string(int length) {
     return str;
 }
 
+// Latency in microseconds at percentile p of a sorted sample
+long percentile(const std::vector<long>& sorted_latencies, double p) {
+    if (sorted_latencies.empty()) {
+        return 0;
+    }
+    size_t index = std::min(sorted_latencies.size() - 1, static_cast<size_t>(p / 100.0 * sorted_latencies.size()));
+    return sorted_latencies[index];
+}
+
 void print_usage() {
     std::cout << "Usage: benchmark [options]\n"
               << "Options:\n"
               << "  --throughput [replicas] Run single client throughput benchmark\n"
+              << "  --window [requests]              With --throughput, keep this many async requests in flight\n"
               << "  --concurrent [replicas] [threads] Run concurrent throughput benchmark\n"
               << "  --loadbalance                    Run load balance benchmark\n"
+              << "  --batch [replicas]               Run multi_get/multi_put benchmark over several batch sizes\n"
+              << "  --scan [replicas]                Run range scan benchmark over several scan lengths against multi_get\n"
+              << "  --compression [replicas]         Run JSON-like value benchmark without compression, with deflate and with a dictionary\n"
+              << "  --contention [replicas] [threads] Run Zipfian hot-key PUT benchmark and report tail latency\n"
+              << "  --values [replicas]              Run 1 KB value benchmark and report latency and storage node memory\n"
+              << "  --durability [replicas] [threads] Run PUT-only throughput benchmark for comparing storage durability modes\n"
+              << "  --consistency [replicas] [threads] Run GET/PUT benchmark at consistency levels ONE, QUORUM and ALL\n"
+              << "  --skew [replicas] [threads]      Run Zipfian hot-key GET benchmark with and without replica selection and caching\n"
+              << "  --rebalance [replicas] [threads] Run GET/PUT throughput benchmark while a new storage node joins\n"
+              << "  --ring                           Run placement lookup microbenchmark on local rings of 10 to 1000 nodes\n"
+              << "  --workload [a|b|c|d]             Run a YCSB core workload and append latency histograms to " WORKLOAD_RESULTS "\n"
+              << "    --threads [n]                  Client threads (default 8)\n"
+              << "    --records [n]                  Keys loaded before the run (default 10000)\n"
+              << "    --read [fraction]              Share of reads, overriding the workload's\n"
+              << "    --insert [fraction]            Share of inserts of new keys; the rest are updates\n"
+              << "    --distribution [name]          Keys: uniform, zipfian, latest or hotspot\n"
+              << "    --value-size [min][:max]       Value bytes (default 100)\n"
+              << "    --value-distribution [name]    Value sizes in the range: fixed, uniform or zipfian\n"
+              << "    --rate [ops/s]                 Open loop at this total rate; 0 runs closed loop (default)\n"
+              << "    --warmup [s]                   Seconds run before measuring (default 5)\n"
+              << "    --duration [s]                 Seconds measured (default 30)\n"
+              << "    --trace-sample [fraction]      Share of operations traced with --trace (default 0.01)\n"
+              << "  --results [file]                 Append results to file instead of the benchmark's own results file\n"
+              << "  --stats                          After any other benchmark, scrape every server's metrics and append them to " STATS_RESULTS "\n"
+              << "  --trace [file]                   Trace sampled workload operations across every server, write them to file\n"
+              << "                                   as a Chrome trace and break down the slowest\n"
               << "  --help                           Show this help message\n";
 }
 
@@ -71,7 +144,7 @@ void client_thread(int thread_id, int ops_per_thread, std::atomic<int>& successf
 }
 
 void throughput_test(int num_ops, int replicas, int num_threads) {
-    std::ofstream outfile("throughput_results.txt", std::ios::app);
+    std::ofstream outfile(results_path("throughput_results.txt"), std::ios::app);
     
     std::cout << "\n=== Running concurrent test with " << replicas << " replicas and "
               << num_threads << " threads ===" << std::endl;
@@ -109,8 +182,549 @@ void throughput_test(int num_ops, int replicas, int num_threads) {
     std::this_thread::sleep_for(std::chrono::seconds(5));
 }
 
+void contention_thread(int thread_id, int ops_per_thread, int num_keys, std::atomic<int>& successful_ops,
+                       std::vector<long>& latencies, std::mutex& latencies_mutex) {
+    GTStoreClient client;
+    client.init(thread_id);
+
+    std::mt19937_64 rng(std::random_device{}());
+    ZipfianGenerator zipfian(num_keys);
+    std::vector<long> thread_latencies;
+    thread_latencies.reserve(ops_per_thread);
+
+    for (int i = 0; i < ops_per_thread; i++) {
+        std::string key = "hot" + std::to_string(zipfian.next(rng));
+        std::string value = "val" + std::to_string(thread_id) + "_" + std::to_string(i);
+
+        auto op_start = std::chrono::high_resolution_clock::now();
+        bool success = !client.put(key, {value}).empty();
+        auto op_end = std::chrono::high_resolution_clock::now();
+
+        if (success) {
+            successful_ops++;
+            thread_latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(op_end - op_start).count());
+        }
+    }
+
+    client.finalize();
+
+    std::lock_guard<std::mutex> lock(latencies_mutex);
+    latencies.insert(latencies.end(), thread_latencies.begin(), thread_latencies.end());
+}
+
+void contention_test(int num_ops, int replicas, int num_threads) {
+    std::ofstream outfile(results_path("contention_results.txt"), std::ios::app);
+    const int num_keys = 1000;
+
+    std::cout << "\n=== Running Zipfian contention test with " << replicas << " replicas and "
+              << num_threads << " threads over " << num_keys << " keys ===" << std::endl;
+
+    std::atomic<int> successful_ops(0);
+    std::vector<long> latencies;
+    std::mutex latencies_mutex;
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (int i = 0; i < num_threads; i++) {
+        threads.emplace_back(contention_thread, i, num_ops / num_threads, num_keys, std::ref(successful_ops),
+                             std::ref(latencies), std::ref(latencies_mutex));
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+
+    std::sort(latencies.begin(), latencies.end());
+    double throughput = static_cast<double>(successful_ops) / (duration.count() / 1000.0);
+
+    std::cout << "Total duration: " << duration.count() << " ms" << std::endl;
+    std::cout << "PUT throughput: " << std::fixed << std::setprecision(2) << throughput << " ops/sec (success rate: "
+              << (successful_ops * 100.0 / num_ops) << "%)" << std::endl;
+    std::cout << "PUT latency: p50 " << percentile(latencies, 50) << " us, p99 " << percentile(latencies, 99)
+              << " us, p99.9 " << percentile(latencies, 99.9) << " us, max "
+              << (latencies.empty() ? 0 : latencies.back()) << " us" << std::endl;
+
+    outfile << replicas << " " << num_threads << " " << throughput << " " << percentile(latencies, 50) << " "
+            << percentile(latencies, 99) << " " << percentile(latencies, 99.9) << std::endl;
+
+    // Sleep to allow system to stabilize between tests
+    std::cout << "Waiting for system to stabilize..." << std::endl;
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+}
+
+void consistency_thread(int thread_id, int ops_per_thread, GTStoreConsistency consistency, std::atomic<int>& successful_ops,
+                        std::vector<long>& get_latencies, std::vector<long>& put_latencies, std::mutex& latencies_mutex) {
+    GTStoreClient client;
+    client.init(thread_id);
+
+    std::mt19937 gen(thread_id);
+    std::uniform_int_distribution<> dis(0, 9999);
+    std::vector<long> thread_get_latencies;
+    std::vector<long> thread_put_latencies;
+
+    for (int i = 0; i < ops_per_thread; i++) {
+        std::string key = "level" + std::to_string(dis(gen));
+        bool is_put = i % 2 == 0;
+
+        auto op_start = std::chrono::high_resolution_clock::now();
+        bool success = is_put ? !client.put(key, {"val" + std::to_string(i)}, consistency).empty() : !client.get(key, consistency).empty();
+        auto op_end = std::chrono::high_resolution_clock::now();
+
+        if (success) {
+            successful_ops++;
+            long latency = std::chrono::duration_cast<std::chrono::microseconds>(op_end - op_start).count();
+            (is_put ? thread_put_latencies : thread_get_latencies).push_back(latency);
+        }
+    }
+
+    client.finalize();
+
+    std::lock_guard<std::mutex> lock(latencies_mutex);
+    get_latencies.insert(get_latencies.end(), thread_get_latencies.begin(), thread_get_latencies.end());
+    put_latencies.insert(put_latencies.end(), thread_put_latencies.begin(), thread_put_latencies.end());
+}
+
+// Alternating PUTs and GETs over 10000 keys at each consistency level, both operations at the
+// same level, reporting throughput and latency percentiles
+void consistency_test(int num_ops, int replicas, int num_threads) {
+    std::ofstream outfile(results_path("consistency_results.txt"), std::ios::app);
+
+    std::cout << "\n=== Running consistency level test with " << replicas << " replicas and "
+              << num_threads << " threads ===" << std::endl;
+
+    const std::pair<const char*, GTStoreConsistency> levels[] = {
+        {"one", GTStoreConsistency::ONE},
+        {"quorum", GTStoreConsistency::QUORUM},
+        {"all", GTStoreConsistency::ALL},
+    };
+
+    for (const auto& [name, consistency] : levels) {
+        std::atomic<int> successful_ops(0);
+        std::vector<long> get_latencies;
+        std::vector<long> put_latencies;
+        std::mutex latencies_mutex;
+        std::vector<std::thread> threads;
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        for (int i = 0; i < num_threads; i++) {
+            threads.emplace_back(consistency_thread, i, num_ops / num_threads, consistency, std::ref(successful_ops),
+                                 std::ref(get_latencies), std::ref(put_latencies), std::ref(latencies_mutex));
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+
+        std::sort(get_latencies.begin(), get_latencies.end());
+        std::sort(put_latencies.begin(), put_latencies.end());
+        double throughput = static_cast<double>(successful_ops) / (duration.count() / 1000.0);
+
+        std::cout << name << ": " << std::fixed << std::setprecision(2) << throughput << " ops/sec, GET p50 "
+                  << percentile(get_latencies, 50) << " us, p99 " << percentile(get_latencies, 99) << " us, PUT p50 "
+                  << percentile(put_latencies, 50) << " us, p99 " << percentile(put_latencies, 99) << " us" << std::endl;
+
+        outfile << name << " " << replicas << " " << num_threads << " " << throughput << " "
+                << percentile(get_latencies, 50) << " " << percentile(get_latencies, 99) << " "
+                << percentile(put_latencies, 50) << " " << percentile(put_latencies, 99) << std::endl;
+    }
+
+    // Sleep to allow system to stabilize between tests
+    std::cout << "Waiting for system to stabilize..." << std::endl;
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+}
+
+void durability_thread(int thread_id, int ops_per_thread, std::atomic<int>& successful_ops) {
+    GTStoreClient client;
+    client.init(thread_id);
+
+    for (int i = 0; i < ops_per_thread; i++) {
+        std::string key = "durable" + std::to_string(thread_id) + "_" + std::to_string(i);
+        if (!client.put(key, {"val" + std::to_string(i)}).empty()) {
+            successful_ops++;
+        }
+    }
+
+    client.finalize();
+}
+
+// PUT-only throughput over distinct keys, to compare the storage nodes' --durability modes
+void durability_test(int num_ops, int replicas, int num_threads) {
+    std::ofstream outfile(results_path("durability_results.txt"), std::ios::app);
+
+    std::cout << "\n=== Running PUT durability test with " << replicas << " replicas and "
+              << num_threads << " threads ===" << std::endl;
+
+    std::atomic<int> successful_ops(0);
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (int i = 0; i < num_threads; i++) {
+        threads.emplace_back(durability_thread, i, num_ops / num_threads, std::ref(successful_ops));
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+
+    double throughput = static_cast<double>(successful_ops) / (duration.count() / 1000.0);
+    std::cout << "Total duration: " << duration.count() << " ms" << std::endl;
+    std::cout << "PUT throughput: " << std::fixed << std::setprecision(2) << throughput << " ops/sec (success rate: "
+              << (successful_ops * 100.0 / num_ops) << "%)" << std::endl;
+
+    outfile << replicas << " " << num_threads << " " << throughput << std::endl;
+}
+
+void rebalance_thread(int thread_id, std::atomic<bool>& running, std::atomic<long>& ops) {
+    GTStoreClient client;
+    client.init(thread_id);
+    std::mt19937 gen(thread_id);
+    std::uniform_int_distribution<> dis(0, REBALANCE_KEYS - 1);
+
+    while (running) {
+        std::string key = "rebalance" + std::to_string(dis(gen));
+        bool ok = (gen() % 2) ? !client.get(key).empty() : !client.put(key, {random_string(10)}).empty();
+        if (ok) {
+            ops++;
+        }
+    }
+
+    client.finalize();
+}
+
+// Foreground GET/PUT throughput sampled while a new storage node joins and the keys it takes
+// over are streamed to it. Reports how long the rebalance took and how far throughput dipped.
+void rebalance_test(int replicas, int num_threads) {
+    std::ofstream outfile(results_path("rebalance_results.txt"), std::ios::app);
+
+    std::cout << "\n=== Running rebalance test with " << replicas << " replicas and "
+              << num_threads << " threads ===" << std::endl;
+
+    auto manager = GTStoreManagerService::NewStub(grpc::CreateChannel("localhost:50000", grpc::InsecureChannelCredentials()));
+    auto rebalance_status = [&manager] {
+        ManagerRebalanceStatusResponse response;
+        ClientContext context;
+        manager->get_rebalance_status(&context, ManagerRebalanceStatusRequest(), &response);
+        return response;
+    };
+
+    ManagerGetRingResponse ring;
+    {
+        ClientContext context;
+        manager->get_ring(&context, ManagerGetRingRequest(), &ring);
+    }
+    int new_node = ring.storage_nodes_size() + 1;
+
+    // Preload every key the foreground threads touch
+    GTStoreClient client;
+    client.init(0);
+    for (int base = 0; base < REBALANCE_KEYS; base += 1000) {
+        std::vector<std::pair<std::string, val_t>> entries;
+        for (int i = base; i < base + 1000; i++) {
+            entries.push_back({"rebalance" + std::to_string(i), {random_string(10)}});
+        }
+        client.multi_put(entries);
+    }
+    client.finalize();
+
+    std::atomic<bool> running(true);
+    std::atomic<long> ops(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+        threads.emplace_back(rebalance_thread, i + 1, std::ref(running), std::ref(ops));
+    }
+
+    uint64_t rebalances = rebalance_status().rebalances();
+    std::vector<double> baseline;
+    std::vector<double> during;
+    bool joined = false;
+    bool finished = false;
+    int samples_after = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto join_time = start;
+    auto finish_time = start;
+
+    while (samples_after < 8) {
+        long before = ops;
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        double throughput = (ops - before) * 4.0;
+        auto now = std::chrono::steady_clock::now();
+
+        if (!joined) {
+            baseline.push_back(throughput);
+            if (now - start >= std::chrono::seconds(3)) {
+                std::cout << "Starting storage node " << new_node << std::endl;
+                std::system(("./build/storage " + std::to_string(new_node) + " > /dev/null 2>&1 &").c_str());
+                join_time = now;
+                joined = true;
+            }
+        }
+        else if (!finished) {
+            during.push_back(throughput);
+            ManagerRebalanceStatusResponse status = rebalance_status();
+            if (status.rebalances() > rebalances && status.pending_transfers() == 0) {
+                finish_time = now;
+                finished = true;
+            }
+            else if (now - join_time >= std::chrono::seconds(120)) {
+                std::cerr << "Rebalance did not finish within 120 s" << std::endl;
+                finish_time = now;
+                finished = true;
+            }
+        }
+        else {
+            samples_after++;
+        }
+    }
+
+    running = false;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto average = [](const std::vector<double>& samples) {
+        double sum = 0;
+        for (double sample : samples) {
+            sum += sample;
+        }
+        return samples.empty() ? 0 : sum / samples.size();
+    };
+    double baseline_avg = average(baseline);
+    double during_avg = average(during);
+    double during_min = during.empty() ? 0 : *std::min_element(during.begin(), during.end());
+    double dip = baseline_avg > 0 ? (1 - during_min / baseline_avg) * 100 : 0;
+    long rebalance_ms = std::chrono::duration_cast<std::chrono::milliseconds>(finish_time - join_time).count();
+
+    std::cout << "Rebalance time: " << rebalance_ms << " ms (manager: " << rebalance_status().last_rebalance_ms() << " ms)" << std::endl;
+    std::cout << "Throughput before: " << std::fixed << std::setprecision(2) << baseline_avg << " ops/sec, during: "
+              << during_avg << " ops/sec avg, " << during_min << " ops/sec min (dip " << dip << "%)" << std::endl;
+
+    outfile << replicas << " " << num_threads << " " << rebalance_ms << " " << baseline_avg << " "
+            << during_avg << " " << during_min << std::endl;
+}
+
+// Written by lookup_ns so its lookups are not optimized away
+volatile size_t lookup_sink;
+
+// Nanoseconds per call of lookup over keys, best of a few passes
+template <class Lookup>
+double lookup_ns(const std::vector<std::string>& keys, Lookup lookup) {
+    double best = std::numeric_limits<double>::max();
+
+    for (int pass = 0; pass < 3; pass++) {
+        size_t sum = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const auto& key : keys) {
+            sum += lookup(key);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        lookup_sink = sum;
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / keys.size());
+    }
+
+    return best;
+}
+
+// The manager's placement strategies, with no nodes yet, by --placement name
+std::vector<std::pair<std::string, std::shared_ptr<const PlacementStrategy>>> placement_strategies(int replicas) {
+    return {
+        {"ring", std::make_shared<RingPlacement>(replicas, 1000)},
+        {"bounded", std::make_shared<RingPlacement>(replicas, 1000, true)},
+        {"jump", std::make_shared<JumpPlacement>()},
+        {"rendezvous", std::make_shared<RendezvousPlacement>()},
+    };
+}
+
+HashRing local_ring(std::shared_ptr<const PlacementStrategy> placement, const std::vector<std::string>& nodes, int replicas) {
+    HashRing ring;
+    ring.num_replicas = replicas;
+    ring.placement = placement;
+    ring.add_nodes(nodes);
+    return ring;
+}
+
+// Placement lookups on local rings of 10 to 1000 nodes, for every placement strategy
+void ring_lookup_test(int num_keys) {
+    std::ofstream outfile(results_path("ring_results.txt"), std::ios::app);
+
+    std::cout << "\n=== Running ring lookup test ===" << std::endl;
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < num_keys; i++) {
+        keys.push_back(random_string(10));
+    }
+
+    for (int num_nodes : {10, 100, 1000}) {
+        std::vector<std::string> nodes;
+        for (int i = 1; i <= num_nodes; i++) {
+            nodes.push_back("0.0.0.0:" + std::to_string(50000 + i));
+        }
+
+        for (const auto& [name, placement] : placement_strategies(3)) {
+            HashRing ring = local_ring(placement, nodes, 3);
+
+            double get_ns = lookup_ns(keys, [&ring](const std::string& key) {
+                return ring.get_storage_node(key).size();
+            });
+            double put_ns = lookup_ns(keys, [&ring](const std::string& key) {
+                return ring.put_replicas(key).size();
+            });
+            size_t memory = ring.placement->memory_bytes();
+
+            std::cout << num_nodes << " nodes, " << name << ": GET node " << std::fixed << std::setprecision(1) << get_ns
+                      << " ns/op, PUT replicas " << put_ns << " ns/op, " << memory / 1024 << " KB" << std::endl;
+
+            outfile << num_nodes << " " << name << " " << get_ns << " " << put_ns << " " << memory << std::endl;
+        }
+    }
+}
+
+// Place keys with every strategy over the nodes and replication of the running service, and
+// report how evenly each spreads them, its lookup cost and its memory
+void placement_comparison(const std::vector<std::string>& keys) {
+    std::ofstream outfile("placement_results.txt");
+
+    auto manager = GTStoreManagerService::NewStub(grpc::CreateChannel("localhost:50000", grpc::InsecureChannelCredentials()));
+    ManagerGetRingResponse response;
+    ClientContext context;
+    if (!manager->get_ring(&context, ManagerGetRingRequest(), &response).ok() || response.storage_nodes_size() == 0) {
+        std::cerr << "Cannot get the ring from the manager" << std::endl;
+        return;
+    }
+    std::vector<std::string> nodes(response.storage_nodes().begin(), response.storage_nodes().end());
+
+    std::cout << "\nPlacement strategies over " << nodes.size() << " nodes and " << response.num_replicas() << " replicas:" << std::endl;
+
+    for (const auto& [name, placement] : placement_strategies(response.num_replicas())) {
+        HashRing ring = local_ring(placement, nodes, response.num_replicas());
+
+        std::unordered_map<std::string, int> node_counts;
+        for (const auto& key : keys) {
+            for (const auto& node : ring.put_storage_nodes(key)) {
+                node_counts[node]++;
+            }
+        }
+
+        int total_keys = 0;
+        int min_keys = std::numeric_limits<int>::max();
+        int max_keys = 0;
+        for (const auto& node : nodes) {
+            total_keys += node_counts[node];
+            min_keys = std::min(min_keys, node_counts[node]);
+            max_keys = std::max(max_keys, node_counts[node]);
+        }
+        double avg_keys = static_cast<double>(total_keys) / nodes.size();
+        double imbalance = static_cast<double>(max_keys - min_keys) / avg_keys * 100.0;
+
+        double put_ns = lookup_ns(keys, [&ring](const std::string& key) {
+            return ring.put_replicas(key).size();
+        });
+        size_t memory = ring.placement->memory_bytes();
+
+        std::cout << "- " << name << ": imbalance " << std::fixed << std::setprecision(2) << imbalance << "%, lookup "
+                  << put_ns << " ns/op, " << memory / 1024 << " KB" << std::endl;
+
+        outfile << name << " " << imbalance << " " << put_ns << " " << memory << std::endl;
+    }
+}
+
+// Resident memory of all local storage node processes in KB, read from /proc
+long storage_rss_kb() {
+    long total = 0;
+
+    for (const auto& entry : std::filesystem::directory_iterator("/proc")) {
+        std::ifstream comm(entry.path() / "comm");
+        std::string name;
+        if (!(comm >> name) || name != "storage") {
+            continue;
+        }
+
+        std::ifstream status(entry.path() / "status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.rfind("VmRSS:", 0) == 0) {
+                total += std::atol(line.c_str() + 6);
+                break;
+            }
+        }
+    }
+    return total;
+}
+
+void value_size_test(int num_keys, int replicas) {
+    std::ofstream outfile(results_path("value_results.txt"), std::ios::app);
+    const std::string value = random_string(MAX_VALUE_BYTE_PER_REQUEST);
+
+    std::cout << "\n=== Running " << value.size() << "-byte value test with " << replicas << " replicas over "
+              << num_keys << " keys ===" << std::endl;
+
+    GTStoreClient client;
+    client.init(1);
+
+    long rss_before = storage_rss_kb();
+    std::vector<long> put_latencies;
+    std::vector<long> get_latencies;
+    int successful_ops = 0;
+
+    for (int i = 0; i < num_keys; i++) {
+        std::string key = "value" + std::to_string(i);
+
+        auto op_start = std::chrono::high_resolution_clock::now();
+        bool put_ok = !client.put(key, {value}).empty();
+        auto op_end = std::chrono::high_resolution_clock::now();
+        put_latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(op_end - op_start).count());
+
+        if (put_ok) {
+            successful_ops++;
+        }
+    }
+
+    for (int i = 0; i < num_keys; i++) {
+        std::string key = "value" + std::to_string(i);
+
+        auto op_start = std::chrono::high_resolution_clock::now();
+        val_t val = client.get(key);
+        auto op_end = std::chrono::high_resolution_clock::now();
+        get_latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(op_end - op_start).count());
+
+        if (val.size() == 1 && val[0] == value) {
+            successful_ops++;
+        }
+    }
+
+    double rss_mb = (storage_rss_kb() - rss_before) / 1024.0;
+    std::sort(put_latencies.begin(), put_latencies.end());
+    std::sort(get_latencies.begin(), get_latencies.end());
+
+    std::cout << "Success rate: " << std::fixed << std::setprecision(2) << (successful_ops * 100.0 / (2 * num_keys)) << "%" << std::endl;
+    std::cout << "PUT latency: p50 " << percentile(put_latencies, 50) << " us, p99 " << percentile(put_latencies, 99) << " us" << std::endl;
+    std::cout << "GET latency: p50 " << percentile(get_latencies, 50) << " us, p99 " << percentile(get_latencies, 99) << " us" << std::endl;
+    std::cout << "Storage node memory growth: " << rss_mb << " MB (" << (rss_mb * 1024 * 1024 / num_keys / replicas)
+              << " bytes per stored copy)" << std::endl;
+
+    outfile << replicas << " " << num_keys << " " << percentile(put_latencies, 50) << " " << percentile(put_latencies, 99) << " "
+            << percentile(get_latencies, 50) << " " << percentile(get_latencies, 99) << " " << rss_mb << std::endl;
+
+    client.finalize();
+
+    // Sleep to allow system to stabilize between tests
+    std::cout << "Waiting for system to stabilize..." << std::endl;
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+}
+
 void single_client_throughput_test(int num_ops, int replicas) {
-    std::ofstream outfile("single_client_results.txt", std::ios::app);
+    std::ofstream outfile(results_path("single_client_results.txt"), std::ios::app);
     
     std::cout << "\n=== Running single client throughput test with " << replicas << " replicas ===" << std::endl;
     
@@ -188,24 +802,412 @@ void single_client_throughput_test(int num_ops, int replicas) {
     std::this_thread::sleep_for(std::chrono::seconds(5));
 }
 
-void loadbalance_test(int num_inserts) {
+// Single client throughput with up to window requests in flight through get_async and
+// put_async: PUTs of num_ops/2 distinct keys, then GETs of them. A full window waits for its
+// oldest request.
+void windowed_throughput_test(int num_ops, int replicas, int window) {
+    std::ofstream outfile(results_path("window_results.txt"), std::ios::app);
+
+    std::cout << "\n=== Running single client throughput test with " << replicas << " replicas and a window of "
+              << window << " requests ===" << std::endl;
+
     GTStoreClient client;
     client.init(1);
-    
-    std::unordered_map<std::string, int> node_counts;
-    std::ofstream outfile("loadbalance_results.txt");
-    
-    std::cout << "\n=== Running load balance test ===" << std::endl;
-    
-    // Perform inserts with random keys
-    for (int i = 0; i < num_inserts; i++) {
-        std::string key = random_string(10);
-        std::string value = random_string(10);
-        
-        try {
-            std::vector<std::string> nodes = client.put(key, {value});
-            for (const auto& node : nodes) {
-                node_counts[node]++;
+
+    int num_keys = num_ops / 2;
+    int successful_ops = 0;
+
+    auto put_start = std::chrono::high_resolution_clock::now();
+    std::deque<std::future<std::vector<std::string>>> puts;
+    for (int i = 0; i < num_keys; i++) {
+        if ((int) puts.size() >= window) {
+            successful_ops += !puts.front().get().empty();
+            puts.pop_front();
+        }
+        puts.push_back(client.put_async("window" + std::to_string(i), {"val" + std::to_string(i)}));
+    }
+    for (auto& put : puts) {
+        successful_ops += !put.get().empty();
+    }
+    auto put_end = std::chrono::high_resolution_clock::now();
+
+    std::deque<std::pair<int, std::future<val_t>>> gets;
+    auto check = [&](std::pair<int, std::future<val_t>>& get) {
+        val_t value = get.second.get();
+        successful_ops += value.size() == 1 && value[0] == "val" + std::to_string(get.first);
+    };
+    for (int i = 0; i < num_keys; i++) {
+        if ((int) gets.size() >= window) {
+            check(gets.front());
+            gets.pop_front();
+        }
+        gets.emplace_back(i, client.get_async("window" + std::to_string(i)));
+    }
+    for (auto& get : gets) {
+        check(get);
+    }
+    auto get_end = std::chrono::high_resolution_clock::now();
+
+    double put_seconds = std::chrono::duration_cast<std::chrono::microseconds>(put_end - put_start).count() / 1000000.0;
+    double get_seconds = std::chrono::duration_cast<std::chrono::microseconds>(get_end - put_end).count() / 1000000.0;
+    double throughput = successful_ops / (put_seconds + get_seconds);
+    double put_throughput = num_keys / put_seconds;
+    double get_throughput = num_keys / get_seconds;
+
+    std::cout << "PUT throughput: " << std::fixed << std::setprecision(2) << put_throughput << " ops/sec" << std::endl;
+    std::cout << "GET throughput: " << std::fixed << std::setprecision(2) << get_throughput << " ops/sec" << std::endl;
+    std::cout << "Overall throughput with " << replicas << " replicas and a window of " << window << ": "
+              << std::fixed << std::setprecision(2) << throughput << " ops/sec (success rate: "
+              << (successful_ops * 100.0 / (2 * num_keys)) << "%)" << std::endl;
+
+    outfile << replicas << " " << window << " " << throughput << " " << put_throughput << " " << get_throughput << std::endl;
+
+    client.finalize();
+
+    // Sleep to allow system to stabilize between tests
+    std::cout << "Waiting for system to stabilize..." << std::endl;
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+}
+
+void batch_throughput_test(int num_keys, int replicas) {
+    std::ofstream outfile(results_path("batch_results.txt"), std::ios::app);
+
+    std::cout << "\n=== Running batch throughput test with " << replicas << " replicas ===" << std::endl;
+
+    GTStoreClient client;
+    client.init(1);
+
+    for (int batch_size : {1, 10, 100, 1000}) {
+        int successful_puts = 0;
+        int successful_gets = 0;
+        auto put_duration = std::chrono::microseconds(0);
+        auto get_duration = std::chrono::microseconds(0);
+
+        for (int base = 0; base < num_keys; base += batch_size) {
+            std::vector<std::pair<std::string, val_t>> entries;
+            std::vector<std::string> keys;
+
+            for (int i = base; i < base + batch_size && i < num_keys; i++) {
+                std::string key = "batch" + std::to_string(batch_size) + "_" + std::to_string(i);
+                entries.push_back({key, {"val" + std::to_string(i)}});
+                keys.push_back(key);
+            }
+
+            // MULTI_PUT
+            auto op_start = std::chrono::high_resolution_clock::now();
+            std::vector<std::vector<std::string>> placements = client.multi_put(entries);
+            auto op_end = std::chrono::high_resolution_clock::now();
+            put_duration += std::chrono::duration_cast<std::chrono::microseconds>(op_end - op_start);
+
+            for (const auto& nodes : placements) {
+                if (!nodes.empty()) {
+                    successful_puts++;
+                }
+            }
+
+            // MULTI_GET
+            op_start = std::chrono::high_resolution_clock::now();
+            std::vector<val_t> vals = client.multi_get(keys);
+            op_end = std::chrono::high_resolution_clock::now();
+            get_duration += std::chrono::duration_cast<std::chrono::microseconds>(op_end - op_start);
+
+            for (size_t j = 0; j < vals.size(); j++) {
+                if (vals[j].size() == 1 && vals[j][0] == entries[j].second[0]) {
+                    successful_gets++;
+                }
+            }
+        }
+
+        double put_throughput = static_cast<double>(successful_puts) / (put_duration.count() / 1000000.0);
+        double get_throughput = static_cast<double>(successful_gets) / (get_duration.count() / 1000000.0);
+
+        std::cout << "Batch size " << batch_size << ": PUT " << std::fixed << std::setprecision(2) << put_throughput
+                  << " keys/sec, GET " << get_throughput << " keys/sec (success rate: "
+                  << ((successful_puts + successful_gets) * 100.0 / (2 * num_keys)) << "%)" << std::endl;
+
+        outfile << replicas << " " << batch_size << " " << put_throughput << " " << get_throughput << std::endl;
+    }
+
+    client.finalize();
+
+    // Sleep to allow system to stabilize between tests
+    std::cout << "Waiting for system to stabilize..." << std::endl;
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+}
+
+// Range scans of several lengths from random keys, against multi_get of the same keys
+void scan_test(int num_keys, int replicas) {
+    std::ofstream outfile(results_path("scan_results.txt"), std::ios::app);
+
+    std::cout << "\n=== Running range scan test with " << replicas << " replicas ===" << std::endl;
+
+    GTStoreClient client;
+    client.init(1);
+
+    // Zero-padded, so key order is numeric order, and 8 bytes long, so range placement can
+    // split them anywhere
+    auto scan_key = [](int i) {
+        char key[16];
+        std::snprintf(key, sizeof(key), "sc%06d", i);
+        return std::string(key);
+    };
+
+    for (int base = 0; base < num_keys; base += 100) {
+        std::vector<std::pair<std::string, val_t>> entries;
+        for (int i = base; i < base + 100 && i < num_keys; i++) {
+            entries.push_back({scan_key(i), {"val" + std::to_string(i)}});
+        }
+        client.multi_put(entries);
+    }
+
+    std::mt19937 gen(42);
+    for (int length : {10, 100, 1000}) {
+        std::uniform_int_distribution<> start_dist(0, num_keys - length);
+        int num_scans = std::max(50, 20000 / length);
+        std::vector<long> latencies;
+        long scanned_keys = 0;
+        long read_keys = 0;
+        auto scan_duration = std::chrono::microseconds(0);
+        auto get_duration = std::chrono::microseconds(0);
+
+        for (int n = 0; n < num_scans; n++) {
+            int first = start_dist(gen);
+
+            // SCAN
+            auto op_start = std::chrono::high_resolution_clock::now();
+            std::vector<std::pair<std::string, val_t>> entries = client.scan(scan_key(first), "", length);
+            auto op_end = std::chrono::high_resolution_clock::now();
+            auto latency = std::chrono::duration_cast<std::chrono::microseconds>(op_end - op_start);
+            scan_duration += latency;
+            latencies.push_back(latency.count());
+            scanned_keys += entries.size();
+
+            // The same keys as point reads, which needs every key known in advance
+            std::vector<std::string> keys;
+            for (int i = first; i < first + length; i++) {
+                keys.push_back(scan_key(i));
+            }
+            op_start = std::chrono::high_resolution_clock::now();
+            std::vector<val_t> vals = client.multi_get(keys);
+            op_end = std::chrono::high_resolution_clock::now();
+            get_duration += std::chrono::duration_cast<std::chrono::microseconds>(op_end - op_start);
+
+            for (const auto& val : vals) {
+                if (!val.empty()) {
+                    read_keys++;
+                }
+            }
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        double scan_throughput = static_cast<double>(scanned_keys) / (scan_duration.count() / 1000000.0);
+        double get_throughput = static_cast<double>(read_keys) / (get_duration.count() / 1000000.0);
+
+        std::cout << "Scan length " << length << ": SCAN " << std::fixed << std::setprecision(2) << scan_throughput
+                  << " keys/sec (p50 " << percentile(latencies, 50) << " us, p99 " << percentile(latencies, 99)
+                  << " us), MULTI_GET " << get_throughput << " keys/sec (keys found: "
+                  << (scanned_keys * 100.0 / (static_cast<long>(num_scans) * length)) << "%)" << std::endl;
+
+        outfile << replicas << " " << length << " " << scan_throughput << " " << get_throughput << " "
+                << percentile(latencies, 50) << " " << percentile(latencies, 99) << std::endl;
+    }
+
+    client.finalize();
+
+    // Sleep to allow system to stabilize between tests
+    std::cout << "Waiting for system to stabilize..." << std::endl;
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+}
+
+// Bytes received on the loopback interface, which carries all traffic of a local cluster
+long loopback_bytes() {
+    std::ifstream dev("/proc/net/dev");
+    std::string line;
+    while (std::getline(dev, line)) {
+        // Counters may run into the name's colon
+        std::replace(line.begin(), line.end(), ':', ' ');
+        std::istringstream fields(line);
+        std::string name;
+        long bytes = 0;
+        if (fields >> name >> bytes && name == "lo") {
+            return bytes;
+        }
+    }
+    return 0;
+}
+
+// User and system CPU time of all local storage node processes in microseconds, read from /proc
+long storage_cpu_us() {
+    long ticks = 0;
+
+    for (const auto& entry : std::filesystem::directory_iterator("/proc")) {
+        std::ifstream comm(entry.path() / "comm");
+        std::string name;
+        if (!(comm >> name) || name != "storage") {
+            continue;
+        }
+
+        // utime and stime are the 12th and 13th fields after the parenthesized name
+        std::ifstream stat(entry.path() / "stat");
+        std::string line;
+        std::getline(stat, line);
+        std::istringstream fields(line.substr(line.rfind(')') + 2));
+        std::string field;
+        for (int i = 0; i < 11; i++) {
+            fields >> field;
+        }
+        long utime = 0;
+        long stime = 0;
+        fields >> utime >> stime;
+        ticks += utime + stime;
+    }
+    return ticks * 1000000 / sysconf(_SC_CLK_TCK);
+}
+
+// User and system CPU time of this process in microseconds
+long client_cpu_us() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000L + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// A record like the JSON documents applications store: the same field names in every value,
+// with varying contents
+std::string json_value(std::mt19937& gen, int i) {
+    static const char* cities[] = {"Atlanta", "Boston", "Chicago", "Denver", "Seattle"};
+    static const char* plans[] = {"free", "basic", "premium"};
+    std::uniform_int_distribution<> n(0, 99999);
+    std::ostringstream value;
+    value << "{\"user_id\":" << i << ",\"name\":\"user" << n(gen) << "\",\"email\":\"user" << n(gen)
+          << "@example.com\",\"address\":{\"street\":\"" << n(gen) % 1000 << " Main Street\",\"city\":\""
+          << cities[n(gen) % 5] << "\",\"zip\":\"" << n(gen) << "\"},\"plan\":\"" << plans[n(gen) % 3]
+          << "\",\"created_at\":\"2024-0" << 1 + n(gen) % 9 << "-1" << n(gen) % 10 << "T12:00:00Z\",\"tags\":[\"tag"
+          << n(gen) % 50 << "\",\"tag" << n(gen) % 50 << "\"],\"login_count\":" << n(gen) << ",\"verified\":"
+          << (n(gen) % 2 ? "true" : "false") << ",\"preferences\":{\"language\":\"en\",\"newsletter\":"
+          << (n(gen) % 2 ? "true" : "false") << ",\"theme\":\"dark\"}}";
+    return value.str();
+}
+
+// JSON-like values written and read without compression, with deflate and with a trained
+// dictionary, reporting network bytes, storage node memory and CPU on both sides per operation
+void compression_test(int num_keys, int replicas) {
+    std::ofstream outfile(results_path("compression_results.txt"), std::ios::app);
+
+    std::cout << "\n=== Running compression test with " << replicas << " replicas over " << num_keys << " keys ===" << std::endl;
+
+    std::mt19937 gen(42);
+    std::vector<std::string> samples;
+    for (int i = 0; i < COMPRESSION_SAMPLES; i++) {
+        samples.push_back(json_value(gen, i));
+    }
+    std::string dictionary = GTStoreClient::train_dictionary(samples);
+    std::cout << "Trained a " << dictionary.size() << "-byte dictionary on " << samples.size() << " values" << std::endl;
+
+    GTStoreClientOptions none;
+    GTStoreClientOptions deflate;
+    deflate.compression = GTStoreCompression::DEFLATE;
+    GTStoreClientOptions trained;
+    trained.compression = GTStoreCompression::DICTIONARY;
+    trained.dictionary = dictionary;
+    const std::pair<const char*, GTStoreClientOptions> modes[] = {
+        {"none", none},
+        {"deflate", deflate},
+        {"dictionary", trained}
+    };
+
+    for (const auto& mode : modes) {
+        GTStoreClient client;
+        client.init(1, false, mode.second);
+
+        std::vector<std::string> values;
+        size_t value_bytes = 0;
+        for (int i = 0; i < num_keys; i++) {
+            values.push_back(json_value(gen, i));
+            value_bytes += values.back().size();
+        }
+        std::string prefix = std::string("compress_") + mode.first + "_";
+
+        long rss_before = storage_rss_kb();
+        long network_before = loopback_bytes();
+        long client_before = client_cpu_us();
+        long storage_before = storage_cpu_us();
+        int successful_ops = 0;
+
+        auto put_start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < num_keys; i++) {
+            if (!client.put(prefix + std::to_string(i), {values[i]}).empty()) {
+                successful_ops++;
+            }
+        }
+        auto put_end = std::chrono::high_resolution_clock::now();
+
+        long put_network = loopback_bytes() - network_before;
+        long put_client = client_cpu_us() - client_before;
+        long put_storage = storage_cpu_us() - storage_before;
+        double rss_mb = (storage_rss_kb() - rss_before) / 1024.0;
+
+        network_before = loopback_bytes();
+        client_before = client_cpu_us();
+        storage_before = storage_cpu_us();
+
+        auto get_start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < num_keys; i++) {
+            val_t val = client.get(prefix + std::to_string(i));
+            if (val.size() == 1 && val[0] == values[i]) {
+                successful_ops++;
+            }
+        }
+        auto get_end = std::chrono::high_resolution_clock::now();
+
+        long get_network = loopback_bytes() - network_before;
+        long get_client = client_cpu_us() - client_before;
+        long get_storage = storage_cpu_us() - storage_before;
+
+        double put_throughput = num_keys / (std::chrono::duration_cast<std::chrono::microseconds>(put_end - put_start).count() / 1000000.0);
+        double get_throughput = num_keys / (std::chrono::duration_cast<std::chrono::microseconds>(get_end - get_start).count() / 1000000.0);
+
+        std::cout << mode.first << " (" << value_bytes / num_keys << "-byte values, success rate " << std::fixed << std::setprecision(2)
+                  << (successful_ops * 100.0 / (2 * num_keys)) << "%):" << std::endl;
+        std::cout << "  PUT " << put_throughput << " ops/sec, " << put_network / num_keys << " network bytes/op, client CPU "
+                  << put_client / num_keys << " us/op, storage CPU " << put_storage / num_keys << " us/op" << std::endl;
+        std::cout << "  GET " << get_throughput << " ops/sec, " << get_network / num_keys << " network bytes/op, client CPU "
+                  << get_client / num_keys << " us/op, storage CPU " << get_storage / num_keys << " us/op" << std::endl;
+        std::cout << "  Storage node memory growth: " << rss_mb << " MB (" << (rss_mb * 1024 * 1024 / num_keys / replicas)
+                  << " bytes per stored copy)" << std::endl;
+
+        outfile << replicas << " " << mode.first << " " << put_throughput << " " << get_throughput << " "
+                << put_network / num_keys << " " << get_network / num_keys << " " << put_client / num_keys << " "
+                << get_client / num_keys << " " << put_storage / num_keys << " " << get_storage / num_keys << " "
+                << rss_mb << std::endl;
+
+        client.finalize();
+    }
+
+    // Sleep to allow system to stabilize between tests
+    std::cout << "Waiting for system to stabilize..." << std::endl;
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+}
+
+void loadbalance_test(int num_inserts) {
+    GTStoreClient client;
+    client.init(1);
+    
+    std::unordered_map<std::string, int> node_counts;
+    std::vector<std::string> keys;
+    std::ofstream outfile("loadbalance_results.txt");
+    
+    std::cout << "\n=== Running load balance test ===" << std::endl;
+    
+    // Perform inserts with random keys
+    for (int i = 0; i < num_inserts; i++) {
+        std::string key = random_string(10);
+        std::string value = random_string(10);
+        keys.push_back(key);
+        
+        try {
+            std::vector<std::string> nodes = client.put(key, {value});
+            for (const auto& node : nodes) {
+                node_counts[node]++;
             }
         }
         catch (const std::exception& e) {
@@ -247,6 +1249,604 @@ void loadbalance_test(int num_inserts) {
     
     outfile.close();
     client.finalize();
+
+    placement_comparison(keys);
+}
+
+void skew_thread(int thread_id, int ops_per_thread, int num_keys, const GTStoreClientOptions& options,
+                 std::atomic<int>& successful_ops, std::vector<long>& latencies, std::mutex& latencies_mutex) {
+    GTStoreClient client;
+    client.init(thread_id, false, options);
+
+    std::mt19937_64 rng(std::random_device{}());
+    ZipfianGenerator zipfian(num_keys);
+    std::vector<long> thread_latencies;
+    thread_latencies.reserve(ops_per_thread);
+
+    for (int i = 0; i < ops_per_thread; i++) {
+        std::string key = "skew" + std::to_string(zipfian.next(rng));
+
+        auto op_start = std::chrono::high_resolution_clock::now();
+        bool success = !client.get(key).empty();
+        auto op_end = std::chrono::high_resolution_clock::now();
+
+        if (success) {
+            successful_ops++;
+            thread_latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(op_end - op_start).count());
+        }
+    }
+
+    client.finalize();
+
+    std::lock_guard<std::mutex> lock(latencies_mutex);
+    latencies.insert(latencies.end(), thread_latencies.begin(), thread_latencies.end());
+}
+
+// Zipfian GETs over 1000 keys, read from the first replica only, from the less loaded of two
+// random replicas, from two random replicas with hedging, and through a leased read cache,
+// reporting tail latency
+void skew_test(int num_ops, int replicas, int num_threads) {
+    std::ofstream outfile(results_path("skew_results.txt"), std::ios::app);
+    const int num_keys = 1000;
+
+    std::cout << "\n=== Running skewed read test with " << replicas << " replicas and "
+              << num_threads << " threads over " << num_keys << " keys ===" << std::endl;
+
+    GTStoreClient loader;
+    loader.init(0);
+    for (int i = 0; i < num_keys; i++) {
+        loader.put("skew" + std::to_string(i), {"val" + std::to_string(i)});
+    }
+    loader.finalize();
+
+    GTStoreClientOptions primary;
+    primary.balance_reads = false;
+    GTStoreClientOptions balanced;
+    GTStoreClientOptions hedged;
+    hedged.hedge_reads = true;
+    GTStoreClientOptions cached;
+    cached.cache_bytes = 16 << 20;
+
+    const std::pair<const char*, GTStoreClientOptions> modes[] = {
+        {"primary", primary},
+        {"balanced", balanced},
+        {"hedged", hedged},
+        {"cached", cached},
+    };
+
+    for (const auto& [name, options] : modes) {
+        std::atomic<int> successful_ops(0);
+        std::vector<long> latencies;
+        std::mutex latencies_mutex;
+        std::vector<std::thread> threads;
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        for (int i = 0; i < num_threads; i++) {
+            threads.emplace_back(skew_thread, i, num_ops / num_threads, num_keys, std::cref(options), std::ref(successful_ops),
+                                 std::ref(latencies), std::ref(latencies_mutex));
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+
+        std::sort(latencies.begin(), latencies.end());
+        double throughput = static_cast<double>(successful_ops) / (duration.count() / 1000.0);
+
+        std::cout << name << ": " << std::fixed << std::setprecision(2) << throughput << " ops/sec, GET p50 "
+                  << percentile(latencies, 50) << " us, p99 " << percentile(latencies, 99) << " us, p99.9 "
+                  << percentile(latencies, 99.9) << " us" << std::endl;
+
+        outfile << name << " " << replicas << " " << num_threads << " " << throughput << " " << percentile(latencies, 50)
+                << " " << percentile(latencies, 99) << " " << percentile(latencies, 99.9) << std::endl;
+    }
+
+    // Sleep to allow system to stabilize between tests
+    std::cout << "Waiting for system to stabilize..." << std::endl;
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+}
+
+// Names of KeyDistribution and SizeDistribution values, for options and results
+const char* const key_distribution_names[] = {"uniform", "zipfian", "latest", "hotspot"};
+const char* const size_distribution_names[] = {"fixed", "uniform", "zipfian"};
+const char* const workload_op_names[] = {"read", "update", "insert"};
+
+// Long options that only tune --workload
+enum WorkloadOption {
+    OPT_THREADS = 256,
+    OPT_RECORDS,
+    OPT_READ,
+    OPT_INSERT,
+    OPT_DISTRIBUTION,
+    OPT_VALUE_SIZE,
+    OPT_VALUE_DISTRIBUTION,
+    OPT_RATE,
+    OPT_WARMUP,
+    OPT_DURATION,
+    OPT_TRACE_SAMPLE
+};
+
+// Position of name in names, or -1
+template <size_t N>
+int name_index(const char* const (&names)[N], const char* name) {
+    for (size_t i = 0; i < N; i++) {
+        if (std::strcmp(names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Latencies and failures of one thread's measured operations, by Workload::Op
+struct WorkloadResults {
+    LatencyHistogram latencies[3];
+    uint64_t errors[3] = {0, 0, 0};
+
+    void merge(const WorkloadResults& other) {
+        for (int op = 0; op < 3; op++) {
+            latencies[op].merge(other.latencies[op]);
+            errors[op] += other.errors[op];
+        }
+    }
+};
+
+// Write this thread's share of the workload's records
+void workload_load_thread(Workload& workload, int thread_id, const std::string& values) {
+    GTStoreClient client;
+    client.init(thread_id);
+    std::mt19937_64 rng(thread_id);
+
+    const WorkloadSpec& spec = workload.spec;
+    uint64_t per_thread = (spec.records + spec.threads - 1) / spec.threads;
+    uint64_t begin = std::min<uint64_t>(spec.records, thread_id * per_thread);
+    uint64_t end = std::min<uint64_t>(spec.records, begin + per_thread);
+
+    std::vector<std::pair<std::string, val_t>> batch;
+    for (uint64_t id = begin; id < end; id++) {
+        batch.push_back({Workload::key_name(id), {values.substr(0, workload.next_value_size(rng))}});
+        if (batch.size() == WORKLOAD_LOAD_BATCH || id + 1 == end) {
+            client.multi_put(batch);
+            batch.clear();
+        }
+    }
+
+    client.finalize();
+}
+
+// Run operations from start until the warm-up and measured periods are over, recording
+// those due after the warm-up. At a target rate, operations are due at fixed intervals and
+// latency counts from when one was due, so a backlog shows up in it instead of slowing
+// the arrivals down.
+void workload_thread(Workload& workload, int thread_id, std::chrono::steady_clock::time_point start,
+                     const std::string& values, const GTStoreClientOptions& options, WorkloadResults& results) {
+    GTStoreClient client;
+    client.init(thread_id, false, options);
+    std::mt19937_64 rng{std::random_device()()};
+
+    const WorkloadSpec& spec = workload.spec;
+    auto measure_from = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(spec.warmup_s));
+    auto end = measure_from + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(spec.duration_s));
+    bool open_loop = spec.target_ops > 0;
+    auto interval = open_loop ? std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(spec.threads / spec.target_ops))
+                              : std::chrono::nanoseconds(0);
+    // Threads start a fraction of an interval apart so their arrivals interleave
+    auto due = start + interval * thread_id / spec.threads;
+
+    while (true) {
+        if (open_loop) {
+            std::this_thread::sleep_until(due);
+        }
+        else {
+            due = std::chrono::steady_clock::now();
+        }
+        if (due >= end) {
+            break;
+        }
+
+        Workload::Op op = workload.next_op(rng);
+        bool ok;
+        if (op == Workload::READ) {
+            ok = !client.get(Workload::key_name(workload.next_key(rng))).empty();
+        }
+        else if (op == Workload::UPDATE) {
+            ok = !client.put(Workload::key_name(workload.next_key(rng)), {values.substr(0, workload.next_value_size(rng))}).empty();
+        }
+        else {
+            uint64_t id = workload.next_insert();
+            ok = !client.put(Workload::key_name(id), {values.substr(0, workload.next_value_size(rng))}).empty();
+            workload.insert_done(id);
+        }
+
+        if (due >= measure_from) {
+            auto latency = std::chrono::steady_clock::now() - due;
+            results.latencies[op].record(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+            results.errors[op] += !ok;
+        }
+        due += interval;
+    }
+
+    client.finalize();
+}
+
+// One line of WORKLOAD_RESULTS: the spec, throughput, and per operation its count, errors,
+// latency percentiles in microseconds and the non-empty histogram buckets
+void write_workload_json(std::ostream& out, const WorkloadSpec& spec, const WorkloadResults& results, double throughput) {
+    out << "{\"workload\": \"" << spec.name << "\", \"threads\": " << spec.threads
+        << ", \"records\": " << spec.records
+        << ", \"read_proportion\": " << spec.read_proportion
+        << ", \"insert_proportion\": " << spec.insert_proportion
+        << ", \"key_distribution\": \"" << key_distribution_names[static_cast<int>(spec.key_distribution)] << "\""
+        << ", \"value_size\": [" << spec.min_value_size << ", " << spec.max_value_size << "]"
+        << ", \"size_distribution\": \"" << size_distribution_names[static_cast<int>(spec.size_distribution)] << "\""
+        << ", \"target_ops\": " << spec.target_ops
+        << ", \"warmup_s\": " << spec.warmup_s
+        << ", \"duration_s\": " << spec.duration_s
+        << ", \"throughput\": " << throughput
+        << ", \"ops\": {";
+
+    bool first = true;
+    for (int op = 0; op < 3; op++) {
+        const LatencyHistogram& latencies = results.latencies[op];
+        if (latencies.count() == 0) {
+            continue;
+        }
+
+        out << (first ? "" : ", ") << "\"" << workload_op_names[op] << "\": {\"count\": " << latencies.count()
+            << ", \"errors\": " << results.errors[op]
+            << ", \"mean_us\": " << latencies.mean()
+            << ", \"p50_us\": " << latencies.percentile(50)
+            << ", \"p99_us\": " << latencies.percentile(99)
+            << ", \"p999_us\": " << latencies.percentile(99.9)
+            << ", \"max_us\": " << latencies.max()
+            << ", \"histogram\": [";
+        auto buckets = latencies.buckets();
+        for (size_t i = 0; i < buckets.size(); i++) {
+            out << (i == 0 ? "" : ", ") << "[" << buckets[i].first << ", " << buckets[i].second << "]";
+        }
+        out << "]}";
+        first = false;
+    }
+    out << "}}" << std::endl;
+}
+
+// Load the workload's records, then run it from spec.threads clients with options and report
+// throughput and latency percentiles per operation
+void workload_test(const WorkloadSpec& spec, const GTStoreClientOptions& options) {
+    std::ofstream outfile(results_path(WORKLOAD_RESULTS), std::ios::app);
+
+    std::cout << "\n=== Running workload " << spec.name << " with " << spec.threads << " threads over "
+              << spec.records << " keys ===" << std::endl;
+
+    Workload workload(spec);
+    std::string values = random_string(spec.max_value_size);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < spec.threads; i++) {
+        threads.emplace_back(workload_load_thread, std::ref(workload), i, std::cref(values));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    workload.loaded();
+    std::cout << "Loaded " << spec.records << " records, warming up for " << spec.warmup_s << " s" << std::endl;
+
+    std::vector<WorkloadResults> thread_results(spec.threads);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < spec.threads; i++) {
+        threads.emplace_back(workload_thread, std::ref(workload), i, start, std::cref(values), std::cref(options),
+                             std::ref(thread_results[i]));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    WorkloadResults results;
+    uint64_t ops = 0;
+    for (const auto& thread_result : thread_results) {
+        results.merge(thread_result);
+    }
+    for (int op = 0; op < 3; op++) {
+        ops += results.latencies[op].count();
+    }
+    double throughput = ops / spec.duration_s;
+
+    std::cout << "Throughput: " << std::fixed << std::setprecision(2) << throughput << " ops/sec" << std::endl;
+    for (int op = 0; op < 3; op++) {
+        const LatencyHistogram& latencies = results.latencies[op];
+        if (latencies.count() == 0) {
+            continue;
+        }
+        std::cout << workload_op_names[op] << ": " << latencies.count() << " ops, " << results.errors[op]
+                  << " errors, p50 " << latencies.percentile(50) << " us, p99 " << latencies.percentile(99)
+                  << " us, p99.9 " << latencies.percentile(99.9) << " us, max " << latencies.max() << " us" << std::endl;
+    }
+
+    write_workload_json(outfile, spec, results, throughput);
+
+    // Sleep to allow system to stabilize between tests
+    std::cout << "Waiting for system to stabilize..." << std::endl;
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+}
+
+// Upper bound of the bucket holding percentile p of a stats histogram
+uint64_t stats_percentile(const StatsMetric& metric, double p) {
+    uint64_t rank = std::max<uint64_t>(1, std::ceil(p / 100.0 * metric.count()));
+    uint64_t seen = 0;
+    for (int i = 0; i < metric.bucket_counts_size(); i++) {
+        seen += metric.bucket_counts(i);
+        if (seen >= rank) {
+            return metric.bucket_bounds(i);
+        }
+    }
+    return 0;
+}
+
+std::string stats_label(const StatsMetric& metric, const std::string& label) {
+    auto it = metric.labels().find(label);
+    return it == metric.labels().end() ? "" : it->second;
+}
+
+void write_stats_json(std::ostream& out, const std::string& server, const google::protobuf::RepeatedPtrField<StatsMetric>& metrics) {
+    out << "{\"server\": \"" << server << "\", \"metrics\": [";
+    for (int i = 0; i < metrics.size(); i++) {
+        const StatsMetric& metric = metrics[i];
+        out << (i == 0 ? "" : ", ") << "{\"name\": \"" << metric.name() << "\", \"labels\": {";
+        bool first = true;
+        for (const auto& [label, value] : metric.labels()) {
+            out << (first ? "" : ", ") << "\"" << label << "\": \"" << value << "\"";
+            first = false;
+        }
+        out << "}";
+
+        if (metric.bucket_counts_size() == 0) {
+            out << ", \"value\": " << metric.value() << "}";
+            continue;
+        }
+        out << ", \"count\": " << metric.count() << ", \"sum\": " << metric.sum() << ", \"buckets\": [";
+        for (int b = 0; b < metric.bucket_counts_size(); b++) {
+            out << (b == 0 ? "" : ", ") << "[" << metric.bucket_bounds(b) << ", " << metric.bucket_counts(b) << "]";
+        }
+        out << "]}";
+    }
+    out << "]}" << std::endl;
+}
+
+// Print what the metrics of one server say about it: latency of each RPC it served, locks
+// that made threads wait, and its gauges
+void print_stats(const std::string& server, const google::protobuf::RepeatedPtrField<StatsMetric>& metrics) {
+    std::cout << "\n" << server << ":" << std::endl;
+
+    std::map<std::string, std::map<std::string, double>> locks;
+    for (const auto& metric : metrics) {
+        if (metric.name() == "gtstore_rpc_latency_us" && metric.count() > 0) {
+            std::cout << "- " << stats_label(metric, "rpc") << ": " << metric.count() << " calls, mean "
+                      << std::fixed << std::setprecision(1) << metric.sum() / metric.count() << " us, p50 <= "
+                      << stats_percentile(metric, 50) << " us, p99 <= " << stats_percentile(metric, 99) << " us" << std::endl;
+        }
+        else if (metric.name().rfind("gtstore_lock_", 0) == 0) {
+            locks[stats_label(metric, "lock")][metric.name()] = metric.value();
+        }
+        else if (metric.bucket_counts_size() == 0) {
+            std::cout << "- " << metric.name() << ": " << std::fixed << std::setprecision(0) << metric.value() << std::endl;
+        }
+        else if (metric.count() > 0) {
+            std::cout << "- " << metric.name() << ": " << metric.count() << " waits, p99 <= " << stats_percentile(metric, 99) << " us" << std::endl;
+        }
+    }
+
+    for (auto& [lock, values] : locks) {
+        double acquired = values["gtstore_lock_acquired_total"];
+        double contended = values["gtstore_lock_contended_total"];
+        if (acquired == 0) {
+            continue;
+        }
+        std::cout << "- " << lock << " lock: " << std::fixed << std::setprecision(0) << acquired << " acquisitions, "
+                  << std::setprecision(2) << contended / acquired * 100 << "% contended, "
+                  << std::setprecision(0) << values["gtstore_lock_wait_us_total"] << " us waiting" << std::endl;
+    }
+}
+
+// Read the metrics of the manager and every storage node on its ring through their stats RPCs
+void stats_scrape() {
+    std::ofstream outfile(STATS_RESULTS, std::ios::app);
+
+    std::cout << "\n=== Scraping server metrics ===" << std::endl;
+
+    auto manager = GTStoreManagerService::NewStub(grpc::CreateChannel("localhost:50000", grpc::InsecureChannelCredentials()));
+    ManagerStatsResponse manager_stats;
+    ClientContext stats_context;
+    if (!manager->stats(&stats_context, ManagerStatsRequest(), &manager_stats).ok()) {
+        std::cerr << "Cannot get stats from the manager" << std::endl;
+        return;
+    }
+    print_stats("manager", manager_stats.metrics());
+    write_stats_json(outfile, "manager", manager_stats.metrics());
+
+    ManagerGetRingResponse ring;
+    ClientContext ring_context;
+    if (!manager->get_ring(&ring_context, ManagerGetRingRequest(), &ring).ok()) {
+        std::cerr << "Cannot get the ring from the manager" << std::endl;
+        return;
+    }
+
+    for (int i = 0; i < ring.storage_nodes_size(); i++) {
+        const std::string& node = ring.storage_nodes(i);
+        if (ring.down(i)) {
+            continue;
+        }
+
+        auto stub = GTStoreStorageService::NewStub(grpc::CreateChannel(node, grpc::InsecureChannelCredentials()));
+        StorageStatsResponse node_stats;
+        ClientContext context;
+        context.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(1));
+        if (!stub->stats(&context, StorageStatsRequest(), &node_stats).ok()) {
+            std::cerr << "Cannot get stats from " << node << std::endl;
+            continue;
+        }
+        print_stats(node, node_stats.metrics());
+        write_stats_json(outfile, node, node_stats.metrics());
+    }
+}
+
+// Spans of one process, named for the trace viewer
+struct TraceProcess {
+    std::string name;
+    std::vector<SpanRecord> spans;
+};
+
+std::vector<SpanRecord> trace_spans(const google::protobuf::RepeatedPtrField<TracedSpan>& spans) {
+    std::vector<SpanRecord> records;
+    for (const auto& span : spans) {
+        records.push_back({span.trace_id(), span.span_id(), span.parent_id(), span.name(), span.peer(),
+                           span.start_us(), span.duration_us(), span.thread()});
+    }
+    return records;
+}
+
+// The spans this process recorded, then those of the manager and every storage node on its
+// ring, through their trace RPCs
+std::vector<TraceProcess> trace_collect() {
+    std::vector<TraceProcess> processes;
+    processes.push_back({"client", Tracer::instance().spans()});
+
+    auto manager = GTStoreManagerService::NewStub(grpc::CreateChannel("localhost:50000", grpc::InsecureChannelCredentials()));
+    ManagerTraceResponse manager_trace;
+    ClientContext trace_context;
+    if (!manager->trace(&trace_context, ManagerTraceRequest(), &manager_trace).ok()) {
+        std::cerr << "Cannot get spans from the manager" << std::endl;
+        return processes;
+    }
+    processes.push_back({"manager", trace_spans(manager_trace.spans())});
+
+    ManagerGetRingResponse ring;
+    ClientContext ring_context;
+    if (!manager->get_ring(&ring_context, ManagerGetRingRequest(), &ring).ok()) {
+        std::cerr << "Cannot get the ring from the manager" << std::endl;
+        return processes;
+    }
+
+    for (int i = 0; i < ring.storage_nodes_size(); i++) {
+        const std::string& node = ring.storage_nodes(i);
+        if (ring.down(i)) {
+            continue;
+        }
+
+        auto stub = GTStoreStorageService::NewStub(grpc::CreateChannel(node, grpc::InsecureChannelCredentials()));
+        StorageTraceResponse node_trace;
+        ClientContext context;
+        context.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(5));
+        if (!stub->trace(&context, StorageTraceRequest(), &node_trace).ok()) {
+            std::cerr << "Cannot get spans from " << node << std::endl;
+            continue;
+        }
+        processes.push_back({node, trace_spans(node_trace.spans())});
+    }
+    return processes;
+}
+
+std::string trace_id_hex(uint64_t id) {
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016" PRIx64, id);
+    return buffer;
+}
+
+// The Trace Event Format chrome://tracing and Perfetto read: a complete event per span, with
+// one process per server and the span's ids in its args
+void write_chrome_trace(std::ostream& out, const std::vector<TraceProcess>& processes) {
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    for (size_t pid = 0; pid < processes.size(); pid++) {
+        out << (first ? "" : ",") << "\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid
+            << ", \"args\": {\"name\": \"" << processes[pid].name << "\"}}";
+        first = false;
+
+        for (const SpanRecord& span : processes[pid].spans) {
+            out << ",\n{\"name\": \"" << span.name << "\", \"cat\": \"gtstore\", \"ph\": \"X\", \"ts\": " << span.start_us
+                << ", \"dur\": " << span.duration_us << ", \"pid\": " << pid << ", \"tid\": " << span.thread
+                << ", \"args\": {\"trace_id\": \"" << trace_id_hex(span.trace_id) << "\", \"span_id\": \"" << trace_id_hex(span.span_id)
+                << "\", \"parent_id\": \"" << trace_id_hex(span.parent_id) << "\"";
+            if (!span.peer.empty()) {
+                out << ", \"peer\": \"" << span.peer << "\"";
+            }
+            out << "}}";
+        }
+    }
+    out << "\n]}" << std::endl;
+}
+
+// Print the TRACE_SLOWEST longest traced operations as trees of their spans, each with its
+// offset from the start of the operation, its duration and the process that recorded it
+void print_slowest_traces(const std::vector<TraceProcess>& processes) {
+    struct Node {
+        const SpanRecord* span;
+        const std::string* process;
+    };
+    std::vector<Node> roots;
+    std::unordered_map<uint64_t, std::vector<Node>> children;
+
+    for (const TraceProcess& process : processes) {
+        for (const SpanRecord& span : process.spans) {
+            if (span.parent_id == 0) {
+                roots.push_back({&span, &process.name});
+            }
+            else {
+                children[span.parent_id].push_back({&span, &process.name});
+            }
+        }
+    }
+
+    std::sort(roots.begin(), roots.end(), [](const Node& a, const Node& b) {
+        return a.span->duration_us > b.span->duration_us;
+    });
+    for (auto& [parent_id, nodes] : children) {
+        std::sort(nodes.begin(), nodes.end(), [](const Node& a, const Node& b) {
+            return a.span->start_us < b.span->start_us;
+        });
+    }
+
+    std::function<void(const Node&, uint64_t, int)> print = [&](const Node& node, uint64_t origin, int depth) {
+        std::cout << std::string(2 * depth, ' ') << "+" << (int64_t) (node.span->start_us - origin) << " us "
+                  << node.span->name << " " << node.span->duration_us << " us on " << *node.process;
+        if (!node.span->peer.empty()) {
+            std::cout << " to " << node.span->peer;
+        }
+        std::cout << std::endl;
+
+        auto it = children.find(node.span->span_id);
+        if (it != children.end()) {
+            for (const Node& child : it->second) {
+                print(child, origin, depth + 1);
+            }
+        }
+    };
+
+    std::cout << "\nSlowest of " << roots.size() << " traced operations:" << std::endl;
+    for (size_t i = 0; i < roots.size() && i < TRACE_SLOWEST; i++) {
+        std::cout << "\nTrace " << trace_id_hex(roots[i].span->trace_id) << ":" << std::endl;
+        print(roots[i], roots[i].span->start_us, 1);
+    }
+}
+
+// Gather every process's spans into a Chrome trace at path and break down the slowest
+void trace_dump(const std::string& path) {
+    std::cout << "\n=== Collecting traces ===" << std::endl;
+
+    std::vector<TraceProcess> processes = trace_collect();
+    size_t spans = 0;
+    for (const TraceProcess& process : processes) {
+        spans += process.spans.size();
+    }
+
+    std::ofstream outfile(path);
+    write_chrome_trace(outfile, processes);
+    std::cout << "Wrote " << spans << " spans from " << processes.size() << " processes to " << path << std::endl;
+
+    print_slowest_traces(processes);
 }
 
 int main(int argc, char** argv) {
@@ -254,6 +1854,32 @@ int main(int argc, char** argv) {
         {"throughput", required_argument, 0, 't'},
         {"concurrent", required_argument, 0, 'c'},
         {"loadbalance", no_argument, 0, 'l'},
+        {"batch", required_argument, 0, 'b'},
+        {"scan", required_argument, 0, 'e'},
+        {"compression", required_argument, 0, 'g'},
+        {"contention", required_argument, 0, 'z'},
+        {"values", required_argument, 0, 'v'},
+        {"durability", required_argument, 0, 'd'},
+        {"rebalance", required_argument, 0, 'r'},
+        {"ring", no_argument, 0, 'n'},
+        {"consistency", required_argument, 0, 'k'},
+        {"skew", required_argument, 0, 's'},
+        {"window", required_argument, 0, 'w'},
+        {"workload", required_argument, 0, 'y'},
+        {"stats", no_argument, 0, 'm'},
+        {"results", required_argument, 0, 'o'},
+        {"trace", required_argument, 0, 'x'},
+        {"threads", required_argument, 0, OPT_THREADS},
+        {"records", required_argument, 0, OPT_RECORDS},
+        {"read", required_argument, 0, OPT_READ},
+        {"insert", required_argument, 0, OPT_INSERT},
+        {"distribution", required_argument, 0, OPT_DISTRIBUTION},
+        {"value-size", required_argument, 0, OPT_VALUE_SIZE},
+        {"value-distribution", required_argument, 0, OPT_VALUE_DISTRIBUTION},
+        {"rate", required_argument, 0, OPT_RATE},
+        {"warmup", required_argument, 0, OPT_WARMUP},
+        {"duration", required_argument, 0, OPT_DURATION},
+        {"trace-sample", required_argument, 0, OPT_TRACE_SAMPLE},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
@@ -261,11 +1887,31 @@ int main(int argc, char** argv) {
     bool run_throughput = false;
     bool run_concurrent = false;
     bool run_loadbalance = false;
+    bool run_batch = false;
+    bool run_scan = false;
+    bool run_compression = false;
+    bool run_contention = false;
+    bool run_values = false;
+    bool run_durability = false;
+    bool run_rebalance = false;
+    bool run_ring = false;
+    bool run_consistency = false;
+    bool run_skew = false;
     int replicas = 0;
     int num_threads = 1;
+    int window = 0;
+    bool run_workload = false;
+    bool run_stats = false;
+    std::string trace_path;
+    double trace_sample = TRACE_DEFAULT_SAMPLE;
+    WorkloadSpec spec;
+    // Set by options that override the preset, whichever order they come in
+    double read_proportion = -1;
+    double insert_proportion = -1;
+    int key_distribution = -1;
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "t:c:lh", long_options, nullptr)) != -1) {
+    while ((opt = getopt_long(argc, argv, "t:c:lb:e:g:z:v:d:r:nk:s:w:y:mo:x:h", long_options, nullptr)) != -1) {
         switch (opt) {
             case 't':
                 run_throughput = true;
@@ -281,6 +1927,131 @@ int main(int argc, char** argv) {
             case 'l':
                 run_loadbalance = true;
                 break;
+            case 'b':
+                run_batch = true;
+                replicas = std::atoi(optarg);
+                break;
+            case 'e':
+                run_scan = true;
+                replicas = std::atoi(optarg);
+                break;
+            case 'g':
+                run_compression = true;
+                replicas = std::atoi(optarg);
+                break;
+            case 'z':
+                run_contention = true;
+                if (optind < argc) {
+                    replicas = std::atoi(optarg);
+                    num_threads = std::atoi(argv[optind]);
+                }
+                break;
+            case 'v':
+                run_values = true;
+                replicas = std::atoi(optarg);
+                break;
+            case 'd':
+                run_durability = true;
+                if (optind < argc) {
+                    replicas = std::atoi(optarg);
+                    num_threads = std::atoi(argv[optind]);
+                }
+                break;
+            case 'r':
+                run_rebalance = true;
+                if (optind < argc) {
+                    replicas = std::atoi(optarg);
+                    num_threads = std::atoi(argv[optind]);
+                }
+                break;
+            case 'n':
+                run_ring = true;
+                break;
+            case 'k':
+                run_consistency = true;
+                if (optind < argc) {
+                    replicas = std::atoi(optarg);
+                    num_threads = std::atoi(argv[optind]);
+                }
+                break;
+            case 's':
+                run_skew = true;
+                if (optind < argc) {
+                    replicas = std::atoi(optarg);
+                    num_threads = std::atoi(argv[optind]);
+                }
+                break;
+            case 'w':
+                window = std::atoi(optarg);
+                break;
+            case 'y':
+                run_workload = true;
+                if (!spec.preset(optarg)) {
+                    std::cerr << "Error: Unknown workload " << optarg << "\n";
+                    return 1;
+                }
+                break;
+            case 'm':
+                run_stats = true;
+                break;
+            case 'x':
+                trace_path = optarg;
+                break;
+            case OPT_THREADS:
+                spec.threads = std::atoi(optarg);
+                break;
+            case OPT_RECORDS:
+                spec.records = std::atoll(optarg);
+                break;
+            case OPT_READ:
+                read_proportion = std::atof(optarg);
+                break;
+            case OPT_INSERT:
+                insert_proportion = std::atof(optarg);
+                break;
+            case OPT_DISTRIBUTION:
+                key_distribution = name_index(key_distribution_names, optarg);
+                if (key_distribution < 0) {
+                    std::cerr << "Error: Unknown key distribution " << optarg << "\n";
+                    return 1;
+                }
+                break;
+            case OPT_VALUE_SIZE: {
+                const char* colon = std::strchr(optarg, ':');
+                spec.min_value_size = std::atoll(optarg);
+                spec.max_value_size = colon ? std::atoll(colon + 1) : spec.min_value_size;
+                if (!colon) {
+                    spec.size_distribution = SizeDistribution::FIXED;
+                }
+                else if (spec.size_distribution == SizeDistribution::FIXED) {
+                    spec.size_distribution = SizeDistribution::UNIFORM;
+                }
+                break;
+            }
+            case OPT_VALUE_DISTRIBUTION: {
+                int distribution = name_index(size_distribution_names, optarg);
+                if (distribution < 0) {
+                    std::cerr << "Error: Unknown value size distribution " << optarg << "\n";
+                    return 1;
+                }
+                spec.size_distribution = static_cast<SizeDistribution>(distribution);
+                break;
+            }
+            case OPT_RATE:
+                spec.target_ops = std::atof(optarg);
+                break;
+            case OPT_WARMUP:
+                spec.warmup_s = std::atof(optarg);
+                break;
+            case OPT_DURATION:
+                spec.duration_s = std::atof(optarg);
+                break;
+            case OPT_TRACE_SAMPLE:
+                trace_sample = std::atof(optarg);
+                break;
+            case 'o':
+                g_results_path = optarg;
+                break;
             case 'h':
                 print_usage();
                 return 0;
@@ -290,8 +2061,8 @@ int main(int argc, char** argv) {
         }
     }
 
-    if (!run_throughput && !run_concurrent && !run_loadbalance) {
-        std::cerr << "Error: Must specify either --throughput <replicas>, --concurrent <replicas> <threads>, or --loadbalance\n";
+    if (!run_throughput && !run_concurrent && !run_loadbalance && !run_batch && !run_scan && !run_compression && !run_contention && !run_values && !run_durability && !run_rebalance && !run_ring && !run_consistency && !run_skew && !run_workload && !run_stats && trace_path.empty()) {
+        std::cerr << "Error: Must specify either --throughput <replicas>, --concurrent <replicas> <threads>, --batch <replicas>, --scan <replicas>, --compression <replicas>, --contention <replicas> <threads>, --values <replicas>, --durability <replicas> <threads>, --rebalance <replicas> <threads>, --ring, --consistency <replicas> <threads>, --skew <replicas> <threads>, --workload <a|b|c|d>, --stats, --trace <file>, or --loadbalance\n";
         return 1;
     }
 
@@ -300,7 +2071,12 @@ int main(int argc, char** argv) {
             std::cerr << "Error: Number of replicas must be positive\n";
             return 1;
         }
-        single_client_throughput_test(200000, replicas);
+        if (window > 0) {
+            windowed_throughput_test(200000, replicas, window);
+        }
+        else {
+            single_client_throughput_test(200000, replicas);
+        }
     }
 
     if (run_concurrent) {
@@ -311,9 +2087,113 @@ int main(int argc, char** argv) {
         throughput_test(200000, replicas, num_threads);
     }
 
+    if (run_batch) {
+        if (replicas <= 0) {
+            std::cerr << "Error: Number of replicas must be positive\n";
+            return 1;
+        }
+        batch_throughput_test(20000, replicas);
+    }
+
+    if (run_scan) {
+        if (replicas <= 0) {
+            std::cerr << "Error: Number of replicas must be positive\n";
+            return 1;
+        }
+        scan_test(20000, replicas);
+    }
+
+    if (run_compression) {
+        if (replicas <= 0) {
+            std::cerr << "Error: Number of replicas must be positive\n";
+            return 1;
+        }
+        compression_test(20000, replicas);
+    }
+
+    if (run_contention) {
+        if (replicas <= 0 || num_threads <= 0) {
+            std::cerr << "Error: Number of replicas and threads must be positive\n";
+            return 1;
+        }
+        contention_test(20000, replicas, num_threads);
+    }
+
+    if (run_values) {
+        if (replicas <= 0) {
+            std::cerr << "Error: Number of replicas must be positive\n";
+            return 1;
+        }
+        value_size_test(50000, replicas);
+    }
+
+    if (run_durability) {
+        if (replicas <= 0 || num_threads <= 0) {
+            std::cerr << "Error: Number of replicas and threads must be positive\n";
+            return 1;
+        }
+        durability_test(100000, replicas, num_threads);
+    }
+
+    if (run_rebalance) {
+        if (replicas <= 0 || num_threads <= 0) {
+            std::cerr << "Error: Number of replicas and threads must be positive\n";
+            return 1;
+        }
+        rebalance_test(replicas, num_threads);
+    }
+
+    if (run_consistency) {
+        if (replicas <= 0 || num_threads <= 0) {
+            std::cerr << "Error: Number of replicas and threads must be positive\n";
+            return 1;
+        }
+        consistency_test(40000, replicas, num_threads);
+    }
+
+    if (run_skew) {
+        if (replicas <= 0 || num_threads <= 0) {
+            std::cerr << "Error: Number of replicas and threads must be positive\n";
+            return 1;
+        }
+        skew_test(60000, replicas, num_threads);
+    }
+
+    if (run_workload) {
+        if (read_proportion >= 0) {
+            spec.read_proportion = read_proportion;
+        }
+        if (insert_proportion >= 0) {
+            spec.insert_proportion = insert_proportion;
+        }
+        if (key_distribution >= 0) {
+            spec.key_distribution = static_cast<KeyDistribution>(key_distribution);
+        }
+        if (spec.threads <= 0 || spec.duration_s <= 0 || spec.max_value_size < spec.min_value_size
+                || spec.read_proportion + spec.insert_proportion > 1) {
+            std::cerr << "Error: Workload needs positive threads and duration, a value size range with min <= max, and read + insert <= 1\n";
+            return 1;
+        }
+        GTStoreClientOptions options;
+        options.trace_sample = trace_path.empty() ? 0 : trace_sample;
+        workload_test(spec, options);
+    }
+
+    if (run_ring) {
+        ring_lookup_test(200000);
+    }
+
     if (run_loadbalance) {
         loadbalance_test(100000);
     }
 
+    if (run_stats) {
+        stats_scrape();
+    }
+
+    if (!trace_path.empty()) {
+        trace_dump(trace_path);
+    }
+
     return 0;
 }
@@ -1,18 +1,342 @@
 #include <memory>
 #include <string>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <set>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <future>
+#include <functional>
+#include <deque>
 #include "gtstore.hpp"
+#include "hash_ring.hpp"
+#include "read_cache.hpp"
+#include "compression.hpp"
+#include "trace.hpp"
+
+#define MANAGER_ADDRESS "localhost:50000"
+// Connections the clients of a process open to each storage node
+#define CHANNELS_PER_NODE 4
+// How long a keepalive ping may go unanswered before its connection is dropped
+#define CHANNEL_KEEPALIVE_TIMEOUT_MS 10000
+// How long a cached ring is trusted before asking the manager whether its epoch moved
+#define RING_REFRESH_INTERVAL_MS 1000
+// Prepares that wait longer than this on a busy key are aborted and retried after a backoff
+#define PREPARE_TIMEOUT_MS 500
+#define PUT_BACKOFF_MS 5
+// Deadline of a chain PUT, for the whole chain; each node passes on a little less of it
+#define CHAIN_PUT_TIMEOUT_MS 2500
+// Times in a row a chain PUT may time out before the node that held it up is reported
+#define CHAIN_PUT_ATTEMPTS 5
+// Deadline of commits and aborts nobody waits for
+#define DETACHED_CALL_TIMEOUT_MS 1000
+// Deadline of the one call behind most get_async and put_async requests; one that runs out is
+// retried with the blocking calls
+#define ASYNC_CALL_TIMEOUT_MS 5000
+// Weight of the newest sample in a node's moving average of GET latency
+#define LATENCY_EWMA_WEIGHT 0.2
+// An idle node's average latency fades with this time constant, so a node that was slow
+// once gets tried again
+#define LATENCY_DECAY_MS 1000
+// GET latencies kept to estimate the p95 hedged reads wait for; hedging starts once this
+// many were seen, and the estimate is refreshed every HEDGE_REFRESH samples
+#define HEDGE_WINDOW 1000
+#define HEDGE_REFRESH 100
 
 bool g_verbose = false;
 
+template <class Request, class Response>
+using StorageAsyncCall = std::unique_ptr<grpc::ClientAsyncResponseReader<Response>> (GTStoreStorageService::Stub::*)(ClientContext*, const Request&, grpc::CompletionQueue*);
+
+// Names of the storage RPCs sent through fan_out and detach, by request, for their spans.
+// StoragePutRequest goes out there only as a one-phase put; prepares name their own.
+inline const char* trace_name(const StorageGetRequest&) { return "get"; }
+inline const char* trace_name(const StoragePutRequest&) { return "put"; }
+inline const char* trace_name(const StorageCommitPutRequest&) { return "commit_put"; }
+inline const char* trace_name(const StorageAbortPutRequest&) { return "abort_put"; }
+inline const char* trace_name(const StorageChainPutRequest&) { return "chain_put"; }
+inline const char* trace_name(const StorageMultiGetRequest&) { return "multi_get"; }
+inline const char* trace_name(const StorageMultiPutRequest&) { return "multi_prepare_put"; }
+inline const char* trace_name(const StorageMultiCommitPutRequest&) { return "multi_commit_put"; }
+inline const char* trace_name(const StorageMultiAbortPutRequest&) { return "multi_abort_put"; }
+inline const char* trace_name(const StorageRepairRequest&) { return "repair"; }
+
+// Recent load of a storage node as seen by the clients of this process
+struct NodeLoad {
+	// GETs sent to the node and not answered yet
+	std::atomic<int> outstanding{0};
+	// Moving average of GET latency in microseconds. Concurrent updates may drop a sample.
+	std::atomic<double> latency_us{0};
+	std::atomic<int64_t> sampled_at_ms{0};
+
+	// Expected wait for one more GET; a node without samples looks free, so it gets some
+	double cost() const {
+		double idle_ms = now_ms() - sampled_at_ms.load(std::memory_order_relaxed);
+		return (outstanding.load(std::memory_order_relaxed) + 1) * latency_us.load(std::memory_order_relaxed)
+			* std::exp(-std::max(idle_ms, 0.0) / LATENCY_DECAY_MS);
+	}
+
+	void sample(double us) {
+		double average = latency_us.load(std::memory_order_relaxed);
+		latency_us.store(average == 0 ? us : average + LATENCY_EWMA_WEIGHT * (us - average), std::memory_order_relaxed);
+		sampled_at_ms.store(now_ms(), std::memory_order_relaxed);
+	}
+
+	static int64_t now_ms() {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// The load of a node, shared by every client in the process; never freed
+	static NodeLoad* of(const std::string& storage_node) {
+		static std::mutex mutex;
+		static std::unordered_map<std::string, NodeLoad*> loads;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		NodeLoad*& load = loads[storage_node];
+		if (!load) {
+			load = new NodeLoad();
+		}
+		return load;
+	}
+};
+
+// Stubs shared by every client in the process, created on first use; gRPC connects a
+// channel once its first call is made. Each storage node gets CHANNELS_PER_NODE channels,
+// each with its own connection, handed out in turn: a client keeps the stub it was given, so
+// many client threads spread over the connections instead of sharing one socket.
+class ChannelPool {
+	public:
+		static GTStoreStorageService::Stub* storage_stub(const std::string& address) {
+			ChannelPool& pool = instance();
+			std::lock_guard<std::mutex> lock(pool.mutex);
+			Node& node = pool.storage_nodes[address];
+			if (node.stubs.empty()) {
+				for (int i = 0; i < CHANNELS_PER_NODE; i++) {
+					node.stubs.push_back(GTStoreStorageService::NewStub(make_channel(address)));
+				}
+			}
+			return node.stubs[node.next++ % node.stubs.size()].get();
+		}
+
+		static GTStoreManagerService::Stub* manager_stub() {
+			ChannelPool& pool = instance();
+			std::lock_guard<std::mutex> lock(pool.mutex);
+			if (!pool.manager) {
+				pool.manager = GTStoreManagerService::NewStub(make_channel(MANAGER_ADDRESS));
+			}
+			return pool.manager.get();
+		}
+
+	private:
+		struct Node {
+			std::vector<std::unique_ptr<GTStoreStorageService::Stub>> stubs;
+			size_t next = 0;
+		};
+
+		std::mutex mutex;
+		std::unordered_map<std::string, Node> storage_nodes;
+		std::unique_ptr<GTStoreManagerService::Stub> manager;
+
+		// Never destroyed, so stubs outlive clients torn down at exit
+		static ChannelPool& instance() {
+			static ChannelPool* pool = new ChannelPool();
+			return *pool;
+		}
+
+		static std::shared_ptr<Channel> make_channel(const std::string& address) {
+			grpc::ChannelArguments args;
+			// Without a local pool, channels to one address share a single connection
+			args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+			args.SetInt(GRPC_ARG_KEEPALIVE_TIME_MS, CHANNEL_KEEPALIVE_MS);
+			args.SetInt(GRPC_ARG_KEEPALIVE_TIMEOUT_MS, CHANNEL_KEEPALIVE_TIMEOUT_MS);
+			args.SetInt(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, 1);
+			return grpc::CreateCustomChannel(address, grpc::InsecureChannelCredentials(), args);
+		}
+};
+
+// A call on the client's poller queue; the poller thread calls done() when it completes,
+// then deletes it
+class PollerCall {
+	public:
+		virtual ~PollerCall() {}
+		virtual void done() = 0;
+};
+
+// A call no thread waits for, such as the commit of a prepare that answered late. A
+// callback, if given, gets the reply on the poller thread.
+template <class Request, class Response>
+class DetachedCall final : public PollerCall {
+	public:
+		using Callback = std::function<void(const Status&, const Response&)>;
+
+		void start(GTStoreStorageService::Stub* stub, const Request& request, StorageAsyncCall<Request, Response> prepare_async,
+				grpc::CompletionQueue* cq, Callback callback = nullptr, int timeout_ms = DETACHED_CALL_TIMEOUT_MS) {
+			this->callback = std::move(callback);
+			context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(timeout_ms));
+			trace.start(trace_name(request), "", context);
+			reader = (stub->*prepare_async)(&context, request, cq);
+			reader->StartCall();
+			reader->Finish(&response, &status, this);
+		}
+
+		void done() override {
+			trace.finish();
+			if (callback) {
+				callback(status, response);
+			}
+		}
+
+	private:
+		Callback callback;
+		ClientContext context;
+		RpcTrace trace;
+		std::unique_ptr<grpc::ClientAsyncResponseReader<Response>> reader;
+		Response response;
+		Status status;
+};
+
+// The prepares of one PUT attempt, one per replica. The put waits on cv until enough
+// answered to decide, or for put_async, on_answer decides on the poller; prepares that
+// answer after that are committed or aborted by the poller according to outcome.
+struct PrepareRound {
+	enum Outcome {
+		PENDING,
+		COMMIT,
+		ABORT
+	};
+
+	std::string key;
+	uint64_t txn_id;
+	std::vector<GTStoreStorageService::Stub*> stubs;
+	std::vector<std::unique_ptr<ClientContext>> contexts;
+	std::vector<std::unique_ptr<grpc::ClientAsyncResponseReader<StoragePutResponse>>> readers;
+	std::vector<StoragePutResponse> responses;
+	std::vector<Status> statuses;
+	std::vector<RpcTrace> traces;
+	// Span of the put, for the commits and aborts the poller sends
+	TraceContext trace;
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<bool> answered;
+	Outcome outcome = PENDING;
+	// Version every replica commits the write at, set with outcome COMMIT
+	uint64_t version = 0;
+	// Called with mutex held as prepares answer while outcome is PENDING
+	std::function<void(PrepareRound&)> on_answer;
+
+	bool prepared(size_t i) const {
+		return answered[i] && statuses[i].ok() && responses[i].success();
+	}
+
+	// The highest version the prepared replicas proposed, above every write each of them
+	// committed to the key before
+	uint64_t proposed_version() const {
+		uint64_t version = 0;
+		for (size_t i = 0; i < responses.size(); i++) {
+			if (prepared(i)) {
+				version = std::max(version, responses[i].version());
+			}
+		}
+		return version;
+	}
+
+	// A node that did not refuse outright may hold the key for this transaction
+	bool reachable(size_t i) const {
+		return statuses[i].ok() || statuses[i].error_code() == grpc::StatusCode::DEADLINE_EXCEEDED;
+	}
+};
+
 class GTStoreClientImpl {
     private:
-        std::unique_ptr<GTStoreManagerService::Stub> manager_stub;
+        GTStoreManagerService::Stub* manager_stub;
         int client_id;
-		std::map<std::string, std::unique_ptr<GTStoreStorageService::Stub>> storage_node_stubs;
+		// Stubs this client was given by ChannelPool
+		std::unordered_map<std::string, GTStoreStorageService::Stub*> storage_node_stubs;
+		std::shared_ptr<const HashRing> ring;
+		std::chrono::steady_clock::time_point ring_checked_at;
+		// How the manager has PUTs reach replicas, and places keys, sent with the ring
+		GTStoreReplication replication = GTStoreReplication::TWO_PHASE;
+		GTStorePlacement placement = GTStorePlacement::RING;
+		std::mt19937_64 txn_rng;
+
+		// Completes PUT prepares, including ones that answer after their put returned
+		grpc::CompletionQueue poller_cq;
+		std::thread poller;
+		std::mutex poller_mutex;
+		std::condition_variable poller_cv;
+		size_t poller_calls = 0;
+
+		GTStoreClientOptions options;
+		// Cached NodeLoad::of, which takes a process-wide lock
+		std::unordered_map<std::string, NodeLoad*> node_loads;
+		// The last HEDGE_WINDOW GET latencies in microseconds, and how long hedged reads wait
+		std::vector<int64_t> get_latencies;
+		size_t latencies_seen = 0;
+		int64_t hedge_delay_us = 0;
+
+		// Values read at ONE under a storage node's lease; null without cache_bytes
+		std::unique_ptr<ReadCache> cache;
+		// Compresses the values this client writes; null without compression
+		std::unique_ptr<ValueCodec> codec;
+
+		// get_async and put_async requests the poller cannot finish with one round of calls,
+		// such as a replica without the key or a write that has to be retried, are run with
+		// the blocking calls of a client of this thread's own, started on first use
+		std::thread fallback;
+		std::mutex fallback_mutex;
+		std::condition_variable fallback_cv;
+		std::deque<std::function<void(GTStoreClientImpl&)>> fallback_jobs;
+		bool fallback_stopping = false;
+
+		uint64_t next_txn_id() {
+			uint64_t txn_id;
+			do {
+				txn_id = txn_rng();
+			} while (txn_id == 0);
+			return txn_id;
+		}
+
+		// Age of a write for wait-die on the storage nodes, fixed across its retries
+		uint64_t txn_priority() {
+			return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		}
 
     public:
-        GTStoreClientImpl(std::shared_ptr<Channel> channel)
-            : manager_stub(GTStoreManagerService::NewStub(channel)) {}
+        GTStoreClientImpl(const GTStoreClientOptions& options)
+            : manager_stub(ChannelPool::manager_stub()), txn_rng(std::random_device()()), options(options) {
+			poller = std::thread(&GTStoreClientImpl::run_poller, this);
+			if (options.cache_bytes > 0) {
+				cache.reset(new ReadCache(options.cache_bytes));
+			}
+			if (options.compression != GTStoreCompression::NONE) {
+				codec.reset(new ValueCodec(options.compress_min_bytes,
+					options.compression == GTStoreCompression::DICTIONARY ? options.dictionary : ""));
+			}
+		}
+
+		~GTStoreClientImpl() {
+			{
+				std::unique_lock<std::mutex> lock(poller_mutex);
+				poller_cv.wait(lock, [this] { return poller_calls == 0; });
+			}
+			// Only the poller hands out fallback jobs, so the queue no longer grows
+			if (fallback.joinable()) {
+				{
+					std::lock_guard<std::mutex> lock(fallback_mutex);
+					fallback_stopping = true;
+				}
+				fallback_cv.notify_all();
+				fallback.join();
+			}
+			poller_cq.Shutdown();
+			poller.join();
+		}
 
         void init(int id) {
             ManagerInitRequest request;
@@ -31,175 +355,1499 @@ class GTStoreClientImpl {
                 return;
             }
 
-			for (const auto& storage_node : response.storage_nodes()) {
-				auto channel = get_storage_channel(storage_node);
-				storage_node_stubs[storage_node] = GTStoreStorageService::NewStub(channel);
+			refresh_ring();
+
+			// The first client of a process to use a dictionary stores it for readers elsewhere. If
+			// that fails, the client compresses with plain deflate instead, as other processes
+			// could not read values compressed against a dictionary they cannot find.
+			if (codec && options.compression == GTStoreCompression::DICTIONARY && !options.dictionary.empty()) {
+				std::string key = DictionaryRegistry::key_of(DictionaryRegistry::id_of(options.dictionary));
+				static std::mutex published_mutex;
+				static std::set<std::string> published;
+				std::lock_guard<std::mutex> lock(published_mutex);
+				if (!published.count(key)) {
+					if (!put(key, {options.dictionary}, GTStoreConsistency::ALL).empty()) {
+						published.insert(key);
+					}
+					else {
+						if (g_verbose) {
+							std::cout << "Dictionary could not be stored; compressing without it" << std::endl;
+						}
+						codec.reset(new ValueCodec(options.compress_min_bytes, ""));
+					}
+				}
 			}
         }
 
-        std::shared_ptr<grpc::Channel> get_storage_channel(const std::string& address) {
-            return grpc::CreateChannel(
-                address,
-                grpc::InsecureChannelCredentials()
-            );
-        }
+		GTStoreStorageService::Stub* get_storage_stub(const std::string& storage_node) {
+			GTStoreStorageService::Stub*& stub = storage_node_stubs[storage_node];
+			if (!stub) {
+				stub = ChannelPool::storage_stub(storage_node);
+			}
+			return stub;
+		}
 
-        val_t get(std::string key) {
-            ManagerGetRequest request;
-            request.set_key(key);
+		// Fetch the ring from the manager, or only confirm the cached epoch if nothing changed
+		void refresh_ring() {
+			ManagerGetRingRequest request;
+			request.set_known_epoch(ring ? ring->epoch : 0);
 
-			val_t result;
+			ManagerGetRingResponse response;
+			ClientContext context;
 
-			while (true) {
-				ManagerGetResponse response;
-				ClientContext context;
+			RpcTrace trace("get_ring", MANAGER_ADDRESS, context);
+			Status status = manager_stub->get_ring(&context, request, &response);
+			trace.finish();
 
-				Status status = manager_stub->get(&context, request, &response);
+			if (!status.ok() || !response.success()) {
+				if (g_verbose) {
+					std::cout << "Get ring failed: " << status.error_message() << std::endl;
+				}
+				return;
+			}
+
+			ring_checked_at = std::chrono::steady_clock::now();
+
+			if (!response.changed()) {
+				return;
+			}
+
+			replication = static_cast<GTStoreReplication>(response.replication());
+			placement = static_cast<GTStorePlacement>(response.placement());
+
+			auto new_ring = std::make_shared<HashRing>();
+			new_ring->epoch = response.epoch();
+			new_ring->num_replicas = response.num_replicas();
+			new_ring->nodes.assign(response.storage_nodes().begin(), response.storage_nodes().end());
+			new_ring->down.assign(response.down().begin(), response.down().end());
+
+			switch (placement) {
+				case GTStorePlacement::JUMP:
+					new_ring->placement = std::make_shared<JumpPlacement>(response.storage_nodes_size());
+					break;
+				case GTStorePlacement::RENDEZVOUS:
+					new_ring->placement = RendezvousPlacement().add_nodes(new_ring->nodes);
+					break;
+				case GTStorePlacement::RANGE:
+					new_ring->placement = std::make_shared<RangePlacement>(response.num_replicas(), response.storage_nodes_size(),
+						std::vector<uint64_t>(response.hashes().begin(), response.hashes().end()),
+						std::vector<int>(response.owners().begin(), response.owners().end()));
+					break;
+				default:
+					new_ring->placement = std::make_shared<RingPlacement>(response.num_replicas(), response.storage_nodes_size(),
+						std::vector<uint64_t>(response.hashes().begin(), response.hashes().end()),
+						std::vector<int>(response.owners().begin(), response.owners().end()));
+					break;
+			}
+			ring = new_ring;
+		}
+
+		std::shared_ptr<const HashRing> get_ring() {
+			auto now = std::chrono::steady_clock::now();
+			if (!ring || now - ring_checked_at > std::chrono::milliseconds(RING_REFRESH_INTERVAL_MS)) {
+				refresh_ring();
+			}
+			return ring ? ring : std::make_shared<HashRing>();
+		}
+
+		// Tell the manager a storage node is unreachable and pick up the resulting ring
+		bool report_failure(const std::string& storage_node) {
+			ManagerReportFailureRequest report_failure_request;
+			report_failure_request.set_storage_node(storage_node);
+			ManagerReportFailureResponse report_failure_response;
+			ClientContext report_failure_context;
+			RpcTrace trace("report_failure", MANAGER_ADDRESS, report_failure_context);
+			Status report_failure_status = manager_stub->report_failure(&report_failure_context, report_failure_request, &report_failure_response);
+			trace.finish();
+
+			if (!report_failure_status.ok()) {
+				if (g_verbose) {
+					std::cout << "Report failure failed: " << report_failure_status.error_message() << std::endl;
+				}
+				return false;
+			}
 
-				if (!status.ok()) {
+			refresh_ring();
+			return true;
+		}
+
+		// Set the values of a PUT's request, compressed if the client compresses, except for
+		// dictionaries, which readers need before they can decompress anything
+		template <class Request>
+		void set_values(const std::string& key, const val_t& value, Request& request) {
+			if (codec && !DictionaryRegistry::is_key(key)) {
+				codec->encode(value, request);
+				return;
+			}
+			for (const auto& val : value) {
+				request.add_values(val);
+			}
+		}
+
+		// The value in a reply, decompressed. A dictionary this process has not seen is read
+		// from the store first; without it the value reads as not found.
+		template <class Reply>
+		val_t decode_values(const Reply& reply) {
+			val_t value;
+			uint64_t missing;
+			if (ValueCodec::decode(reply, value, missing)) {
+				return value;
+			}
+
+			val_t dictionary = get(DictionaryRegistry::key_of(missing), GTStoreConsistency::ONE);
+			if (dictionary.size() != 1 || DictionaryRegistry::id_of(dictionary[0]) != missing) {
+				if (g_verbose) {
+					std::cout << "Dictionary " << DictionaryRegistry::key_of(missing) << " not found" << std::endl;
+				}
+				return val_t();
+			}
+			DictionaryRegistry::add(dictionary[0]);
+			ValueCodec::decode(reply, value, missing);
+			return value;
+		}
+
+        // Read key at a consistency level. ONE asks replicas one at a time, see read_one, and
+        // with a cache is answered from it while the lease of the cached copy lasts; QUORUM
+        // and ALL ask every replica at once
+        // and take the newest copy among the first majority, or all, of the replies. Replicas
+        // that answered without the key or with an older copy are then repaired with it. With
+        // chain replication, QUORUM and ALL ask only the tail, which has every acknowledged write.
+        val_t get(std::string key, GTStoreConsistency consistency) {
+			TraceSpan span("get", Tracer::sample(options.trace_sample));
+			val_t cached;
+			if (cache && consistency == GTStoreConsistency::ONE && cache->get(key, cached)) {
+				if (g_verbose) {
+					std::cout << "<GET> " << key << " from cache" << std::endl;
+				}
+				return cached;
+			}
+
+			while (true) {
+				std::vector<HashRing::Replica> replicas = get_ring()->put_replicas(key);
+
+				if (replicas.empty()) {
 					if (g_verbose) {
-						std::cout << "Get failed: " << status.error_message() << std::endl;
+						std::cout << "Get failed: no storage nodes available" << std::endl;
 					}
 					return val_t();
 				}
 
-				string storage_node = response.storage_node();
-			
+				std::vector<string> storage_nodes;
+				for (const auto& replica : replicas) {
+					storage_nodes.push_back(replica.storage_node);
+				}
+				size_t needed = replicas_needed(consistency, storage_nodes.size());
+				if (replication == GTStoreReplication::CHAIN && needed > 1) {
+					storage_nodes.erase(storage_nodes.begin(), storage_nodes.end() - 1);
+					needed = 1;
+				}
+
 				StorageGetRequest storage_get_request;
 				storage_get_request.set_key(key);
+				storage_get_request.set_lease(cache && needed == 1);
 
-				StorageGetResponse storage_get_response;
-				ClientContext storage_context;
+				std::vector<StorageGetResponse> responses(storage_nodes.size());
+				std::vector<Status> statuses(storage_nodes.size(), Status(grpc::StatusCode::CANCELLED, ""));
+				// Leases count from when the node answered, which is after this
+				auto sent_at = ReadCache::Clock::now();
 
-				Status storage_status = storage_node_stubs[storage_node]->get(&storage_context, storage_get_request, &storage_get_response);
+				if (needed == 1) {
+					read_one(storage_nodes, storage_get_request, responses, statuses);
+				}
+				else {
+					statuses = fan_out(storage_nodes, storage_get_request, responses, &GTStoreStorageService::Stub::PrepareAsyncget, 0, needed);
+				}
 
-				if (!storage_status.ok() || !storage_get_response.success()) {
-					// Report failure to manager
-					ManagerReportFailureRequest report_failure_request;
-					report_failure_request.set_storage_node(storage_node);
-					ManagerReportFailureResponse report_failure_response;
-					ClientContext report_failure_context;
-					Status report_failure_status = manager_stub->report_failure(&report_failure_context, report_failure_request, &report_failure_response);
+				size_t answered = 0;
+				int newest = -1;
+				bool ring_changed = false;
 
-					if (!report_failure_status.ok()) {
-						if (g_verbose) {
-							std::cout << "Report failure failed: " << report_failure_status.error_message() << std::endl;
+				for (size_t i = 0; i < storage_nodes.size(); i++) {
+					if (statuses[i].ok()) {
+						answered++;
+						if (responses[i].success() && (newest < 0 || responses[i].version() > responses[newest].version())) {
+							newest = i;
 						}
-						return val_t();
+					}
+					else if (statuses[i].error_code() != grpc::StatusCode::CANCELLED) {
+						// Report failure to manager
+						if (!report_failure(storage_nodes[i])) {
+							return val_t();
+						}
+						ring_changed = true;
+					}
+				}
+
+				if (answered < needed || (newest < 0 && ring_changed)) {
+					continue;
+				}
+
+				if (newest < 0) {
+					if (g_verbose) {
+						std::cout << "<GET> " << key << " not found" << std::endl;
+					}
+					return val_t();
+				}
+
+				const StorageGetResponse& found = responses[newest];
+				val_t value = decode_values(found);
+				std::vector<string> stale;
+				for (size_t i = 0; i < storage_nodes.size(); i++) {
+					if (statuses[i].ok() && (!responses[i].success() || responses[i].version() < found.version())) {
+						stale.push_back(storage_nodes[i]);
+					}
+				}
+
+				if (g_verbose) {
+					std::cout << "<GET> " << key << ", ";
+					for (const auto& val : value) {
+						std::cout << val << " ";
+					}
+					std::cout << ", from " << storage_nodes[newest] << std::endl;
+				}
+
+				if (!stale.empty()) {
+					read_repair(stale, key, found);
+				}
+
+				if (cache && found.lease_ms() > 0) {
+					cache->put(key, value, sent_at + std::chrono::milliseconds(found.lease_ms()));
+				}
+				return value;
+			}
+        }
+
+		// A GET at ONE. The replica pick_replica chooses is asked first and the others follow,
+		// in ring order, while replicas answer without the key. With hedge_reads, a request
+		// that has not answered within the recent p95 is also sent to the next replica and the
+		// first copy found wins. storage_nodes is reordered to match statuses and responses.
+		void read_one(std::vector<string>& storage_nodes, const StorageGetRequest& request,
+				std::vector<StorageGetResponse>& responses, std::vector<Status>& statuses) {
+			size_t first = pick_replica(storage_nodes);
+			std::rotate(storage_nodes.begin(), storage_nodes.begin() + first, storage_nodes.begin() + first + 1);
+
+			grpc::CompletionQueue cq;
+			std::vector<std::unique_ptr<ClientContext>> contexts(storage_nodes.size());
+			std::vector<std::unique_ptr<grpc::ClientAsyncResponseReader<StorageGetResponse>>> readers(storage_nodes.size());
+			std::vector<std::chrono::system_clock::time_point> sent_at(storage_nodes.size());
+			std::vector<RpcTrace> traces(storage_nodes.size());
+			size_t next = 0;
+			size_t in_flight = 0;
+
+			auto send = [&](size_t i) {
+				node_load(storage_nodes[i])->outstanding++;
+				sent_at[i] = std::chrono::system_clock::now();
+				contexts[i].reset(new ClientContext());
+				traces[i].start("get", storage_nodes[i], *contexts[i]);
+				readers[i] = get_storage_stub(storage_nodes[i])->PrepareAsyncget(contexts[i].get(), request, &cq);
+				readers[i]->StartCall();
+				readers[i]->Finish(&responses[i], &statuses[i], (void*) i);
+				next++;
+				in_flight++;
+			};
+
+			send(0);
+			void* tag;
+			bool ok;
+			bool found = false;
+			while (in_flight > 0) {
+				if (options.hedge_reads && hedge_delay_us > 0 && in_flight == 1 && next < storage_nodes.size() && !found) {
+					auto hedge_at = sent_at[next - 1] + std::chrono::microseconds(hedge_delay_us);
+					if (cq.AsyncNext(&tag, &ok, hedge_at) == grpc::CompletionQueue::TIMEOUT) {
+						send(next);
+						continue;
 					}
 				}
 				else {
-					if (g_verbose) std::cout << "<GET> " << request.key() << ", ";
+					cq.Next(&tag, &ok);
+				}
+
+				size_t i = (size_t) tag;
+				in_flight--;
+				traces[i].finish();
+				int64_t latency_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now() - sent_at[i]).count();
+				NodeLoad* load = node_load(storage_nodes[i]);
+				load->outstanding--;
+				// A cancelled request still took at least this long
+				load->sample(latency_us);
+				if (statuses[i].ok()) {
+					record_latency(latency_us);
+				}
 
-					for (const auto& value : storage_get_response.values()) {
-						result.push_back(value);
-						if (g_verbose) std::cout << value << " ";
+				if (found) {
+					continue;
+				}
+				if (statuses[i].ok() && responses[i].success()) {
+					found = true;
+					for (auto& context : contexts) {
+						if (context) {
+							context->TryCancel();
+						}
 					}
+				}
+				else if (statuses[i].ok() && in_flight == 0 && next < storage_nodes.size()) {
+					send(next);
+				}
+			}
 
-					if (g_verbose) std::cout << ", from " << storage_node << std::endl;
+			cq.Shutdown();
+			while (cq.Next(&tag, &ok)) {}
+		}
 
-					break;
+		NodeLoad* node_load(const std::string& storage_node) {
+			NodeLoad*& load = node_loads[storage_node];
+			if (!load) {
+				load = NodeLoad::of(storage_node);
+			}
+			return load;
+		}
+
+		// Power of two choices: of two random replicas, the one with the lower expected wait.
+		// Without balance_reads, the first replica.
+		size_t pick_replica(const std::vector<string>& storage_nodes) {
+			size_t n = storage_nodes.size();
+			if (!options.balance_reads || n < 2) {
+				return 0;
+			}
+
+			size_t a = txn_rng() % n;
+			size_t b = txn_rng() % (n - 1);
+			if (b >= a) {
+				b++;
+			}
+			return node_load(storage_nodes[a])->cost() <= node_load(storage_nodes[b])->cost() ? a : b;
+		}
+
+		void record_latency(int64_t latency_us) {
+			if (get_latencies.size() < HEDGE_WINDOW) {
+				get_latencies.push_back(latency_us);
+			}
+			else {
+				get_latencies[latencies_seen % HEDGE_WINDOW] = latency_us;
+			}
+
+			if (++latencies_seen >= HEDGE_WINDOW && latencies_seen % HEDGE_REFRESH == 0) {
+				std::vector<int64_t> sorted = get_latencies;
+				auto p95 = sorted.begin() + sorted.size() * 95 / 100;
+				std::nth_element(sorted.begin(), p95, sorted.end());
+				hedge_delay_us = std::max<int64_t>(*p95, 1);
+			}
+		}
+
+		// Replies a consistency level needs from a key's n replicas
+		static size_t replicas_needed(GTStoreConsistency consistency, size_t n) {
+			switch (consistency) {
+				case GTStoreConsistency::ONE:
+					return 1;
+				case GTStoreConsistency::QUORUM:
+					return n / 2 + 1;
+				default:
+					return n;
+			}
+		}
+
+		// Give replicas that lack key the copy another replica returned. A node keeps its own
+		// copy if that is newer.
+		void read_repair(const std::vector<string>& storage_nodes, const std::string& key, const StorageGetResponse& found) {
+			StorageRepairRequest repair_request;
+			StorageRepairEntry* entry = repair_request.add_entries();
+			entry->set_key(key);
+			*entry->mutable_values() = found.values();
+			entry->set_version(found.version());
+			entry->set_encoding(found.encoding());
+
+			std::vector<StorageRepairResponse> repair_responses;
+			fan_out(storage_nodes, repair_request, repair_responses, &GTStoreStorageService::Stub::PrepareAsyncrepair);
+
+			if (g_verbose) {
+				std::cout << "<REPAIR> " << key << " on " << storage_nodes.size() << " replicas" << std::endl;
+			}
+		}
+
+		// Issue one request per storage node at once over one completion queue and wait for
+		// all replies; statuses[i] and responses[i] belong to storage_nodes[i]. Once needed
+		// requests succeeded, the rest are cancelled and end with CANCELLED.
+		template <class Request, class Response>
+		std::vector<Status> fan_out(const std::vector<string>& storage_nodes, const std::vector<const Request*>& requests,
+				std::vector<Response>& responses, StorageAsyncCall<Request, Response> prepare_async, int timeout_ms = 0,
+				size_t needed = SIZE_MAX) {
+			grpc::CompletionQueue cq;
+			std::vector<std::unique_ptr<ClientContext>> contexts;
+			std::vector<std::unique_ptr<grpc::ClientAsyncResponseReader<Response>>> readers;
+			std::vector<Status> statuses(storage_nodes.size());
+			std::vector<RpcTrace> traces(storage_nodes.size());
+			responses.assign(storage_nodes.size(), Response());
+
+			for (size_t i = 0; i < storage_nodes.size(); i++) {
+				contexts.emplace_back(new ClientContext());
+				if (timeout_ms > 0) {
+					contexts[i]->set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(timeout_ms));
 				}
+				traces[i].start(trace_name(*requests[i]), storage_nodes[i], *contexts[i]);
+				readers.push_back((get_storage_stub(storage_nodes[i])->*prepare_async)(contexts[i].get(), *requests[i], &cq));
+				readers[i]->StartCall();
+				readers[i]->Finish(&responses[i], &statuses[i], (void*) i);
 			}
 
-            return result;
-        }
+			void* tag;
+			bool ok;
+			size_t succeeded = 0;
+			for (size_t i = 0; i < storage_nodes.size(); i++) {
+				cq.Next(&tag, &ok);
+				traces[(size_t) tag].finish();
+				if (statuses[(size_t) tag].ok() && ++succeeded == needed) {
+					for (auto& context : contexts) {
+						context->TryCancel();
+					}
+				}
+			}
+
+			cq.Shutdown();
+			while (cq.Next(&tag, &ok)) {}
+
+			return statuses;
+		}
+
+		template <class Request, class Response>
+		std::vector<Status> fan_out(const std::vector<string>& storage_nodes, const Request& request,
+				std::vector<Response>& responses, StorageAsyncCall<Request, Response> prepare_async, int timeout_ms = 0,
+				size_t needed = SIZE_MAX) {
+			return fan_out(storage_nodes, std::vector<const Request*>(storage_nodes.size(), &request), responses, prepare_async,
+				timeout_ms, needed);
+		}
+
+		// Sort prepare replies: nodes that failed outright are reported to the manager, the rest
+		// are reachable and must be aborted if any of them did not prepare (a timed out or refused
+		// prepare means another writer holds the key). Returns false if the manager is unreachable.
+		template <class Response>
+		bool check_prepares(const std::vector<string>& storage_nodes, const std::vector<Status>& statuses,
+				const std::vector<Response>& responses, std::vector<size_t>& reachable, bool& prepared) {
+			prepared = true;
+
+			for (size_t i = 0; i < storage_nodes.size(); i++) {
+				if (!statuses[i].ok() && statuses[i].error_code() != grpc::StatusCode::DEADLINE_EXCEEDED) {
+					// Report failure to manager
+					if (!report_failure(storage_nodes[i])) {
+						return false;
+					}
+					prepared = false;
+					continue;
+				}
+
+				reachable.push_back(i);
+				if (!statuses[i].ok() || !responses[i].success()) {
+					prepared = false;
+				}
+			}
 
-        vector<string> put(std::string key, val_t value) {
-            ManagerPutRequest request;
-            request.set_key(key);
+			return true;
+		}
+
+		void backoff(int attempt) {
+			TraceSpan span("backoff");
+			std::uniform_int_distribution<int> backoff_ms(0, PUT_BACKOFF_MS * std::min(attempt + 1, 8));
+			std::this_thread::sleep_for(std::chrono::milliseconds(backoff_ms(txn_rng)));
+		}
+
+        // Write key to its replicas in two phases. The value is committed once as many replicas
+        // as the consistency level needs have prepared it; prepares still outstanding then
+        // are committed by the poller as they answer, so a slow replica only delays ALL. A key
+        // with a single replica is first tried with a one-phase put.
+        vector<string> put(std::string key, val_t value, GTStoreConsistency consistency) {
+			TraceSpan span("put", Tracer::sample(options.trace_sample));
+			if (cache) {
+				cache->erase(key);
+			}
+
+			if (replication == GTStoreReplication::CHAIN) {
+				return chain_put(key, value);
+			}
 
 			StoragePutRequest storage_put_request;
 			storage_put_request.set_key(key);
+			set_values(key, value, storage_put_request);
+			storage_put_request.set_priority(txn_priority());
 
-			for (const auto& val : value) {
-				storage_put_request.add_values(val);
+			for (int attempt = 0; ; attempt++) {
+				std::vector<HashRing::Replica> replicas = get_ring()->put_replicas(key);
+
+				if (replicas.empty()) {
+					if (g_verbose) {
+						std::cout << "PUT failed: no storage nodes available" << std::endl;
+					}
+					return std::vector<string>();
+				}
+
+				uint64_t txn_id = next_txn_id();
+				storage_put_request.set_txn_id(txn_id);
+
+				std::vector<string> storage_nodes;
+				std::vector<StoragePutRequest> hinted_requests;
+				std::vector<const StoragePutRequest*> request_ptrs;
+				hint_requests(storage_put_request, replicas, storage_nodes, hinted_requests, request_ptrs);
+
+				// A single replica has nobody to agree with, so it takes the write in one round trip
+				// unless another write holds the key
+				if (storage_nodes.size() == 1) {
+					StoragePutResponse put_response;
+					ClientContext put_context;
+					RpcTrace trace("put", storage_nodes[0], put_context);
+					Status put_status = get_storage_stub(storage_nodes[0])->put(&put_context, *request_ptrs[0], &put_response);
+					trace.finish();
+
+					if (!put_status.ok()) {
+						if (!report_failure(storage_nodes[0])) {
+							return std::vector<string>();
+						}
+						continue;
+					}
+					if (put_response.success()) {
+						print_put(key, value, storage_nodes);
+						return storage_nodes;
+					}
+				}
+
+				size_t needed = replicas_needed(consistency, storage_nodes.size());
+				std::shared_ptr<PrepareRound> round = start_prepares(key, txn_id, storage_nodes, request_ptrs);
+
+				// Wait until enough replicas prepared, or too many did not for that to happen
+				std::vector<size_t> answered;
+				bool commit;
+				{
+					std::unique_lock<std::mutex> lock(round->mutex);
+					round->cv.wait(lock, [&] {
+						size_t prepared = 0;
+						size_t failed = 0;
+						for (size_t i = 0; i < storage_nodes.size(); i++) {
+							if (round->prepared(i)) {
+								prepared++;
+							}
+							else if (round->answered[i]) {
+								failed++;
+							}
+						}
+						return prepared >= needed || failed > storage_nodes.size() - needed;
+					});
+
+					for (size_t i = 0; i < storage_nodes.size(); i++) {
+						if (round->answered[i]) {
+							answered.push_back(i);
+						}
+					}
+					commit = std::count_if(answered.begin(), answered.end(), [&round](size_t i) { return round->prepared(i); }) >= (long) needed;
+					round->outcome = commit ? PrepareRound::COMMIT : PrepareRound::ABORT;
+					round->version = round->proposed_version();
+				}
+
+				// Prepares that answered are finished here, the others by the poller
+				std::vector<string> commit_nodes;
+				std::vector<string> abort_nodes;
+				bool manager_reachable = true;
+
+				for (size_t i : answered) {
+					if (commit && round->prepared(i)) {
+						commit_nodes.push_back(storage_nodes[i]);
+					}
+					else if (round->reachable(i)) {
+						abort_nodes.push_back(storage_nodes[i]);
+					}
+					else if (!report_failure(storage_nodes[i])) {
+						manager_reachable = false;
+					}
+				}
+
+				StorageAbortPutRequest abort_put_request;
+				abort_put_request.set_key(key);
+				abort_put_request.set_txn_id(txn_id);
+				std::vector<StorageAbortPutResponse> abort_put_responses;
+				fan_out(abort_nodes, abort_put_request, abort_put_responses, &GTStoreStorageService::Stub::PrepareAsyncabort_put);
+
+				if (!commit) {
+					if (!manager_reachable) {
+						return std::vector<string>();
+					}
+					backoff(attempt);
+					continue;
+				}
+
+				// Commit put transaction
+				StorageCommitPutRequest commit_put_request;
+				commit_put_request.set_key(key);
+				commit_put_request.set_txn_id(txn_id);
+				commit_put_request.set_version(round->version);
+				std::vector<StorageCommitPutResponse> commit_put_responses;
+				fan_out(commit_nodes, commit_put_request, commit_put_responses, &GTStoreStorageService::Stub::PrepareAsynccommit_put);
+
+				print_put(key, value, commit_nodes);
+				return storage_nodes;
 			}
+        }
 
-			while (true) {
-                ManagerPutResponse response;
-                ClientContext context;
-            	Status status = manager_stub->put(&context, request, &response);
+		// Write key with chain replication: one request to the head of its replicas, which
+		// passes it down the chain in ring order. It returns once the tail has the value, so
+		// consistency levels do not apply. A failed link is reported and the write retried on
+		// the chain of the new ring. A write that times out is retried on the same chain, and
+		// after CHAIN_PUT_ATTEMPTS in a row the node that did not answer in time is reported
+		// like a failed one; if no node was slow, only busy, the write fails.
+		vector<string> chain_put(const std::string& key, const val_t& value) {
+			StorageChainPutRequest request;
+			request.set_key(key);
+			set_values(key, value, request);
+
+			int timeouts = 0;
+			for (int attempt = 0; ; attempt++) {
+				std::vector<HashRing::Replica> replicas = get_ring()->put_replicas(key);
 
-				if (!status.ok()) {
+				if (replicas.empty()) {
 					if (g_verbose) {
-						std::cout << "PUT failed: " << status.error_message() << std::endl;
+						std::cout << "PUT failed: no storage nodes available" << std::endl;
 					}
 					return std::vector<string>();
 				}
 
 				std::vector<string> storage_nodes;
-				for (const auto& storage_node : response.storage_nodes()) {
-					storage_nodes.push_back(storage_node);
+				chain_request(request, replicas, storage_nodes);
+
+				StorageChainPutResponse response;
+				ClientContext context;
+				context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(CHAIN_PUT_TIMEOUT_MS));
+				RpcTrace trace("chain_put", storage_nodes[0], context);
+				Status status = get_storage_stub(storage_nodes[0])->chain_put(&context, request, &response);
+				trace.finish();
+
+				bool head_slow = status.error_code() == grpc::StatusCode::DEADLINE_EXCEEDED;
+				if (head_slow || (status.ok() && !response.success() && response.failed_node().empty())) {
+					// Nothing failed, so try the same chain again, up to a point
+					if (++timeouts < CHAIN_PUT_ATTEMPTS) {
+						backoff(attempt);
+						continue;
+					}
+
+					std::string slow_node = head_slow ? storage_nodes[0] : response.slow_node();
+					if (slow_node.empty() || !report_failure(slow_node)) {
+						if (g_verbose) {
+							std::cout << "PUT failed: chain write timed out" << std::endl;
+						}
+						return std::vector<string>();
+					}
+					timeouts = 0;
+					continue;
 				}
 
-				std::vector<string> storage_nodes_success;
+				if (!status.ok() || !response.success()) {
+					// Report failure to manager: the head, or the first link it could not reach
+					if (!report_failure(status.ok() ? response.failed_node() : storage_nodes[0])) {
+						return std::vector<string>();
+					}
+					continue;
+				}
 
-				for (const auto& storage_node : storage_nodes) {
-					StoragePutResponse storage_put_response;
-					ClientContext storage_context;
+				print_put(key, value, storage_nodes);
+				return storage_nodes;
+			}
+		}
 
-					Status storage_status = storage_node_stubs[storage_node]->prepare_put(&storage_context, storage_put_request, &storage_put_response);
+		// One request per replica of a PUT. Nodes standing in for a down replica get a copy of
+		// the request naming it, kept in hinted_requests.
+		static void hint_requests(const StoragePutRequest& request, const std::vector<HashRing::Replica>& replicas,
+				std::vector<string>& storage_nodes, std::vector<StoragePutRequest>& hinted_requests,
+				std::vector<const StoragePutRequest*>& request_ptrs) {
+			hinted_requests.reserve(replicas.size());
 
-					if (!storage_status.ok()) {
-						// Report failure to manager
-						ManagerReportFailureRequest report_failure_request;
-						report_failure_request.set_storage_node(storage_node);
-						ManagerReportFailureResponse report_failure_response;
-						ClientContext report_failure_context;
-						Status report_failure_status = manager_stub->report_failure(&report_failure_context, report_failure_request, &report_failure_response);
-
-						if (!report_failure_status.ok()) {
-							if (g_verbose) {
-								std::cout << "Report failure failed: " << report_failure_status.error_message() << std::endl;
+			for (const auto& replica : replicas) {
+				storage_nodes.push_back(replica.storage_node);
+				if (replica.hint_for.empty()) {
+					request_ptrs.push_back(&request);
+					continue;
+				}
+				hinted_requests.push_back(request);
+				hinted_requests.back().set_hint_for(replica.hint_for);
+				request_ptrs.push_back(&hinted_requests.back());
+			}
+		}
+
+		// Address a chain PUT to the head of replicas, with the rest as its successors
+		static void chain_request(StorageChainPutRequest& request, const std::vector<HashRing::Replica>& replicas,
+				std::vector<string>& storage_nodes) {
+			request.clear_successors();
+			request.set_hint_for(replicas[0].hint_for);
+			for (size_t i = 0; i < replicas.size(); i++) {
+				storage_nodes.push_back(replicas[i].storage_node);
+				if (i > 0) {
+					StorageChainLink* link = request.add_successors();
+					link->set_storage_node(replicas[i].storage_node);
+					link->set_hint_for(replicas[i].hint_for);
+				}
+			}
+		}
+
+		static void print_put(const std::string& key, const val_t& value, const std::vector<string>& storage_nodes) {
+			if (!g_verbose) {
+				return;
+			}
+
+			std::cout << "<PUT> " << key << ", ";
+			for (const auto& val : value) {
+				std::cout << val << " ";
+			}
+
+			std::cout << ", to ";
+			for (const auto& storage_node : storage_nodes) {
+				std::cout << storage_node << ", ";
+			}
+			std::cout << std::endl;
+		}
+
+		// Send a prepare to every storage node on the poller queue
+		std::shared_ptr<PrepareRound> start_prepares(const std::string& key, uint64_t txn_id, const std::vector<string>& storage_nodes,
+				const std::vector<const StoragePutRequest*>& requests, std::function<void(PrepareRound&)> on_answer = nullptr) {
+			auto round = std::make_shared<PrepareRound>();
+			round->key = key;
+			round->txn_id = txn_id;
+			round->on_answer = std::move(on_answer);
+			round->responses.resize(storage_nodes.size());
+			round->statuses.resize(storage_nodes.size());
+			round->answered.assign(storage_nodes.size(), false);
+			round->traces.resize(storage_nodes.size());
+			round->trace = TraceSpan::current();
+
+			for (size_t i = 0; i < storage_nodes.size(); i++) {
+				round->stubs.push_back(get_storage_stub(storage_nodes[i]));
+				round->contexts.emplace_back(new ClientContext());
+				round->contexts[i]->set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(PREPARE_TIMEOUT_MS));
+				round->traces[i].start("prepare_put", storage_nodes[i], *round->contexts[i]);
+			}
+
+			std::lock_guard<std::mutex> lock(round->mutex);
+			for (size_t i = 0; i < storage_nodes.size(); i++) {
+				round->readers.push_back(round->stubs[i]->PrepareAsyncprepare_put(round->contexts[i].get(), *requests[i], &poller_cq));
+				round->readers[i]->StartCall();
+				round->readers[i]->Finish(&round->responses[i], &round->statuses[i], track(new PrepareAnswer(this, round, i)));
+			}
+
+			return round;
+		}
+
+		// A prepare of a PrepareRound answering on the poller
+		class PrepareAnswer final : public PollerCall {
+			public:
+				PrepareAnswer(GTStoreClientImpl* client, std::shared_ptr<PrepareRound> round, size_t index)
+					: client(client), round(std::move(round)), index(index) {}
+
+				void done() override {
+					std::lock_guard<std::mutex> lock(round->mutex);
+					round->answered[index] = true;
+					round->traces[index].finish();
+					TraceScope scope(round->trace);
+
+					if (round->outcome == PrepareRound::PENDING && round->on_answer) {
+						round->on_answer(*round);
+					}
+					else if (round->outcome == PrepareRound::PENDING) {
+						round->cv.notify_all();
+					}
+					else if (round->outcome == PrepareRound::COMMIT && round->prepared(index)) {
+						StorageCommitPutRequest request;
+						request.set_key(round->key);
+						request.set_txn_id(round->txn_id);
+						request.set_version(round->version);
+						client->detach(round->stubs[index], request, &GTStoreStorageService::Stub::PrepareAsynccommit_put);
+					}
+					else if (round->reachable(index)) {
+						StorageAbortPutRequest request;
+						request.set_key(round->key);
+						request.set_txn_id(round->txn_id);
+						client->detach(round->stubs[index], request, &GTStoreStorageService::Stub::PrepareAsyncabort_put);
+					}
+				}
+
+			private:
+				GTStoreClientImpl* client;
+				std::shared_ptr<PrepareRound> round;
+				size_t index;
+		};
+
+		// Count a call the poller must complete before the client can go
+		PollerCall* track(PollerCall* call) {
+			std::lock_guard<std::mutex> lock(poller_mutex);
+			poller_calls++;
+			return call;
+		}
+
+		template <class Request, class Response>
+		void detach(GTStoreStorageService::Stub* stub, const Request& request, StorageAsyncCall<Request, Response> prepare_async,
+				typename DetachedCall<Request, Response>::Callback callback = nullptr, int timeout_ms = DETACHED_CALL_TIMEOUT_MS) {
+			auto call = new DetachedCall<Request, Response>();
+			track(call);
+			call->start(stub, request, prepare_async, &poller_cq, std::move(callback), timeout_ms);
+		}
+
+		void run_poller() {
+			void* tag;
+			bool ok;
+			while (poller_cq.Next(&tag, &ok)) {
+				std::unique_ptr<PollerCall> call(static_cast<PollerCall*>(tag));
+				call->done();
+
+				std::lock_guard<std::mutex> lock(poller_mutex);
+				if (--poller_calls == 0) {
+					poller_cv.notify_all();
+				}
+			}
+		}
+
+		// get without waiting. At ONE, a cache miss is one GET on the poller queue to the
+		// replica pick_replica chooses, or the tail for a strong read under chain replication.
+		// A reply with the value settles the future; anything else, and QUORUM and ALL with
+		// two-phase writes, goes to the fallback client. Reads are not hedged.
+		std::future<val_t> get_async(const std::string& key, GTStoreConsistency consistency) {
+			auto promise = std::make_shared<std::promise<val_t>>();
+			std::future<val_t> future = promise->get_future();
+
+			val_t cached;
+			if (cache && consistency == GTStoreConsistency::ONE && cache->get(key, cached)) {
+				promise->set_value(std::move(cached));
+				return future;
+			}
+
+			start_fallback();
+			auto retry = [promise, key, consistency](GTStoreClientImpl& client) {
+				promise->set_value(client.get(key, consistency));
+			};
+
+			std::vector<HashRing::Replica> replicas = get_ring()->put_replicas(key);
+			bool strong = consistency != GTStoreConsistency::ONE;
+			if (replicas.empty() || (strong && replication != GTStoreReplication::CHAIN)) {
+				post_fallback(retry);
+				return future;
+			}
+
+			std::vector<string> storage_nodes;
+			for (const auto& replica : replicas) {
+				storage_nodes.push_back(replica.storage_node);
+			}
+			std::string storage_node = strong ? storage_nodes.back() : storage_nodes[pick_replica(storage_nodes)];
+
+			StorageGetRequest request;
+			request.set_key(key);
+			request.set_lease(cache != nullptr);
+
+			NodeLoad* load = node_load(storage_node);
+			load->outstanding++;
+			auto sent_at = ReadCache::Clock::now();
+
+			detach(get_storage_stub(storage_node), request, &GTStoreStorageService::Stub::PrepareAsyncget,
+				[this, promise, key, load, sent_at, retry](const Status& status, const StorageGetResponse& response) {
+					load->outstanding--;
+					load->sample(std::chrono::duration_cast<std::chrono::microseconds>(ReadCache::Clock::now() - sent_at).count());
+
+					// A dictionary not seen yet is read by the fallback client, off the poller
+					val_t value;
+					uint64_t missing;
+					if (!status.ok() || !response.success() || !ValueCodec::decode(response, value, missing)) {
+						post_fallback(retry);
+						return;
+					}
+
+					if (cache && response.lease_ms() > 0) {
+						cache->put(key, value, sent_at + std::chrono::milliseconds(response.lease_ms()));
+					}
+					promise->set_value(std::move(value));
+				}, ASYNC_CALL_TIMEOUT_MS);
+			return future;
+		}
+
+		// put without waiting. Chain writes and one-phase writes to a single replica are one
+		// call on the poller queue; two-phase writes prepare on it and commit as soon as enough
+		// replicas prepared, settling the future once the commits answer. Writes that fail or
+		// lose a conflict are retried by the fallback client, so two writes of one key in
+		// flight together may land in either order.
+		std::future<vector<string>> put_async(const std::string& key, const val_t& value, GTStoreConsistency consistency) {
+			auto promise = std::make_shared<std::promise<vector<string>>>();
+			std::future<vector<string>> future = promise->get_future();
+
+			if (cache) {
+				cache->erase(key);
+			}
+
+			start_fallback();
+			auto retry = [promise, key, value, consistency](GTStoreClientImpl& client) {
+				promise->set_value(client.put(key, value, consistency));
+			};
+
+			std::vector<HashRing::Replica> replicas = get_ring()->put_replicas(key);
+			if (replicas.empty()) {
+				post_fallback(retry);
+				return future;
+			}
+
+			std::vector<string> storage_nodes;
+
+			if (replication == GTStoreReplication::CHAIN) {
+				StorageChainPutRequest request;
+				request.set_key(key);
+				set_values(key, value, request);
+				chain_request(request, replicas, storage_nodes);
+
+				detach(get_storage_stub(storage_nodes[0]), request, &GTStoreStorageService::Stub::PrepareAsyncchain_put,
+					[this, promise, storage_nodes, retry](const Status& status, const StorageChainPutResponse& response) {
+						if (status.ok() && response.success()) {
+							promise->set_value(storage_nodes);
+						}
+						else {
+							post_fallback(retry);
+						}
+					}, ASYNC_CALL_TIMEOUT_MS);
+				return future;
+			}
+
+			StoragePutRequest request;
+			request.set_key(key);
+			set_values(key, value, request);
+			request.set_priority(txn_priority());
+			uint64_t txn_id = next_txn_id();
+			request.set_txn_id(txn_id);
+
+			std::vector<StoragePutRequest> hinted_requests;
+			std::vector<const StoragePutRequest*> request_ptrs;
+			hint_requests(request, replicas, storage_nodes, hinted_requests, request_ptrs);
+
+			if (storage_nodes.size() == 1) {
+				detach(get_storage_stub(storage_nodes[0]), *request_ptrs[0], &GTStoreStorageService::Stub::PrepareAsyncput,
+					[this, promise, storage_nodes, retry](const Status& status, const StoragePutResponse& response) {
+						if (status.ok() && response.success()) {
+							promise->set_value(storage_nodes);
+						}
+						else {
+							post_fallback(retry);
+						}
+					}, ASYNC_CALL_TIMEOUT_MS);
+				return future;
+			}
+
+			size_t needed = replicas_needed(consistency, storage_nodes.size());
+			start_prepares(key, txn_id, storage_nodes, request_ptrs, [this, promise, storage_nodes, needed, retry](PrepareRound& round) {
+				decide_put(round, storage_nodes, needed, promise, retry);
+			});
+			return future;
+		}
+
+		// The decision put makes for a put_async round, taken on the poller as its prepares
+		// answer: commit once needed replicas prepared, or abort once too many did not and
+		// leave the write to the fallback client. Nodes that failed outright are reported there.
+		void decide_put(PrepareRound& round, const std::vector<string>& storage_nodes, size_t needed,
+				const std::shared_ptr<std::promise<vector<string>>>& promise, const std::function<void(GTStoreClientImpl&)>& retry) {
+			size_t prepared = 0;
+			size_t failed = 0;
+			for (size_t i = 0; i < storage_nodes.size(); i++) {
+				if (round.prepared(i)) {
+					prepared++;
+				}
+				else if (round.answered[i]) {
+					failed++;
+				}
+			}
+			if (prepared < needed && failed <= storage_nodes.size() - needed) {
+				return;
+			}
+
+			bool commit = prepared >= needed;
+			round.outcome = commit ? PrepareRound::COMMIT : PrepareRound::ABORT;
+			round.version = round.proposed_version();
+			// Commits still to answer before the write counts as done
+			auto committing = std::make_shared<std::atomic<size_t>>(prepared);
+
+			for (size_t i = 0; i < storage_nodes.size(); i++) {
+				if (!round.answered[i]) {
+					continue;
+				}
+
+				if (commit && round.prepared(i)) {
+					StorageCommitPutRequest request;
+					request.set_key(round.key);
+					request.set_txn_id(round.txn_id);
+					request.set_version(round.version);
+					detach(round.stubs[i], request, &GTStoreStorageService::Stub::PrepareAsynccommit_put,
+						[promise, committing, storage_nodes](const Status&, const StorageCommitPutResponse&) {
+							if (--*committing == 0) {
+								promise->set_value(storage_nodes);
 							}
-							return std::vector<string>();
+						});
+				}
+				else if (round.reachable(i)) {
+					StorageAbortPutRequest request;
+					request.set_key(round.key);
+					request.set_txn_id(round.txn_id);
+					detach(round.stubs[i], request, &GTStoreStorageService::Stub::PrepareAsyncabort_put);
+				}
+				else {
+					std::string storage_node = storage_nodes[i];
+					post_fallback([storage_node](GTStoreClientImpl& client) {
+						client.report_failure(storage_node);
+					});
+				}
+			}
+
+			if (!commit) {
+				post_fallback(retry);
+			}
+		}
+
+		// Start the fallback client's thread if this is the first async request
+		void start_fallback() {
+			if (!fallback.joinable()) {
+				fallback = std::thread(&GTStoreClientImpl::run_fallback, this);
+			}
+		}
+
+		void post_fallback(std::function<void(GTStoreClientImpl&)> job) {
+			{
+				std::lock_guard<std::mutex> lock(fallback_mutex);
+				fallback_jobs.push_back(std::move(job));
+			}
+			fallback_cv.notify_one();
+		}
+
+		// Run fallback jobs in order on a client of this thread's own, until the queue is
+		// empty after the client began to go
+		void run_fallback() {
+			GTStoreClientOptions fallback_options = options;
+			// Values it reads are not shared with this client's cache
+			fallback_options.cache_bytes = 0;
+			GTStoreClientImpl client(fallback_options);
+			client.init(client_id);
+
+			while (true) {
+				std::function<void(GTStoreClientImpl&)> job;
+				{
+					std::unique_lock<std::mutex> lock(fallback_mutex);
+					fallback_cv.wait(lock, [this] { return fallback_stopping || !fallback_jobs.empty(); });
+					if (fallback_jobs.empty()) {
+						break;
+					}
+					job = std::move(fallback_jobs.front());
+					fallback_jobs.pop_front();
+				}
+				job(client);
+			}
+
+			client.finalize();
+		}
+
+		// Read keys at ONE, batched per node. Like get, a key a replica answered without, or
+		// whose replica failed, is asked of its next replica, until one has it or none is left.
+		vector<val_t> multi_get(vector<string> keys) {
+			TraceSpan span("multi_get", Tracer::sample(options.trace_sample));
+			vector<val_t> results(keys.size());
+			std::vector<size_t> pending;
+			// Replicas each key was already asked
+			std::vector<std::set<string>> tried(keys.size());
+
+			for (size_t i = 0; i < keys.size(); i++) {
+				if (!cache || !cache->get(keys[i], results[i])) {
+					pending.push_back(i);
+				}
+			}
+
+			while (!pending.empty()) {
+				auto ring = get_ring();
+
+				// Group the keys by the first of their replicas not yet asked, one batched request
+				// per node
+				std::map<string, std::vector<size_t>> key_groups;
+				for (size_t i : pending) {
+					std::vector<HashRing::Replica> replicas = ring->put_replicas(keys[i]);
+
+					if (replicas.empty()) {
+						if (g_verbose) {
+							std::cout << "MULTI_GET failed: no storage nodes available" << std::endl;
 						}
+						return results;
 					}
-					else {
-						storage_nodes_success.push_back(storage_node);
+					for (const auto& replica : replicas) {
+						if (!tried[i].count(replica.storage_node)) {
+							key_groups[replica.storage_node].push_back(i);
+							break;
+						}
 					}
 				}
 
-				if (storage_nodes_success.size() != storage_nodes.size()) {
-					for (const auto& storage_node : storage_nodes) {
-						// Abort put transaction
-						StorageAbortPutRequest abort_put_request;
-						abort_put_request.set_key(key);
-						StorageAbortPutResponse abort_put_response;
-						ClientContext abort_put_context;
-						Status abort_put_status = storage_node_stubs[storage_node]->abort_put(&abort_put_context, abort_put_request, &abort_put_response);
+				std::vector<string> storage_nodes;
+				std::vector<StorageMultiGetRequest> requests(key_groups.size());
+				std::vector<const StorageMultiGetRequest*> request_ptrs;
+
+				for (auto& [storage_node, indices] : key_groups) {
+					StorageMultiGetRequest& request = requests[storage_nodes.size()];
+					for (size_t i : indices) {
+						request.add_keys(keys[i]);
 					}
+					storage_nodes.push_back(storage_node);
+					request_ptrs.push_back(&request);
 				}
-				else {
+
+				std::vector<StorageMultiGetResponse> responses;
+				std::vector<Status> statuses = fan_out(storage_nodes, request_ptrs, responses, &GTStoreStorageService::Stub::PrepareAsyncmulti_get);
+
+				pending.clear();
+				for (size_t n = 0; n < storage_nodes.size(); n++) {
+					const std::vector<size_t>& indices = key_groups[storage_nodes[n]];
+					for (size_t i : indices) {
+						tried[i].insert(storage_nodes[n]);
+					}
+
+					if (!statuses[n].ok() || !responses[n].success()) {
+						// Report failure to manager; the node's keys go to their next replicas
+						report_failure(storage_nodes[n]);
+						pending.insert(pending.end(), indices.begin(), indices.end());
+						continue;
+					}
+
+					for (size_t j = 0; j < indices.size(); j++) {
+						if (j < (size_t) responses[n].results_size() && responses[n].results(j).success()) {
+							results[indices[j]] = decode_values(responses[n].results(j));
+						}
+						else {
+							pending.push_back(indices[j]);
+						}
+					}
+				}
+			}
+
+			if (g_verbose) std::cout << "<MULTI_GET> " << keys.size() << " keys" << std::endl;
+
+			return results;
+		}
+
+		vector<vector<string>> multi_put(vector<pair<string, val_t>> entries) {
+			TraceSpan span("multi_put", Tracer::sample(options.trace_sample));
+			vector<vector<string>> placements(entries.size());
+
+			// A key given twice is written once, with its last value
+			std::unordered_map<string, size_t> latest;
+			for (size_t i = 0; i < entries.size(); i++) {
+				latest[entries[i].first] = i;
+				if (cache) {
+					cache->erase(entries[i].first);
+				}
+			}
+			if (replication == GTStoreReplication::CHAIN) {
+				return chain_multi_put(entries, latest);
+			}
+			uint64_t priority = txn_priority();
+
+			for (int attempt = 0; ; attempt++) {
+				auto ring = get_ring();
+
+				// Group the entries by replica node, one batched transaction per node
+				std::map<string, std::vector<size_t>> key_groups;
+				std::map<std::pair<string, size_t>, string> hints;
+				for (auto& [key, i] : latest) {
+					std::vector<HashRing::Replica> replicas = ring->put_replicas(key);
+
+					if (replicas.empty()) {
+						if (g_verbose) {
+							std::cout << "MULTI_PUT failed: no storage nodes available" << std::endl;
+						}
+						return vector<vector<string>>(entries.size());
+					}
+
+					placements[i].clear();
+					for (const auto& replica : replicas) {
+						placements[i].push_back(replica.storage_node);
+						key_groups[replica.storage_node].push_back(i);
+						if (!replica.hint_for.empty()) {
+							hints[{replica.storage_node, i}] = replica.hint_for;
+						}
+					}
+				}
+
+				uint64_t txn_id = next_txn_id();
+				std::vector<string> storage_nodes;
+				std::vector<StorageMultiPutRequest> requests(key_groups.size());
+				std::vector<const StorageMultiPutRequest*> request_ptrs;
+
+				for (auto& [storage_node, indices] : key_groups) {
+					StorageMultiPutRequest& request = requests[storage_nodes.size()];
+					request.set_txn_id(txn_id);
+					request.set_priority(priority);
+					for (size_t i : indices) {
+						StoragePutRequest* entry = request.add_entries();
+						entry->set_key(entries[i].first);
+						set_values(entries[i].first, entries[i].second, *entry);
+
+						auto hint = hints.find({storage_node, i});
+						if (hint != hints.end()) {
+							entry->set_hint_for(hint->second);
+						}
+					}
+					storage_nodes.push_back(storage_node);
+					request_ptrs.push_back(&request);
+				}
+
+				std::vector<StorageMultiPutResponse> responses;
+				std::vector<Status> statuses = fan_out(storage_nodes, request_ptrs, responses,
+						&GTStoreStorageService::Stub::PrepareAsyncmulti_prepare_put, PREPARE_TIMEOUT_MS);
+
+				std::vector<size_t> reachable;
+				bool prepared;
+
+				if (!check_prepares(storage_nodes, statuses, responses, reachable, prepared)) {
+					return vector<vector<string>>(entries.size());
+				}
+
+				if (!prepared) {
+					// Abort put transaction
+					std::vector<string> storage_nodes_reachable;
+					std::vector<StorageMultiAbortPutRequest> abort_requests(reachable.size());
+					std::vector<const StorageMultiAbortPutRequest*> abort_request_ptrs;
+
+					for (size_t n = 0; n < reachable.size(); n++) {
+						abort_requests[n].set_txn_id(txn_id);
+						for (size_t i : key_groups[storage_nodes[reachable[n]]]) {
+							abort_requests[n].add_keys(entries[i].first);
+						}
+						storage_nodes_reachable.push_back(storage_nodes[reachable[n]]);
+						abort_request_ptrs.push_back(&abort_requests[n]);
+					}
+
+					std::vector<StorageMultiAbortPutResponse> abort_responses;
+					fan_out(storage_nodes_reachable, abort_request_ptrs, abort_responses, &GTStoreStorageService::Stub::PrepareAsyncmulti_abort_put);
+
+					backoff(attempt);
+					continue;
+				}
+
+				// Commit put transaction, at the highest version any node proposed
+				uint64_t version = 0;
+				for (const auto& response : responses) {
+					version = std::max(version, response.version());
+				}
+				std::vector<StorageMultiCommitPutRequest> commit_requests(storage_nodes.size());
+				std::vector<const StorageMultiCommitPutRequest*> commit_request_ptrs;
+
+				for (size_t n = 0; n < storage_nodes.size(); n++) {
+					commit_requests[n].set_txn_id(txn_id);
+					commit_requests[n].set_version(version);
+					for (size_t i : key_groups[storage_nodes[n]]) {
+						commit_requests[n].add_keys(entries[i].first);
+					}
+					commit_request_ptrs.push_back(&commit_requests[n]);
+				}
+
+				std::vector<StorageMultiCommitPutResponse> commit_responses;
+				fan_out(storage_nodes, commit_request_ptrs, commit_responses, &GTStoreStorageService::Stub::PrepareAsyncmulti_commit_put);
+
+				for (size_t i = 0; i < entries.size(); i++) {
+					placements[i] = placements[latest[entries[i].first]];
+				}
+
+				if (g_verbose) std::cout << "<MULTI_PUT> " << latest.size() << " keys to " << storage_nodes.size() << " nodes" << std::endl;
+
+				return placements;
+			}
+		}
+
+		// multi_put under chain replication: a chain write per key, so the head of each key's
+		// chain orders it with single PUTs of the key. They are sent at once; writes that
+		// failed are retried one at a time as chain_put retries them.
+		vector<vector<string>> chain_multi_put(const vector<pair<string, val_t>>& entries, const std::unordered_map<string, size_t>& latest) {
+			auto ring = get_ring();
+			std::vector<size_t> indices;
+			std::vector<string> heads;
+			std::vector<StorageChainPutRequest> requests(latest.size());
+			std::vector<const StorageChainPutRequest*> request_ptrs;
+			vector<vector<string>> placements(entries.size());
+
+			for (const auto& [key, i] : latest) {
+				std::vector<HashRing::Replica> replicas = ring->put_replicas(key);
+				if (replicas.empty()) {
 					if (g_verbose) {
-						std::cout << "<PUT> " << key << ", ";
+						std::cout << "MULTI_PUT failed: no storage nodes available" << std::endl;
+					}
+					return vector<vector<string>>(entries.size());
+				}
+
+				StorageChainPutRequest& request = requests[indices.size()];
+				request.set_key(key);
+				set_values(key, entries[i].second, request);
+				chain_request(request, replicas, placements[i]);
+				indices.push_back(i);
+				heads.push_back(placements[i][0]);
+				request_ptrs.push_back(&request);
+			}
+
+			std::vector<StorageChainPutResponse> responses;
+			std::vector<Status> statuses = fan_out(heads, request_ptrs, responses, &GTStoreStorageService::Stub::PrepareAsyncchain_put,
+					CHAIN_PUT_TIMEOUT_MS);
+
+			for (size_t n = 0; n < indices.size(); n++) {
+				if (!statuses[n].ok() || !responses[n].success()) {
+					size_t i = indices[n];
+					placements[i] = chain_put(entries[i].first, entries[i].second);
+				}
+			}
 
-						for (const auto& val : value) {
-							std::cout << val << " ";
+			for (size_t i = 0; i < entries.size(); i++) {
+				placements[i] = placements[latest.at(entries[i].first)];
+			}
+
+			if (g_verbose) std::cout << "<MULTI_PUT> " << latest.size() << " keys by chain" << std::endl;
+
+			return placements;
+		}
+
+		// One storage node's stream of a scan, read a batch at a time
+		struct ScanStream {
+			std::string storage_node;
+			ClientContext context;
+			RpcTrace trace;
+			std::unique_ptr<grpc::ClientReader<StorageScanResponse>> reader;
+			StorageScanResponse batch;
+			int next = 0;
+			bool finished = false;
+			Status status;
+
+			// The entry at the head of the stream, or null once it ended, with status set
+			const StorageScanEntry* head() {
+				while (!finished && next == batch.entries_size()) {
+					next = 0;
+					if (!reader->Read(&batch)) {
+						finished = true;
+						status = reader->Finish();
+						trace.finish();
+					}
+				}
+				return finished ? nullptr : &batch.entries(next);
+			}
+		};
+
+		// Stream the range from every node scan_nodes picks at once and merge the streams in
+		// key order, handing fn the newest copy of each key as soon as every stream is past
+		// it. If a node fails, it is reported and the scan resumes after the last key handed
+		// over, on the new ring and without that node, whose ranges go to their next replicas.
+		size_t scan(const std::string& start_key, const std::string& end_key, size_t limit,
+				const std::function<bool(const string&, const val_t&)>& fn) {
+			TraceSpan span("scan", Tracer::sample(options.trace_sample));
+			std::string cursor = start_key;
+			size_t delivered = 0;
+			// Nodes whose stream failed, passed over for the next replica from then on
+			std::set<string> failed_nodes;
+
+			while (true) {
+				std::vector<string> storage_nodes = scan_nodes(*get_ring(), cursor, end_key, failed_nodes);
+
+				if (storage_nodes.empty()) {
+					if (g_verbose) {
+						std::cout << "SCAN failed: no storage nodes available" << std::endl;
+					}
+					return delivered;
+				}
+
+				StorageScanRequest request;
+				request.set_start_key(cursor);
+				request.set_end_key(end_key);
+				request.set_limit(limit > 0 ? limit - delivered : 0);
+
+				std::vector<std::unique_ptr<ScanStream>> streams;
+				for (const auto& storage_node : storage_nodes) {
+					streams.emplace_back(new ScanStream());
+					ScanStream& stream = *streams.back();
+					stream.storage_node = storage_node;
+					stream.trace.start("scan", storage_node, stream.context);
+					stream.reader = get_storage_stub(storage_node)->scan(&stream.context, request);
+				}
+
+				ScanStream* failed = nullptr;
+				bool stopped = false;
+				while (!stopped && (limit == 0 || delivered < limit)) {
+					// The smallest key at the head of a stream, in its newest copy
+					const StorageScanEntry* newest = nullptr;
+					for (auto& stream : streams) {
+						const StorageScanEntry* head = stream->head();
+						if (!head && !stream->status.ok()) {
+							failed = stream.get();
+							break;
+						}
+						if (head && (!newest || head->key() < newest->key()
+								|| (head->key() == newest->key() && head->version() > newest->version()))) {
+							newest = head;
 						}
+					}
+					if (failed || !newest) {
+						break;
+					}
 
-						std::cout << ", to ";
+					std::string key = newest->key();
+					val_t value = decode_values(*newest);
+					for (auto& stream : streams) {
+						const StorageScanEntry* head = stream->head();
+						if (head && head->key() == key) {
+							stream->next++;
+						}
 					}
 
-					for (const auto& storage_node : storage_nodes_success) {
-						// Commit put transaction
-						StorageCommitPutRequest commit_put_request;
-						commit_put_request.set_key(key);
-						StorageCommitPutResponse commit_put_response;
-						ClientContext commit_put_context;
-						Status commit_put_status = storage_node_stubs[storage_node]->commit_put(&commit_put_context, commit_put_request, &commit_put_response);
+					cursor = key + '\0';
+					delivered++;
+					stopped = !fn(key, value);
+				}
 
-						if (g_verbose) std::cout << storage_node << ", ";
+				// Streams still open are no longer needed
+				for (auto& stream : streams) {
+					if (!stream->finished) {
+						stream->context.TryCancel();
+						stream->reader->Finish();
+						stream->trace.finish();
+					}
+				}
+
+				if (!failed) {
+					if (g_verbose) {
+						std::cout << "<SCAN> " << delivered << " keys from " << storage_nodes.size() << " nodes" << std::endl;
 					}
+					return delivered;
+				}
+
+				// Report failure to manager, and resume on the next replica even if it was not heard
+				failed_nodes.insert(failed->storage_node);
+				report_failure(failed->storage_node);
+			}
+		}
 
-					if (g_verbose) std::cout << std::endl;
+		// Nodes to ask for the keys from start_key up to end_key, leaving out the failed ones.
+		// Under range placement, the first replica that is up of each range they span;
+		// otherwise any node may hold any key, so every node that is up.
+		std::vector<string> scan_nodes(const HashRing& ring, const std::string& start_key, const std::string& end_key,
+				const std::set<string>& failed_nodes) {
+			std::set<string> storage_nodes;
+			if (ring.empty()) {
+				return std::vector<string>();
+			}
 
-					return storage_nodes;
+			if (placement != GTStorePlacement::RANGE) {
+				for (size_t i = 0; i < ring.nodes.size(); i++) {
+					if (!ring.is_down(i) && !failed_nodes.count(ring.nodes[i])) {
+						storage_nodes.insert(ring.nodes[i]);
+					}
 				}
+				return std::vector<string>(storage_nodes.begin(), storage_nodes.end());
 			}
-            return std::vector<string>();
-        }
+
+			// Ranges end at their boundaries, the last one at UINT64_MAX
+			std::vector<uint64_t> ends = ring.placement->boundaries();
+			uint64_t last = end_key.empty() ? UINT64_MAX : key_position(end_key);
+			for (auto it = std::lower_bound(ends.begin(), ends.end(), key_position(start_key)); it != ends.end(); ++it) {
+				for (const auto& replica : ring.put_replicas_at(*it)) {
+					if (!failed_nodes.count(replica.storage_node)) {
+						storage_nodes.insert(replica.storage_node);
+						break;
+					}
+				}
+				if (*it >= last) {
+					break;
+				}
+			}
+			return std::vector<string>(storage_nodes.begin(), storage_nodes.end());
+		}
 
         void finalize() {
             ManagerFinalizeRequest request;
@@ -229,13 +1877,8 @@ GTStoreClient::~GTStoreClient() {
 	finalize();
 }
 
-void GTStoreClient::init(int id, bool verbose) {
-    auto channel = grpc::CreateChannel(
-        "localhost:50000",
-        grpc::InsecureChannelCredentials()
-    );
-
-    impl = new GTStoreClientImpl(channel);
+void GTStoreClient::init(int id, bool verbose, const GTStoreClientOptions& options) {
+    impl = new GTStoreClientImpl(options);
     impl->init(id);
     client_id = id;
 	g_verbose = verbose;
@@ -249,12 +1892,59 @@ void GTStoreClient::finalize() {
     }
 }
 
-val_t GTStoreClient::get(string key) {
+val_t GTStoreClient::get(string key, GTStoreConsistency consistency) {
     if (!impl) return val_t();
-    return impl->get(key);
+    return impl->get(key, consistency);
 }
 
-vector<string> GTStoreClient::put(string key, val_t value) {
+vector<string> GTStoreClient::put(string key, val_t value, GTStoreConsistency consistency) {
     if (!impl) return std::vector<string>();
-    return impl->put(key, value);
+    return impl->put(key, value, consistency);
+}
+
+vector<val_t> GTStoreClient::multi_get(vector<string> keys) {
+    if (!impl) return vector<val_t>(keys.size());
+    return impl->multi_get(keys);
+}
+
+vector<vector<string>> GTStoreClient::multi_put(vector<pair<string, val_t>> entries) {
+    if (!impl) return vector<vector<string>>(entries.size());
+    return impl->multi_put(entries);
+}
+
+std::future<val_t> GTStoreClient::get_async(string key, GTStoreConsistency consistency) {
+    if (!impl) {
+        std::promise<val_t> promise;
+        promise.set_value(val_t());
+        return promise.get_future();
+    }
+    return impl->get_async(key, consistency);
+}
+
+std::future<vector<string>> GTStoreClient::put_async(string key, val_t value, GTStoreConsistency consistency) {
+    if (!impl) {
+        std::promise<vector<string>> promise;
+        promise.set_value(vector<string>());
+        return promise.get_future();
+    }
+    return impl->put_async(key, value, consistency);
+}
+
+vector<pair<string, val_t>> GTStoreClient::scan(string start_key, string end_key, size_t limit) {
+    vector<pair<string, val_t>> entries;
+    if (!impl) return entries;
+    impl->scan(start_key, end_key, limit, [&entries](const string& key, const val_t& value) {
+        entries.emplace_back(key, value);
+        return true;
+    });
+    return entries;
+}
+
+size_t GTStoreClient::scan(string start_key, string end_key, size_t limit, const std::function<bool(const string&, const val_t&)>& fn) {
+    if (!impl) return 0;
+    return impl->scan(start_key, end_key, limit, fn);
+}
+
+string GTStoreClient::train_dictionary(const vector<string>& samples, size_t max_bytes) {
+    return ::train_dictionary(samples, max_bytes);
 }
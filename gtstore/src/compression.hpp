@@ -0,0 +1,364 @@
+#ifndef GTSTORE_COMPRESSION
+#define GTSTORE_COMPRESSION
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <zlib.h>
+#include "gtstore.hpp"
+#include "hash.hpp"
+
+// deflate level values are compressed at: the fastest, since every write pays for it
+#define COMPRESS_LEVEL 1
+// Most bytes deflate can encode in one compressed byte: a 258-byte match in two bits
+#define DEFLATE_MAX_RATIO 1032
+// Length of the substrings dictionary training counts across samples
+#define DICTIONARY_KMER 8
+// Bytes of a sample that training scores, and copies into the dictionary, at a time
+#define DICTIONARY_SEGMENT 64
+
+// How a value is stored and sent. The client that writes a value picks its encoding; storage
+// nodes keep the encoding with the value and hand it back with every copy, never decoding it.
+enum class ValueEncoding : uint32_t {
+    // The elements as they are
+    RAW = 0,
+    // One element: the u32 size of the packed elements (u32 count, and u32 length + bytes per
+    // element), then the packed elements as a raw deflate stream
+    DEFLATE = 1,
+    // One element: the u64 id of a dictionary, then as DEFLATE, deflated against it
+    DEFLATE_DICTIONARY = 2
+};
+
+// The dictionaries a process knows, by id, shared by all its clients; never destroyed
+class DictionaryRegistry {
+    public:
+        static uint64_t id_of(const std::string& dictionary) {
+            return stable_hash(dictionary);
+        }
+
+        static std::string key_of(uint64_t id) {
+            char hex[17];
+            std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(id));
+            return DICTIONARY_KEY_PREFIX + std::string(hex);
+        }
+
+        static bool is_key(const std::string& key) {
+            return key.compare(0, sizeof(DICTIONARY_KEY_PREFIX) - 1, DICTIONARY_KEY_PREFIX) == 0;
+        }
+
+        // Returns false if the dictionary was known already
+        static bool add(const std::string& dictionary) {
+            DictionaryRegistry& registry = instance();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            auto& known = registry.dictionaries[id_of(dictionary)];
+            if (known) {
+                return false;
+            }
+            known = std::make_shared<const std::string>(dictionary);
+            return true;
+        }
+
+        static std::shared_ptr<const std::string> find(uint64_t id) {
+            DictionaryRegistry& registry = instance();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            auto it = registry.dictionaries.find(id);
+            return it == registry.dictionaries.end() ? nullptr : it->second;
+        }
+
+    private:
+        std::mutex mutex;
+        std::unordered_map<uint64_t, std::shared_ptr<const std::string>> dictionaries;
+
+        static DictionaryRegistry& instance() {
+            static DictionaryRegistry* registry = new DictionaryRegistry();
+            return *registry;
+        }
+};
+
+// Compresses the values a client writes, once, before they are sent to every replica, and
+// decompresses the values it reads. Values under the threshold, and values deflate does not
+// shrink, stay raw. Each thread keeps one deflate and one inflate stream, reset between values.
+class ValueCodec {
+    public:
+        // Compress values of at least min_bytes, against dictionary unless it is empty
+        ValueCodec(size_t min_bytes, const std::string& dictionary) : min_bytes(min_bytes) {
+            if (!dictionary.empty()) {
+                DictionaryRegistry::add(dictionary);
+                dictionary_id = DictionaryRegistry::id_of(dictionary);
+                this->dictionary = DictionaryRegistry::find(dictionary_id);
+            }
+        }
+
+        // Set the values of a StoragePutRequest or StorageChainPutRequest, and their encoding
+        template <class Request>
+        void encode(const std::vector<std::string>& value, Request& request) const {
+            request.clear_values();
+            std::string compressed;
+            if (compress(value, compressed)) {
+                request.add_values(std::move(compressed));
+                request.set_encoding(static_cast<uint32_t>(dictionary ? ValueEncoding::DEFLATE_DICTIONARY : ValueEncoding::DEFLATE));
+                return;
+            }
+
+            for (const auto& element : value) {
+                request.add_values(element);
+            }
+            request.set_encoding(static_cast<uint32_t>(ValueEncoding::RAW));
+        }
+
+        // The value in a reply with values and an encoding. Returns false if it was compressed
+        // against a dictionary this process does not know, with its id in missing. A value
+        // that does not decode comes back empty, as if the key were not found.
+        template <class Reply>
+        static bool decode(const Reply& reply, std::vector<std::string>& value, uint64_t& missing) {
+            auto encoding = static_cast<ValueEncoding>(reply.encoding());
+            if (encoding == ValueEncoding::RAW) {
+                value.assign(reply.values().begin(), reply.values().end());
+                return true;
+            }
+
+            value.clear();
+            if (reply.values_size() != 1) {
+                return true;
+            }
+            std::string_view data = reply.values(0);
+
+            std::shared_ptr<const std::string> dictionary;
+            if (encoding == ValueEncoding::DEFLATE_DICTIONARY) {
+                if (data.size() < 8) {
+                    return true;
+                }
+                std::memcpy(&missing, data.data(), 8);
+                data.remove_prefix(8);
+                dictionary = DictionaryRegistry::find(missing);
+                if (!dictionary) {
+                    return false;
+                }
+            }
+            else if (encoding != ValueEncoding::DEFLATE) {
+                return true;
+            }
+
+            std::string packed;
+            if (decompress(data, dictionary.get(), packed)) {
+                unpack(packed, value);
+            }
+            return true;
+        }
+
+    private:
+        size_t min_bytes;
+        uint64_t dictionary_id = 0;
+        std::shared_ptr<const std::string> dictionary;
+
+        struct Deflater {
+            z_stream stream{};
+
+            Deflater() {
+                deflateInit2(&stream, COMPRESS_LEVEL, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+            }
+
+            ~Deflater() {
+                deflateEnd(&stream);
+            }
+        };
+
+        struct Inflater {
+            z_stream stream{};
+
+            Inflater() {
+                inflateInit2(&stream, -MAX_WBITS);
+            }
+
+            ~Inflater() {
+                inflateEnd(&stream);
+            }
+        };
+
+        // The compressed form of value, if it is worth sending instead
+        bool compress(const std::vector<std::string>& value, std::string& out) const {
+            size_t bytes = 0;
+            for (const auto& element : value) {
+                bytes += element.size();
+            }
+            if (bytes < min_bytes) {
+                return false;
+            }
+
+            std::string packed;
+            pack(value, packed);
+            if (dictionary) {
+                out.append(reinterpret_cast<const char*>(&dictionary_id), 8);
+            }
+            append_u32(out, packed.size());
+            size_t header = out.size();
+
+            thread_local Deflater deflater;
+            z_stream& stream = deflater.stream;
+            deflateReset(&stream);
+            if (dictionary) {
+                deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dictionary->data()), dictionary->size());
+            }
+
+            out.resize(header + deflateBound(&stream, packed.size()));
+            stream.next_in = reinterpret_cast<Bytef*>(&packed[0]);
+            stream.avail_in = packed.size();
+            stream.next_out = reinterpret_cast<Bytef*>(&out[header]);
+            stream.avail_out = out.size() - header;
+            if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+                return false;
+            }
+            out.resize(header + stream.total_out);
+            return out.size() < bytes;
+        }
+
+        static bool decompress(std::string_view data, const std::string* dictionary, std::string& packed) {
+            if (data.size() < 4) {
+                return false;
+            }
+            uint32_t size;
+            std::memcpy(&size, data.data(), 4);
+            data.remove_prefix(4);
+            // The size comes from the value itself, so refuse one no stream this long could hold
+            if (size > static_cast<uint64_t>(data.size()) * DEFLATE_MAX_RATIO) {
+                return false;
+            }
+
+            thread_local Inflater inflater;
+            z_stream& stream = inflater.stream;
+            inflateReset(&stream);
+            if (dictionary) {
+                inflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dictionary->data()), dictionary->size());
+            }
+
+            packed.resize(size);
+            stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+            stream.avail_in = data.size();
+            stream.next_out = reinterpret_cast<Bytef*>(&packed[0]);
+            stream.avail_out = size;
+            return inflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out == size;
+        }
+
+        static void pack(const std::vector<std::string>& value, std::string& out) {
+            append_u32(out, value.size());
+            for (const auto& element : value) {
+                append_u32(out, element.size());
+                out.append(element);
+            }
+        }
+
+        static void unpack(const std::string& packed, std::vector<std::string>& value) {
+            size_t pos = 4;
+            uint32_t count = packed.size() >= 4 ? read_u32(packed, 0) : 0;
+            for (uint32_t i = 0; i < count && pos + 4 <= packed.size(); i++) {
+                uint32_t length = read_u32(packed, pos);
+                if (pos + 4 + length > packed.size()) {
+                    break;
+                }
+                value.emplace_back(packed, pos + 4, length);
+                pos += 4 + length;
+            }
+            if (value.size() != count) {
+                value.clear();
+            }
+        }
+
+        static void append_u32(std::string& out, uint32_t n) {
+            out.append(reinterpret_cast<const char*>(&n), 4);
+        }
+
+        static uint32_t read_u32(const std::string& data, size_t pos) {
+            uint32_t n;
+            std::memcpy(&n, data.data() + pos, 4);
+            return n;
+        }
+};
+
+// A dictionary of at most max_bytes for compressing values like samples, a simplified form
+// of zstd's COVER training. Samples are cut into segments, scored by how many samples share
+// each substring of the segment, and the best segments are taken greedily; a substring
+// counts only for the first segment taken that holds it. The best segment goes last, where
+// deflate reaches it over the shortest distance.
+inline std::string train_dictionary(const std::vector<std::string>& samples, size_t max_bytes = DICTIONARY_MAX_BYTES) {
+    // Samples each substring appears in
+    std::unordered_map<std::string_view, uint32_t> frequency;
+    std::unordered_set<std::string_view> seen;
+    for (const auto& sample : samples) {
+        seen.clear();
+        for (size_t i = 0; i + DICTIONARY_KMER <= sample.size(); i++) {
+            std::string_view kmer(sample.data() + i, DICTIONARY_KMER);
+            if (seen.insert(kmer).second) {
+                frequency[kmer]++;
+            }
+        }
+    }
+
+    // Substrings only one sample holds do not help compress others
+    auto score = [&](std::string_view segment) {
+        uint64_t total = 0;
+        seen.clear();
+        for (size_t i = 0; i + DICTIONARY_KMER <= segment.size(); i++) {
+            std::string_view kmer = segment.substr(i, DICTIONARY_KMER);
+            uint32_t count = frequency[kmer];
+            if (count > 1 && seen.insert(kmer).second) {
+                total += count;
+            }
+        }
+        return total;
+    };
+
+    // Scores only fall as segments are taken, so a segment whose fresh score still tops the
+    // queue is the best one left
+    std::priority_queue<std::pair<uint64_t, std::string_view>> queue;
+    for (const auto& sample : samples) {
+        for (size_t start = 0; start < sample.size(); start += DICTIONARY_SEGMENT) {
+            std::string_view segment = std::string_view(sample).substr(start, DICTIONARY_SEGMENT);
+            uint64_t segment_score = score(segment);
+            if (segment_score > 0) {
+                queue.emplace(segment_score, segment);
+            }
+        }
+    }
+
+    std::vector<std::string_view> taken;
+    size_t bytes = 0;
+    while (!queue.empty()) {
+        std::string_view segment = queue.top().second;
+        queue.pop();
+        uint64_t segment_score = score(segment);
+        if (segment_score == 0) {
+            continue;
+        }
+        if (!queue.empty() && segment_score < queue.top().first) {
+            queue.emplace(segment_score, segment);
+            continue;
+        }
+        if (bytes + segment.size() > max_bytes) {
+            break;
+        }
+
+        taken.push_back(segment);
+        bytes += segment.size();
+        for (size_t i = 0; i + DICTIONARY_KMER <= segment.size(); i++) {
+            frequency[segment.substr(i, DICTIONARY_KMER)] = 0;
+        }
+    }
+
+    std::string dictionary;
+    dictionary.reserve(bytes);
+    for (auto it = taken.rbegin(); it != taken.rend(); ++it) {
+        dictionary.append(*it);
+    }
+    return dictionary;
+}
+
+#endif
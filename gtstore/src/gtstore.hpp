@@ -6,6 +6,8 @@
 #include <cstdlib>
 #include <iostream>
 #include <vector>
+#include <future>
+#include <functional>
 #include <unistd.h>
 #include <sys/wait.h>
 
@@ -31,6 +33,20 @@ using gtstore::ManagerReportFailureRequest;
 using gtstore::ManagerReportFailureResponse;
 using gtstore::ManagerUpdateStatusRequest;
 using gtstore::ManagerUpdateStatusResponse;
+using gtstore::ManagerGetRingRequest;
+using gtstore::ManagerGetRingResponse;
+using gtstore::ManagerRouteRequest;
+using gtstore::ManagerRouteResponse;
+using gtstore::ManagerTransferDoneRequest;
+using gtstore::ManagerTransferDoneResponse;
+using gtstore::ManagerRebalanceStatusRequest;
+using gtstore::ManagerRebalanceStatusResponse;
+using gtstore::StatsMetric;
+using gtstore::ManagerStatsRequest;
+using gtstore::ManagerStatsResponse;
+using gtstore::TracedSpan;
+using gtstore::ManagerTraceRequest;
+using gtstore::ManagerTraceResponse;
 using gtstore::GTStoreStorageService;
 using gtstore::StorageGetRequest;
 using gtstore::StorageGetResponse;
@@ -40,14 +56,90 @@ using gtstore::StorageCommitPutRequest;
 using gtstore::StorageCommitPutResponse;
 using gtstore::StorageAbortPutRequest;
 using gtstore::StorageAbortPutResponse;
+using gtstore::StorageMultiGetRequest;
+using gtstore::StorageMultiGetResponse;
+using gtstore::StorageMultiPutRequest;
+using gtstore::StorageMultiPutResponse;
+using gtstore::StorageMultiCommitPutRequest;
+using gtstore::StorageMultiCommitPutResponse;
+using gtstore::StorageMultiAbortPutRequest;
+using gtstore::StorageMultiAbortPutResponse;
+using gtstore::StorageRepairEntry;
+using gtstore::StorageRepairRequest;
+using gtstore::StorageRepairResponse;
+using gtstore::StorageHashRange;
+using gtstore::StorageTransferRequest;
+using gtstore::StorageTransferResponse;
+using gtstore::StorageChainLink;
+using gtstore::StorageChainPutRequest;
+using gtstore::StorageChainPutResponse;
+using gtstore::StorageStatsRequest;
+using gtstore::StorageStatsResponse;
+using gtstore::StorageTraceRequest;
+using gtstore::StorageTraceResponse;
+using gtstore::StorageScanRequest;
+using gtstore::StorageScanEntry;
+using gtstore::StorageScanResponse;
 
 #define MAX_KEY_BYTE_PER_REQUEST 20
 #define MAX_VALUE_BYTE_PER_REQUEST 1000
 
+// Values with fewer bytes than this are sent raw, unless a client sets its own threshold
+#define COMPRESS_MIN_BYTES 64
+// Largest dictionary train_dictionary makes. deflate looks back at most 32 KB, and indexes
+// the whole dictionary before each value it compresses against it.
+#define DICTIONARY_MAX_BYTES 16384
+// Dictionaries are stored as values under this prefix and their id in hex, so every client
+// can read the values compressed against them. Scans leave these keys out.
+#define DICTIONARY_KEY_PREFIX "~gtstore/dictionary/"
+
+// Clients ping idle connections this often to notice dead peers; servers accept pings at up to
+// twice that rate
+#define CHANNEL_KEEPALIVE_MS 30000
+
 using namespace std;
 
 typedef vector<string> val_t;
 
+// How many of a key's replicas must answer a GET, or prepare a PUT, before it returns: one,
+// a majority, or all. A GET sees the latest PUT when their levels overlap, e.g. both QUORUM,
+// or ONE for GETs with ALL for PUTs (the defaults).
+enum class GTStoreConsistency {
+		ONE,
+		QUORUM,
+		ALL
+};
+
+// How a client compresses the values it writes: not at all, with deflate, or with deflate
+// against a dictionary trained on sample values, which also shrinks small values
+enum class GTStoreCompression {
+		NONE,
+		DEFLATE,
+		DICTIONARY
+};
+
+struct GTStoreClientOptions {
+		// Send GETs at ONE to the less loaded of two random replicas, by outstanding requests and
+		// moving average latency; otherwise to the first replica in ring order
+		bool balance_reads = true;
+		// Also send a GET at ONE to a second replica once it has waited the client's recent p95
+		bool hedge_reads = false;
+		// Bytes of values read at ONE to cache for as long as the storage node's read lease
+		// lasts; 0 caches nothing
+		size_t cache_bytes = 0;
+		// Share of get, put, multi_get and multi_put calls to trace, from 0 to 1, across this
+		// client and the servers they reach; see trace.hpp
+		double trace_sample = 0;
+		// Compress values the client writes of at least compress_min_bytes, once before they
+		// are sent to the replicas, which store them compressed; see compression.hpp. Values
+		// are decompressed on reading whatever this is set to.
+		GTStoreCompression compression = GTStoreCompression::NONE;
+		size_t compress_min_bytes = COMPRESS_MIN_BYTES;
+		// For DICTIONARY: a dictionary from GTStoreClient::train_dictionary, written to the
+		// store at init so other clients can read values compressed against it
+		string dictionary;
+};
+
 // Forward declaration of implementation class
 class GTStoreClientImpl;
 
@@ -59,20 +151,106 @@ class GTStoreClient {
 		public:
 				GTStoreClient();
 				~GTStoreClient();
-				void init(int id, bool verbose = false);
+				void init(int id, bool verbose = false, const GTStoreClientOptions& options = GTStoreClientOptions());
 				void finalize();
-				val_t get(string key);
-				vector<string> put(string key, val_t value);
+				val_t get(string key, GTStoreConsistency consistency = GTStoreConsistency::ONE);
+				vector<string> put(string key, val_t value, GTStoreConsistency consistency = GTStoreConsistency::ALL);
+				vector<val_t> multi_get(vector<string> keys);
+				// Writes every entry in one transaction. Under chain replication each entry is
+				// a chain write of its own instead, all sent at once, so the batch is not atomic.
+				vector<vector<string>> multi_put(vector<pair<string, val_t>> entries);
+				// get and put without waiting for the reply. Futures are fulfilled on a thread
+				// of the client, so many requests can be in flight at once; the client itself is
+				// still called from one thread at a time. finalize waits for requests in flight.
+				std::future<val_t> get_async(string key, GTStoreConsistency consistency = GTStoreConsistency::ONE);
+				std::future<vector<string>> put_async(string key, val_t value, GTStoreConsistency consistency = GTStoreConsistency::ALL);
+				// Keys from start_key up to end_key (excluded; empty for no bound) in key order, at
+				// most limit of them or all if 0, each with the newest copy among the nodes asked.
+				// Under range placement only nodes owning the range are asked, otherwise every node.
+				vector<pair<string, val_t>> scan(string start_key, string end_key, size_t limit = 0);
+				// scan, handing each key to fn as soon as the merged streams reach it, until fn
+				// returns false. Returns the keys handed over.
+				size_t scan(string start_key, string end_key, size_t limit, const std::function<bool(const string&, const val_t&)>& fn);
+				// A dictionary of at most max_bytes for GTStoreCompression::DICTIONARY, trained on
+				// values like the ones to be written
+				static string train_dictionary(const vector<string>& samples, size_t max_bytes = DICTIONARY_MAX_BYTES);
+};
+
+// How the manager maps keys to storage nodes, see PlacementStrategy
+enum class GTStorePlacement {
+		RING,
+		BOUNDED,
+		JUMP,
+		RENDEZVOUS,
+		RANGE
+};
+
+// How a PUT reaches a key's replicas: the client runs two-phase commit on all of them, or
+// sends the write to the head of the replicas in ring order, which passes it down the chain
+enum class GTStoreReplication {
+		TWO_PHASE,
+		CHAIN
+};
+
+struct GTStoreManagerOptions {
+		GTStorePlacement placement = GTStorePlacement::RING;
+		GTStoreReplication replication = GTStoreReplication::TWO_PHASE;
+		// Points per node on the ring, for RING and BOUNDED
+		int virtual_nodes = 1000;
+		// Keys that start a new range, for RANGE
+		vector<string> split_keys;
+		// Serve Prometheus text on http://host:metrics_port/metrics; 0 serves none
+		int metrics_port = 0;
 };
 
 class GTStoreManager {
 		public:
-				void init(int num_nodes, int num_replicas);
+				void init(int num_nodes, int num_replicas, const GTStoreManagerOptions& options = GTStoreManagerOptions());
+};
+
+// When a storage node's committed writes reach disk, see WriteAheadLog
+enum class GTStoreDurability {
+		NONE,
+		BATCHED,
+		PER_WRITE
+};
+
+// Where a storage node keeps committed values, see StorageEngine
+enum class GTStoreEngine {
+		MEMORY,
+		LOG
+};
+
+struct GTStoreStorageOptions {
+		// Serve on gRPC's async API instead of the sync thread pool
+		bool async = false;
+		int cq_threads = 4;
+
+		// Log commits and snapshot the store under data_dir; empty keeps data in memory only
+		string data_dir;
+		GTStoreDurability durability = GTStoreDurability::BATCHED;
+		// Snapshot once this many records were logged since the last one
+		uint64_t snapshot_records = 1000000;
+
+		// Keys per second streamed to other nodes when ranges change owners
+		int stream_rate = 20000;
+
+		// How long clients may cache a value read from this node; commits of a key wait out
+		// its leases. Zero grants none.
+		int lease_ms = 20;
+
+		GTStoreEngine engine = GTStoreEngine::MEMORY;
+		// Scratch directory for the segment files of the log engine; empty puts them under
+		// data_dir, or in the working directory without one. Not /tmp, which is often in RAM.
+		string engine_dir;
+
+		// Serve Prometheus text on http://host:(metrics_port + node_id)/metrics; 0 serves none
+		int metrics_port = 0;
 };
 
 class GTStoreStorage {
 		public:
-				void init(int node_id);
+				void init(int node_id, const GTStoreStorageOptions& options = GTStoreStorageOptions());
 };
 
 #endif
@@ -0,0 +1,102 @@
+#ifndef GTSTORE_HASH
+#define GTSTORE_HASH
+
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+
+// Key hashing shared by the manager, clients and storage nodes. Unlike std::hash, whose
+// result is up to the standard library, this gives the same hash on every build and every
+// little-endian machine, so all of them agree on placement.
+//
+// It follows the structure of wyhash: input is read 8 or 16 bytes at a time and folded with
+// 64x64->128 bit multiplies, which spreads short keys evenly at a few ns per key.
+
+#define HASH_P0 0xa0761d6478bd642full
+#define HASH_P1 0xe7037ed1a0b428dbull
+#define HASH_P2 0x8ebc6af09c88c6e3ull
+#define HASH_P3 0x589965cc75374cc3ull
+
+// Multiply and fold the two halves of the 128-bit product
+inline uint64_t hash_mix(uint64_t a, uint64_t b) {
+    __uint128_t product = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+// Hash of a 64-bit value, such as a key hash to be rehashed with a seed
+inline uint64_t hash_u64(uint64_t value, uint64_t seed = 0) {
+    return hash_mix(value ^ HASH_P0, seed ^ HASH_P1);
+}
+
+inline uint64_t hash_read_u64(const char* p) {
+    uint64_t value;
+    std::memcpy(&value, p, 8);
+    return value;
+}
+
+inline uint64_t hash_read_u32(const char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, 4);
+    return value;
+}
+
+inline uint64_t stable_hash(std::string_view data, uint64_t seed = 0) {
+    const char* p = data.data();
+    size_t length = data.size();
+    uint64_t a = 0;
+    uint64_t b = 0;
+
+    seed ^= hash_mix(seed ^ HASH_P0, HASH_P1);
+
+    if (length <= 16) {
+        if (length >= 4) {
+            size_t middle = (length >> 3) << 2;
+            a = (hash_read_u32(p) << 32) | hash_read_u32(p + middle);
+            b = (hash_read_u32(p + length - 4) << 32) | hash_read_u32(p + length - 4 - middle);
+        }
+        else if (length > 0) {
+            a = (static_cast<uint64_t>(static_cast<uint8_t>(p[0])) << 16)
+                | (static_cast<uint64_t>(static_cast<uint8_t>(p[length >> 1])) << 8)
+                | static_cast<uint8_t>(p[length - 1]);
+        }
+    }
+    else {
+        size_t remaining = length;
+        if (remaining > 48) {
+            uint64_t seed1 = seed;
+            uint64_t seed2 = seed;
+            do {
+                seed = hash_mix(hash_read_u64(p) ^ HASH_P1, hash_read_u64(p + 8) ^ seed);
+                seed1 = hash_mix(hash_read_u64(p + 16) ^ HASH_P2, hash_read_u64(p + 24) ^ seed1);
+                seed2 = hash_mix(hash_read_u64(p + 32) ^ HASH_P3, hash_read_u64(p + 40) ^ seed2);
+                p += 48;
+                remaining -= 48;
+            }
+            while (remaining > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (remaining > 16) {
+            seed = hash_mix(hash_read_u64(p) ^ HASH_P1, hash_read_u64(p + 8) ^ seed);
+            p += 16;
+            remaining -= 16;
+        }
+        a = hash_read_u64(p + remaining - 16);
+        b = hash_read_u64(p + remaining - 8);
+    }
+
+    __uint128_t product = static_cast<__uint128_t>(a ^ HASH_P1) * (b ^ seed);
+    return hash_mix(static_cast<uint64_t>(product) ^ HASH_P0 ^ length, static_cast<uint64_t>(product >> 64) ^ HASH_P1);
+}
+
+// Where a key falls in key order, for range placement, in place of its hash: its first 8 bytes
+// as a big-endian number, zero-padded. A key that sorts after another never gets a lower
+// position, so each range of positions holds a contiguous run of keys.
+inline uint64_t key_position(std::string_view key) {
+    uint64_t position = 0;
+    for (size_t i = 0; i < 8; i++) {
+        position = (position << 8) | (i < key.size() ? static_cast<uint8_t>(key[i]) : 0);
+    }
+    return position;
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef GTSTORE_HASH_RING
+#define GTSTORE_HASH_RING
+
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include "hash.hpp"
+#include "placement.hpp"
+
+// Storage nodes and where keys go among them, as published by the manager and cached by
+// clients. Which nodes a key prefers is up to the placement strategy; this skips the nodes
+// that are down and picks stand-ins for them. A ring is not changed once shared;
+// membership changes build a new one.
+class HashRing {
+    public:
+        uint64_t epoch = 0;
+        int num_replicas = 0;
+        std::vector<std::string> nodes;
+        // down[n] is set while nodes[n] is reported failed
+        std::vector<bool> down;
+        std::shared_ptr<const PlacementStrategy> placement;
+
+        bool empty() const {
+            return nodes.empty();
+        }
+
+        // Add storage nodes, up, to the placement strategy
+        void add_nodes(const std::vector<std::string>& new_nodes) {
+            placement = placement->add_nodes(new_nodes);
+            for (const auto& node : new_nodes) {
+                nodes.push_back(node);
+                down.push_back(false);
+            }
+        }
+
+        // The first node in key's preference order that is up, the first of its put_replicas
+        std::string get_storage_node(const std::string& key) const {
+            if (empty()) {
+                return "";
+            }
+
+            std::vector<int> order;
+            uint64_t key_hash = placement->position(key);
+            placement->preference(key_hash, 1, order);
+
+            if (!is_down(order[0])) {
+                return nodes[order[0]];
+            }
+
+            placement->preference(key_hash, num_down() + 1, order);
+            for (int node : order) {
+                if (!is_down(node)) {
+                    return nodes[node];
+                }
+            }
+            return "";
+        }
+
+        std::vector<std::string> put_storage_nodes(const std::string& key) const {
+            std::set<std::string> storage_nodes;
+
+            for (const auto& replica : put_replicas(key)) {
+                storage_nodes.insert(replica.storage_node);
+            }
+
+            return std::vector<std::string>(storage_nodes.begin(), storage_nodes.end());
+        }
+
+        // A node holding a copy of a key. hint_for names the down node of the key's
+        // preference list (its first num_replicas nodes) this one stands in for.
+        struct Replica {
+            std::string storage_node;
+            std::string hint_for;
+        };
+
+        // The first num_replicas nodes in key's preference order that are up, so the first
+        // one serves GETs. Down nodes of the preference list are matched, in order, with the
+        // nodes past it that take their place.
+        std::vector<Replica> put_replicas(const std::string& key) const {
+            return put_replicas_at(placement->position(key));
+        }
+
+        // put_replicas for a key with the given hash, or position under range placement
+        std::vector<Replica> put_replicas_at(uint64_t key_hash) const {
+            std::vector<Replica> replicas;
+            std::vector<int> order;
+            std::vector<int> skipped;
+
+            if (empty()) {
+                return replicas;
+            }
+
+            placement->preference(key_hash, num_replicas, order);
+            if (std::any_of(order.begin(), order.end(), [this](int node) { return is_down(node); })) {
+                placement->preference(key_hash, num_replicas + num_down(), order);
+            }
+
+            for (size_t i = 0; i < order.size() && replicas.size() < (size_t) num_replicas; i++) {
+                int node = order[i];
+
+                if (is_down(node)) {
+                    if (i < (size_t) num_replicas) {
+                        skipped.push_back(node);
+                    }
+                    continue;
+                }
+
+                Replica replica{nodes[node], ""};
+                if (i >= (size_t) num_replicas) {
+                    replica.hint_for = nodes[skipped[replicas.size() + skipped.size() - num_replicas]];
+                }
+                replicas.push_back(replica);
+            }
+
+            return replicas;
+        }
+
+        bool is_down(int node) const {
+            return node < (int) down.size() && down[node];
+        }
+
+    private:
+        size_t num_down() const {
+            return std::count(down.begin(), down.end(), true);
+        }
+};
+
+#endif
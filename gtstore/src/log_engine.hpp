@@ -0,0 +1,357 @@
+#ifndef GTSTORE_LOG_ENGINE
+#define GTSTORE_LOG_ENGINE
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <shared_mutex>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "storage_engine.hpp"
+
+// Size of each segment file; a record larger than this gets a segment of its own
+#define LOG_SEGMENT_BYTES (64 << 20)
+// Key length, value length, version
+#define RECORD_HEADER_BYTES 16
+
+// Values in append-only segment files mapped into memory; only an index of key hash to
+// record location stays on the heap, along with the sorted keys scans walk, so a node can
+// hold far more data than RAM and serves GETs of the working set from the page cache.
+// Those sorted keys are the heap's largest share: every key, in full, in the OrderedIndex
+// skiplist, at about 60 bytes per key plus the key itself past 15 bytes. Memory therefore
+// still grows with the number of keys, only no longer with the size of their values.
+//
+// Each record is a u32 key length, a u32 value length, the u64 version, the key, then the
+// value (u32 element count, u32 length + bytes per element, and the u32 encoding). The key is kept in the record, so
+// keys whose hashes collide share an index bucket and are told apart by reading it back.
+//
+// A put appends to the active segment and repoints the index, leaving the old record as
+// garbage counted against its segment. A background thread compacts sealed segments that
+// are at least half garbage by moving their live records to the active segment, then drops
+// them; readers hold a reference to the segment they read, so it is unmapped after them.
+//
+// The files are scratch space and are cleared when the engine opens. Surviving a restart is
+// the write-ahead log's job.
+class LogEngine final : public StorageEngine {
+    public:
+        LogEngine(const std::string& dir) : dir(dir) {
+            std::filesystem::create_directories(dir);
+            for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+                if (entry.path().filename().string().rfind("segment-", 0) == 0) {
+                    std::filesystem::remove(entry.path());
+                }
+            }
+
+            std::unique_lock<std::mutex> lock(append_mutex);
+            roll(LOG_SEGMENT_BYTES);
+            compactor = std::thread(&LogEngine::run_compaction, this);
+        }
+
+        ~LogEngine() {
+            {
+                std::unique_lock<std::mutex> lock(stop_mutex);
+                stopping = true;
+            }
+            stop_cv.notify_all();
+            compactor.join();
+        }
+
+        bool get(const std::string& key, Value& value) override {
+            uint64_t hash = hasher(key);
+            IndexShard& shard = shard_for(hash);
+            auto lock = lock_shared_metered(shard.mutex, stripe_locks);
+
+            auto range = shard.index.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                std::shared_ptr<Segment> segment = segment_at(it->second.segment);
+                if (key_at(*segment, it->second) == key) {
+                    value = value_at(*segment, it->second);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void put(const std::string& key, Value value) override {
+            std::string record;
+            encode(record, key, value);
+            Location location = append(record);
+
+            uint64_t hash = hasher(key);
+            IndexShard& shard = shard_for(hash);
+            {
+                auto lock = lock_metered(shard.mutex, stripe_locks);
+
+                auto range = shard.index.equal_range(hash);
+                for (auto it = range.first; it != range.second; ++it) {
+                    std::shared_ptr<Segment> segment = segment_at(it->second.segment);
+                    if (key_at(*segment, it->second) == key) {
+                        segment->garbage += it->second.length;
+                        it->second = location;
+                        return;
+                    }
+                }
+                shard.index.emplace(hash, location);
+            }
+            ordered_keys.insert(key);
+        }
+
+        void for_each(const std::function<void(const std::string&, const Value&)>& fn) override {
+            std::vector<std::pair<std::shared_ptr<Segment>, Location>> records;
+
+            for (IndexShard& shard : shards) {
+                records.clear();
+                {
+                    auto lock = lock_shared_metered(shard.mutex, stripe_locks);
+                    for (const auto& [hash, location] : shard.index) {
+                        records.emplace_back(segment_at(location.segment), location);
+                    }
+                }
+                for (const auto& [segment, location] : records) {
+                    fn(std::string(key_at(*segment, location)), value_at(*segment, location));
+                }
+            }
+        }
+
+        // Bytes are the live records in the segments, headers included
+        void usage(uint64_t& keys, uint64_t& bytes) override {
+            keys = 0;
+            for (IndexShard& shard : shards) {
+                std::shared_lock<std::shared_mutex> lock(shard.mutex);
+                keys += shard.index.size();
+            }
+
+            bytes = 0;
+            std::unique_lock<std::mutex> append_lock(append_mutex);
+            std::shared_lock<std::shared_mutex> lock(segments_mutex);
+            for (const auto& [id, segment] : segments) {
+                bytes += segment->used - std::min<uint64_t>(segment->used, segment->garbage);
+            }
+        }
+
+    private:
+        struct Location {
+            uint32_t segment;
+            uint32_t offset;
+            uint32_t length;
+        };
+
+        struct Segment {
+            uint32_t id;
+            std::string path;
+            int fd = -1;
+            char* data = nullptr;
+            size_t capacity = 0;
+            // Bytes appended so far; final once sealed
+            size_t used = 0;
+            bool sealed = false;
+            std::atomic<uint64_t> garbage{0};
+
+            ~Segment() {
+                if (data) {
+                    ::munmap(data, capacity);
+                }
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                ::unlink(path.c_str());
+            }
+        };
+
+        struct IndexShard {
+            std::unordered_multimap<uint64_t, Location> index;
+            std::shared_mutex mutex;
+        };
+
+        std::string dir;
+        IndexShard shards[NUM_ENGINE_SHARDS];
+        std::hash<std::string_view> hasher;
+
+        // Lock order: an index shard, then append_mutex, then segments_mutex
+        std::mutex append_mutex;
+        std::shared_ptr<Segment> active;
+        uint32_t next_segment = 0;
+
+        std::shared_mutex segments_mutex;
+        std::map<uint32_t, std::shared_ptr<Segment>> segments;
+
+        std::thread compactor;
+        std::mutex stop_mutex;
+        std::condition_variable stop_cv;
+        bool stopping = false;
+
+        IndexShard& shard_for(uint64_t hash) {
+            return shards[hash & (NUM_ENGINE_SHARDS - 1)];
+        }
+
+        std::shared_ptr<Segment> segment_at(uint32_t id) {
+            std::shared_lock<std::shared_mutex> lock(segments_mutex);
+            return segments.at(id);
+        }
+
+        // Seal the active segment and start one that fits at least min_bytes. Called with
+        // append_mutex held.
+        void roll(size_t min_bytes) {
+            auto segment = std::make_shared<Segment>();
+            segment->id = next_segment++;
+            segment->capacity = std::max<size_t>(min_bytes, LOG_SEGMENT_BYTES);
+
+            char name[32];
+            std::snprintf(name, sizeof(name), "/segment-%010u.dat", segment->id);
+            segment->path = dir + name;
+
+            segment->fd = ::open(segment->path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (segment->fd < 0 || ::ftruncate(segment->fd, segment->capacity) != 0) {
+                throw std::runtime_error("cannot create segment in " + dir);
+            }
+            void* data = ::mmap(nullptr, segment->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+            if (data == MAP_FAILED) {
+                throw std::runtime_error("cannot map segment in " + dir);
+            }
+            segment->data = static_cast<char*>(data);
+
+            if (active) {
+                active->sealed = true;
+            }
+            active = segment;
+
+            std::unique_lock<std::shared_mutex> lock(segments_mutex);
+            segments[segment->id] = segment;
+        }
+
+        // Copy an encoded record into the active segment
+        Location append(const std::string& record) {
+            std::unique_lock<std::mutex> lock(append_mutex);
+            if (active->used + record.size() > active->capacity) {
+                roll(record.size());
+            }
+
+            Location location{active->id, static_cast<uint32_t>(active->used), static_cast<uint32_t>(record.size())};
+            std::memcpy(active->data + active->used, record.data(), record.size());
+            active->used += record.size();
+            return location;
+        }
+
+        static void encode(std::string& out, const std::string& key, const Value& value) {
+            uint32_t value_length = 8;
+            for (size_t i = 0; i < value.size(); i++) {
+                value_length += 4 + value[i].size();
+            }
+
+            uint64_t version = value.version();
+            out.reserve(RECORD_HEADER_BYTES + key.size() + value_length);
+            append_u32(out, key.size());
+            append_u32(out, value_length);
+            out.append(reinterpret_cast<const char*>(&version), 8);
+            out.append(key);
+            append_u32(out, value.size());
+            for (size_t i = 0; i < value.size(); i++) {
+                append_u32(out, value[i].size());
+                out.append(value[i]);
+            }
+            append_u32(out, value.encoding());
+        }
+
+        static std::string_view key_at(const Segment& segment, const Location& location) {
+            const char* record = segment.data + location.offset;
+            return std::string_view(record + RECORD_HEADER_BYTES, read_u32(record));
+        }
+
+        static Value value_at(const Segment& segment, const Location& location) {
+            const char* record = segment.data + location.offset;
+            const char* pos = record + RECORD_HEADER_BYTES + read_u32(record);
+            uint64_t version;
+            std::memcpy(&version, record + 8, 8);
+
+            uint32_t count = read_u32(pos);
+            pos += 4;
+            std::vector<std::string_view> elements;
+            elements.reserve(count);
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t length = read_u32(pos);
+                elements.emplace_back(pos + 4, length);
+                pos += 4 + length;
+            }
+            return Value::copy_of(elements, version, read_u32(pos));
+        }
+
+        static void append_u32(std::string& out, uint32_t n) {
+            out.append(reinterpret_cast<const char*>(&n), 4);
+        }
+
+        static uint32_t read_u32(const char* data) {
+            uint32_t n;
+            std::memcpy(&n, data, 4);
+            return n;
+        }
+
+        void run_compaction() {
+            std::unique_lock<std::mutex> lock(stop_mutex);
+            while (!stop_cv.wait_for(lock, std::chrono::seconds(1), [this] { return stopping; })) {
+                lock.unlock();
+                for (const auto& segment : compaction_candidates()) {
+                    compact(*segment);
+                }
+                lock.lock();
+            }
+        }
+
+        std::vector<std::shared_ptr<Segment>> compaction_candidates() {
+            std::vector<std::shared_ptr<Segment>> candidates;
+            std::unique_lock<std::mutex> append_lock(append_mutex);
+            std::shared_lock<std::shared_mutex> lock(segments_mutex);
+
+            for (const auto& [id, segment] : segments) {
+                if (segment->sealed && segment->garbage * 2 >= segment->used) {
+                    candidates.push_back(segment);
+                }
+            }
+            return candidates;
+        }
+
+        // Move the records of a sealed segment that the index still points at to the active
+        // segment, then forget it
+        void compact(Segment& segment) {
+            size_t offset = 0;
+            while (offset < segment.used) {
+                const char* record = segment.data + offset;
+                uint32_t length = RECORD_HEADER_BYTES + read_u32(record) + read_u32(record + 4);
+                std::string_view key(record + RECORD_HEADER_BYTES, read_u32(record));
+
+                uint64_t hash = hasher(key);
+                IndexShard& shard = shard_for(hash);
+                {
+                    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+                    auto range = shard.index.equal_range(hash);
+                    for (auto it = range.first; it != range.second; ++it) {
+                        if (it->second.segment == segment.id && it->second.offset == offset) {
+                            it->second = append(std::string(record, length));
+                            break;
+                        }
+                    }
+                }
+                offset += length;
+            }
+
+            std::unique_lock<std::shared_mutex> lock(segments_mutex);
+            segments.erase(segment.id);
+        }
+};
+
+#endif
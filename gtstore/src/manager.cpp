@@ -2,25 +2,135 @@
 #include <string>
 #include <unordered_map>
 #include <set>
-#include <shared_mutex>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <getopt.h>
 #include "gtstore.hpp"
+#include "hash_ring.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+// How often the manager asks storage nodes marked down whether they answer again
+#define HEALTH_PROBE_MS 1000
+// How long a probed node has to answer
+#define HEALTH_PROBE_TIMEOUT_MS 500
 
 class GTStoreManagerImpl final : public GTStoreManagerService::Service {
     public:
-		GTStoreManagerImpl(int num_nodes, int num_replicas, int num_virtual_replicas = 1000) {
+		GTStoreManagerImpl(int num_nodes, int num_replicas, const GTStoreManagerOptions& options) {
 			this->num_nodes = num_nodes;
 			this->num_replicas = num_replicas;
-			this->num_virtual_replicas = num_virtual_replicas;
+			this->placement = options.placement;
+			this->replication = options.replication;
 
 			for (int i = 1; i < num_nodes; i++) {
 				std::string server_address = "0.0.0.0:" + std::to_string(50000 + i);
 				storage_node_status[server_address] = false;
 			}
+
+			auto empty_ring = std::make_shared<HashRing>();
+			empty_ring->epoch = 1;
+			empty_ring->num_replicas = num_replicas;
+			switch (placement) {
+				case GTStorePlacement::RING:
+					empty_ring->placement = std::make_shared<RingPlacement>(num_replicas, options.virtual_nodes);
+					break;
+				case GTStorePlacement::BOUNDED:
+					empty_ring->placement = std::make_shared<RingPlacement>(num_replicas, options.virtual_nodes, true);
+					break;
+				case GTStorePlacement::JUMP:
+					empty_ring->placement = std::make_shared<JumpPlacement>();
+					break;
+				case GTStorePlacement::RENDEZVOUS:
+					empty_ring->placement = std::make_shared<RendezvousPlacement>();
+					break;
+				case GTStorePlacement::RANGE: {
+					auto range_placement = std::make_shared<RangePlacement>(num_replicas, options.split_keys);
+					// Each node should own a run of ranges for every replica it holds
+					size_t wanted = storage_node_status.size() * num_replicas;
+					if (range_placement->num_ranges() < wanted) {
+						std::cerr << "Warning: " << range_placement->num_ranges() << " key ranges for " << storage_node_status.size()
+							<< " storage nodes with " << num_replicas << " replicas; with fewer than " << wanted
+							<< " ranges, nodes own uneven shares of the keys, and with fewer ranges than nodes some own none" << std::endl;
+					}
+					empty_ring->placement = range_placement;
+					break;
+				}
+			}
+			ring = empty_ring;
+
+			register_metrics();
+		}
+
+		// Bring nodes marked down back once they answer again. Clients report a node after a
+		// single failed call, so a node that was only slow for a moment would otherwise stay
+		// down, with writes for it piling up as hints, until it restarts. Never returns.
+		void run_health_probe() {
+			std::map<string, std::unique_ptr<GTStoreStorageService::Stub>> stubs;
+			grpc::ChannelArguments args;
+			// Reconnect at the probe's pace rather than gRPC's backoff of up to two minutes
+			args.SetInt(GRPC_ARG_MAX_RECONNECT_BACKOFF_MS, HEALTH_PROBE_MS);
+
+			while (true) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(HEALTH_PROBE_MS));
+
+				std::shared_ptr<const HashRing> snapshot = current_ring();
+				for (size_t i = 0; i < snapshot->nodes.size(); i++) {
+					if (!snapshot->down[i]) {
+						continue;
+					}
+
+					const std::string& node = snapshot->nodes[i];
+					auto& stub = stubs[node];
+					if (!stub) {
+						stub = GTStoreStorageService::NewStub(grpc::CreateCustomChannel(node, grpc::InsecureChannelCredentials(), args));
+					}
+
+					StorageStatsRequest request;
+					StorageStatsResponse response;
+					ClientContext context;
+					context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(HEALTH_PROBE_TIMEOUT_MS));
+					if (stub->stats(&context, request, &response).ok()) {
+						std::cout << "Storage node " << node << " answers again" << std::endl;
+						set_status(node, true);
+					}
+				}
+			}
+		}
+
+		// Plan and start the transfers of each ring change in turn, from the published rings
+		// and off membership_mutex, as a plan under jump or rendezvous placement evaluates
+		// every slice of hash space. Never returns.
+		void run_planning() {
+			while (true) {
+				std::shared_ptr<const HashRing> old_ring;
+				std::shared_ptr<const HashRing> new_ring;
+				{
+					std::unique_lock<std::mutex> lock(planning_mutex);
+					planning_cv.wait(lock, [this] { return !ring_changes.empty(); });
+					std::tie(old_ring, new_ring) = ring_changes.front();
+					ring_changes.pop_front();
+				}
+				start_transfers(plan_transfers(*old_ring, *new_ring));
+			}
+		}
+
+		// Serve the manager's metrics as Prometheus text on port
+		bool serve_metrics(int port) {
+			return metrics_server.start(port, metrics);
 		}
 
 		Status init(ServerContext* context, const ManagerInitRequest* request, ManagerInitResponse* response) {
+			RpcScope scope(this, RPC_INIT, context);
 			response->set_success(true);
-			std::shared_lock<std::shared_mutex> lock(storage_mutex);
+			auto lock = lock_metered(membership_mutex, membership_locks);
 			for (auto& [node_address, status] : storage_node_status) {
 				response->add_storage_nodes(node_address);
 			}
@@ -28,22 +138,14 @@ class GTStoreManagerImpl final : public GTStoreManagerService::Service {
 		}
 
 		Status update_status(ServerContext* context, const ManagerUpdateStatusRequest* request, ManagerUpdateStatusResponse* response) {
+			RpcScope scope(this, RPC_UPDATE_STATUS, context);
 			response->set_success(true);
-			std::string node_address = request->storage_node();
-			std::unique_lock<std::shared_mutex> lock(storage_mutex);
-			storage_node_status[node_address] = true;
-
-			for (int j = 0; j < num_virtual_replicas; j++) {
-				std::string virtual_node_address = node_address + "_" + std::to_string(j);
-				size_t address_hash = hasher(virtual_node_address);
-				address_hashes.insert(address_hash);
-				hash_to_address[address_hash] = node_address;
-			}
-
+			set_status(request->storage_node(), true);
 			return Status::OK;
 		}
 
 		Status get(ServerContext* context, const ManagerGetRequest* request, ManagerGetResponse* response) {
+			RpcScope scope(this, RPC_GET, context);
 			std::string key = request->key();
 			std::string storage_node = retrieve_get_storage_node(key);
 			if (storage_node == "") {
@@ -56,6 +158,7 @@ class GTStoreManagerImpl final : public GTStoreManagerService::Service {
 		}
 
 		Status put(ServerContext* context, const ManagerPutRequest* request, ManagerPutResponse* response) {
+			RpcScope scope(this, RPC_PUT, context);
 			std::string key = request->key();
 			std::vector<string> storage_nodes = retrieve_put_storage_nodes(key);
 			if (storage_nodes.size() == 0) {
@@ -70,92 +173,387 @@ class GTStoreManagerImpl final : public GTStoreManagerService::Service {
 		}
 
 		Status report_failure(ServerContext* context, const ManagerReportFailureRequest* request, ManagerReportFailureResponse* response) {
+			RpcScope scope(this, RPC_REPORT_FAILURE, context);
 			response->set_success(true);
-			std::string node_address = request->storage_node();
-			std::unique_lock<std::shared_mutex> lock(storage_mutex);
-			storage_node_status[node_address] = false;
+			set_status(request->storage_node(), false);
+			return Status::OK;
+		}
+
+		Status get_ring(ServerContext* context, const ManagerGetRingRequest* request, ManagerGetRingResponse* response) {
+			RpcScope scope(this, RPC_GET_RING, context);
+			std::shared_ptr<const HashRing> snapshot = current_ring();
+			response->set_success(true);
+			response->set_epoch(snapshot->epoch);
+			response->set_num_replicas(num_replicas);
+
+			if (request->known_epoch() == snapshot->epoch) {
+				response->set_changed(false);
+				return Status::OK;
+			}
+
+			response->set_changed(true);
+			response->set_placement(static_cast<int>(placement));
+			response->set_replication(static_cast<int>(replication));
+			for (size_t i = 0; i < snapshot->nodes.size(); i++) {
+				response->add_storage_nodes(snapshot->nodes[i]);
+				response->add_down(snapshot->down[i]);
+			}
 
-			for (int j = 0; j < num_virtual_replicas; j++) {
-				std::string virtual_node_address = node_address + "_" + std::to_string(j);
-				size_t address_hash = hasher(virtual_node_address);
-				address_hashes.erase(address_hash);
+			if (placement == GTStorePlacement::RING || placement == GTStorePlacement::BOUNDED || placement == GTStorePlacement::RANGE) {
+				const auto& points = placement == GTStorePlacement::RANGE
+					? static_cast<const RangePlacement&>(*snapshot->placement).points()
+					: static_cast<const RingPlacement&>(*snapshot->placement);
+				response->mutable_hashes()->Reserve(points.hashes.size());
+				response->mutable_owners()->Reserve(points.owners.size());
+				for (size_t i = 0; i < points.hashes.size(); i++) {
+					response->add_hashes(points.hashes[i]);
+					response->add_owners(points.owners[i]);
+				}
 			}
 
 			return Status::OK;
 		}
 
+		Status route(ServerContext* context, const ManagerRouteRequest* request, ManagerRouteResponse* response) {
+			RpcScope scope(this, RPC_ROUTE, context);
+			bool success = true;
+			for (std::string key : request->keys()) {
+				auto* route = response->add_routes();
+				route->set_get_storage_node(retrieve_get_storage_node(key));
+				for (auto& storage_node : retrieve_put_storage_nodes(key)) {
+					route->add_put_storage_nodes(storage_node);
+				}
+				if (route->get_storage_node() == "") {
+					success = false;
+				}
+			}
+			response->set_success(success);
+			return Status::OK;
+		}
+
 		Status finalize(ServerContext* context, const ManagerFinalizeRequest* request, ManagerFinalizeResponse* response) {
+			RpcScope scope(this, RPC_FINALIZE, context);
+			response->set_success(true);
+			return Status::OK;
+		}
+
+		Status transfer_done(ServerContext* context, const ManagerTransferDoneRequest* request, ManagerTransferDoneResponse* response) {
+			RpcScope scope(this, RPC_TRANSFER_DONE, context);
+			finish_transfer(request->transfer_id());
 			response->set_success(true);
 			return Status::OK;
 		}
 
+		Status get_rebalance_status(ServerContext* context, const ManagerRebalanceStatusRequest* request, ManagerRebalanceStatusResponse* response) {
+			RpcScope scope(this, RPC_GET_REBALANCE_STATUS, context);
+			auto lock = lock_metered(rebalance_mutex, rebalance_locks);
+			response->set_pending_transfers(pending_transfers.size());
+			response->set_rebalances(rebalances);
+			response->set_last_rebalance_ms(last_rebalance_ms);
+			return Status::OK;
+		}
+
+		Status stats(ServerContext* context, const ManagerStatsRequest* request, ManagerStatsResponse* response) {
+			metrics.fill(response);
+			return Status::OK;
+		}
+
+		Status trace(ServerContext* context, const ManagerTraceRequest* request, ManagerTraceResponse* response) {
+			Tracer::instance().fill(response);
+			return Status::OK;
+		}
+
 	private:
 		int num_nodes;
 		int num_replicas;
-		int num_virtual_replicas;
+		GTStorePlacement placement;
+		GTStoreReplication replication;
 
+		// Serializes membership changes, each of which publishes a new ring
+		std::mutex membership_mutex;
+		// Every node the manager knows of, whether or not it ever joined the ring
 		std::unordered_map<string, bool> storage_node_status;
-		std::shared_mutex storage_mutex;
 
-		std::hash<std::string> hasher;
-		std::set<size_t> address_hashes;
-		std::unordered_map<size_t, string> hash_to_address;
+		// The current ring, never modified once published. Lookups take a reference to it
+		// with std::atomic_load, so they never wait on a membership change.
+		std::shared_ptr<const HashRing> ring;
 
-		std::string retrieve_get_storage_node(std::string& key) {
-			size_t key_hash = hasher(key);
-			std::shared_lock<std::shared_mutex> lock(storage_mutex);
+		std::shared_ptr<const HashRing> current_ring() {
+			return std::atomic_load(&ring);
+		}
 
-			if (address_hashes.empty()) {
-				return "";
+		// Publish a ring with node_address up or down, and stream the ranges that changed
+		// hands. A node joining for the first time gets its points on the ring; a node that
+		// fails keeps them, marked down: placement skips it, and the nodes standing in for it
+		// hold hints for its writes until it is back.
+		void set_status(const std::string& node_address, bool up) {
+			auto lock = lock_metered(membership_mutex, membership_locks);
+			storage_node_status[node_address] = up;
+
+			std::shared_ptr<const HashRing> old_ring = current_ring();
+			auto new_ring = std::make_shared<HashRing>(*old_ring);
+			new_ring->epoch++;
+
+			auto it = std::find(new_ring->nodes.begin(), new_ring->nodes.end(), node_address);
+			if (it != new_ring->nodes.end()) {
+				new_ring->down[it - new_ring->nodes.begin()] = !up;
+			}
+			else if (up) {
+				new_ring->add_nodes({node_address});
 			}
 
-			auto it = address_hashes.lower_bound(key_hash);
-
-			if (it == address_hashes.end()) {
-				it = address_hashes.begin();
+			std::atomic_store(&ring, std::shared_ptr<const HashRing>(new_ring));
+			if (!up) {
+				expire_transfers(node_address);
 			}
 
-			std::string storage_node = hash_to_address[*it];
-			return storage_node;
+			{
+				std::lock_guard<std::mutex> planning_lock(planning_mutex);
+				ring_changes.emplace_back(old_ring, new_ring);
+			}
+			planning_cv.notify_one();
 		}
 
-		std::vector<string> retrieve_put_storage_nodes(std::string& key) {
-			size_t key_hash = hasher(key);
-			std::set<string> storage_nodes;
-			std::shared_lock<std::shared_mutex> lock(storage_mutex);
-			
-			if (address_hashes.empty()) {
-				return std::vector<string>();
+		// Ring changes whose transfers are still to be planned, oldest first
+		std::mutex planning_mutex;
+		std::condition_variable planning_cv;
+		std::deque<std::pair<std::shared_ptr<const HashRing>, std::shared_ptr<const HashRing>>> ring_changes;
+
+		// Transfers in flight, and how long the current rebalance has been running
+		std::mutex rebalance_mutex;
+		// Source of each transfer in flight, by id
+		std::map<uint64_t, std::string> pending_transfers;
+		uint64_t next_transfer_id = 1;
+		std::chrono::steady_clock::time_point rebalance_started;
+		uint64_t rebalances = 0;
+		uint64_t last_rebalance_ms = 0;
+
+		// Hash ranges, (start, end] as in StorageHashRange, for one source to stream to one target
+		using TransferPlan = std::map<std::pair<string, string>, std::vector<std::pair<uint64_t, uint64_t>>>;
+
+		// Compare placement on two rings, on every interval between consecutive points of
+		// either. A node that now holds an interval it did not before gets it streamed from a
+		// node that held it before and is up on the new ring.
+		TransferPlan plan_transfers(const HashRing& old_ring, const HashRing& new_ring) {
+			TransferPlan plan;
+
+			if (old_ring.empty()) {
+				return plan;
 			}
 
-			auto it_begin = address_hashes.lower_bound(key_hash);
+			std::set<std::string> up;
+			for (size_t i = 0; i < new_ring.nodes.size(); i++) {
+				if (!new_ring.down[i]) {
+					up.insert(new_ring.nodes[i]);
+				}
+			}
 
-			if (it_begin == address_hashes.end()) {
-				it_begin = address_hashes.begin();
+			std::vector<uint64_t> old_points = old_ring.placement->boundaries();
+			std::vector<uint64_t> new_points = new_ring.placement->boundaries();
+			std::vector<uint64_t> points;
+			std::set_union(old_points.begin(), old_points.end(), new_points.begin(), new_points.end(), std::back_inserter(points));
+
+			uint64_t start = points.back();
+			for (uint64_t end : points) {
+				std::vector<HashRing::Replica> old_replicas = old_ring.put_replicas_at(end);
+				std::vector<HashRing::Replica> new_replicas = new_ring.put_replicas_at(end);
+
+				std::string source;
+				for (const auto& replica : old_replicas) {
+					if (up.count(replica.storage_node)) {
+						source = replica.storage_node;
+						break;
+					}
+				}
+
+				for (const auto& replica : new_replicas) {
+					const std::string& target = replica.storage_node;
+					bool held = std::any_of(old_replicas.begin(), old_replicas.end(), [&target](const auto& old_replica) {
+						return old_replica.storage_node == target;
+					});
+					if (source.empty() || held) {
+						continue;
+					}
+
+					auto& ranges = plan[{source, target}];
+					if (!ranges.empty() && ranges.back().second == start) {
+						ranges.back().second = end;
+					}
+					else {
+						ranges.emplace_back(start, end);
+					}
+				}
+				start = end;
 			}
 
-			auto it_end = it_begin;
+			return plan;
+		}
+
+		// Ask each source to stream its ranges, from a thread of its own so membership
+		// changes return at once. Sources report back through transfer_done.
+		void start_transfers(TransferPlan plan) {
+			if (plan.empty()) {
+				return;
+			}
+
+			std::vector<std::pair<std::string, StorageTransferRequest>> requests;
+			{
+				auto lock = lock_metered(rebalance_mutex, rebalance_locks);
+				if (pending_transfers.empty()) {
+					rebalance_started = std::chrono::steady_clock::now();
+				}
+
+				for (auto& [nodes, ranges] : plan) {
+					StorageTransferRequest request;
+					request.set_transfer_id(next_transfer_id++);
+					request.set_target(nodes.second);
+					request.set_key_order(placement == GTStorePlacement::RANGE);
+					for (auto& [start, end] : ranges) {
+						StorageHashRange* range = request.add_ranges();
+						range->set_start(start);
+						range->set_end(end);
+					}
+					pending_transfers.emplace(request.transfer_id(), nodes.first);
+					requests.emplace_back(nodes.first, std::move(request));
+				}
+			}
 
-			do {
-				storage_nodes.insert(hash_to_address[*it_end]);
-				it_end++;
+			std::thread([this, requests] {
+				for (const auto& [source, request] : requests) {
+					auto stub = GTStoreStorageService::NewStub(grpc::CreateChannel(source, grpc::InsecureChannelCredentials()));
+					StorageTransferResponse response;
+					ClientContext context;
+					context.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(1));
+
+					if (!stub->transfer(&context, request, &response).ok()) {
+						std::cerr << "Transfer " << request.transfer_id() << " to " << request.target() << " failed: " << source << " unreachable" << std::endl;
+						finish_transfer(request.transfer_id());
+					}
+				}
+			}).detach();
+		}
 
-				if (it_end == address_hashes.end()) {
-					it_end = address_hashes.begin();
+		// Give up on the transfers a node that went down was streaming, which would otherwise
+		// never report back. The ranges it had not streamed yet reach their new owners only
+		// through read-repair and hinted handoff.
+		void expire_transfers(const std::string& source) {
+			std::vector<uint64_t> expired;
+			{
+				auto lock = lock_metered(rebalance_mutex, rebalance_locks);
+				for (const auto& [transfer_id, transfer_source] : pending_transfers) {
+					if (transfer_source == source) {
+						expired.push_back(transfer_id);
+					}
 				}
 			}
-			while (it_end != it_begin && storage_nodes.size() < num_replicas);
-			
-			return std::vector<string>(storage_nodes.begin(), storage_nodes.end());
+
+			for (uint64_t transfer_id : expired) {
+				std::cerr << "Transfer " << transfer_id << " expired: " << source << " is down" << std::endl;
+				finish_transfer(transfer_id);
+			}
+		}
+
+		void finish_transfer(uint64_t transfer_id) {
+			auto lock = lock_metered(rebalance_mutex, rebalance_locks);
+			if (pending_transfers.erase(transfer_id) && pending_transfers.empty()) {
+				rebalances++;
+				last_rebalance_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - rebalance_started).count();
+				std::cout << "Rebalance finished in " << last_rebalance_ms << " ms" << std::endl;
+			}
+		}
+
+		std::string retrieve_get_storage_node(std::string& key) {
+			return current_ring()->get_storage_node(key);
+		}
+
+		std::vector<string> retrieve_put_storage_nodes(std::string& key) {
+			return current_ring()->put_storage_nodes(key);
+		}
+
+		// RPCs timed in rpc_latency
+		enum ManagerRpc {
+			RPC_INIT,
+			RPC_UPDATE_STATUS,
+			RPC_GET,
+			RPC_PUT,
+			RPC_REPORT_FAILURE,
+			RPC_GET_RING,
+			RPC_ROUTE,
+			RPC_FINALIZE,
+			RPC_TRANSFER_DONE,
+			RPC_GET_REBALANCE_STATUS,
+			NUM_MANAGER_RPCS
+		};
+		static constexpr const char* rpc_names[NUM_MANAGER_RPCS] = {
+			"init", "update_status", "get", "put", "report_failure", "get_ring", "route", "finalize",
+			"transfer_done", "get_rebalance_status"
+		};
+
+		MetricHistogram rpc_latency[NUM_MANAGER_RPCS];
+		LockMetrics membership_locks;
+		LockMetrics rebalance_locks;
+		MetricsRegistry metrics;
+		MetricsHttpServer metrics_server;
+
+		// Times a handler into rpc_latency and traces it under the caller's span
+		class RpcScope {
+			public:
+				RpcScope(GTStoreManagerImpl* impl, ManagerRpc rpc, const ServerContext* context)
+					: timer(impl->rpc_latency[rpc]), span(trace_extract(context), rpc_names[rpc]) {}
+
+			private:
+				MetricTimer timer;
+				TraceSpan span;
+		};
+
+		void register_metrics() {
+			for (int rpc = 0; rpc < NUM_MANAGER_RPCS; rpc++) {
+				metrics.histogram("gtstore_rpc_latency_us", "Time from a request's arrival to its response, by RPC",
+								  {{"rpc", rpc_names[rpc]}}, rpc_latency[rpc]);
+			}
+
+			metrics.lock("membership", membership_locks);
+			metrics.lock("rebalance", rebalance_locks);
+
+			metrics.gauge("gtstore_ring_epoch", "Epoch of the published ring", {}, [this] {
+				return static_cast<double>(current_ring()->epoch);
+			});
+			metrics.gauge("gtstore_nodes_up", "Storage nodes on the ring and up", {}, [this] {
+				std::shared_ptr<const HashRing> snapshot = current_ring();
+				return static_cast<double>(std::count(snapshot->down.begin(), snapshot->down.end(), false));
+			});
+			metrics.gauge("gtstore_pending_transfers", "Range transfers started and not yet finished", {}, [this] {
+				std::lock_guard<std::mutex> lock(rebalance_mutex);
+				return static_cast<double>(pending_transfers.size());
+			});
+			metrics.counter("gtstore_rebalances_total", "Rebalances finished", {}, [this] {
+				std::lock_guard<std::mutex> lock(rebalance_mutex);
+				return static_cast<double>(rebalances);
+			});
 		}
 };
 
-void GTStoreManager::init(int num_nodes, int num_replicas) {
+void GTStoreManager::init(int num_nodes, int num_replicas, const GTStoreManagerOptions& options) {
 	std::string server_address("0.0.0.0:50000");
-	GTStoreManagerImpl service(num_nodes, num_replicas);
+	GTStoreManagerImpl service(num_nodes, num_replicas, options);
+	std::thread(&GTStoreManagerImpl::run_health_probe, &service).detach();
+	std::thread(&GTStoreManagerImpl::run_planning, &service).detach();
+
+	if (options.metrics_port > 0) {
+		if (service.serve_metrics(options.metrics_port)) {
+			std::cout << "Serving metrics on port " << options.metrics_port << std::endl;
+		}
+		else {
+			std::cerr << "Cannot serve metrics on port " << options.metrics_port << std::endl;
+		}
+	}
 
 	ServerBuilder builder;
 	builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+	// Accept the keepalive pings of pooled client connections, with room for pings that
+	// arrive early, which the server would otherwise answer with GOAWAY too_many_pings
+	builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, 1);
+	builder.AddChannelArgument(GRPC_ARG_HTTP2_MIN_RECV_PING_INTERVAL_WITHOUT_DATA_MS, CHANNEL_KEEPALIVE_MS / 2);
 	builder.RegisterService(&service);
 
 	std::unique_ptr<Server> server(builder.BuildAndStart());
@@ -163,16 +561,99 @@ void GTStoreManager::init(int num_nodes, int num_replicas) {
 	server->Wait();
 }
 
+void print_usage(const char* program) {
+	std::cerr << "Usage: " << program << " <num_nodes> <num_replicas> [options]\n"
+		<< "Options:\n"
+		<< "  --placement <strategy> How keys map to nodes: ring, bounded, jump, rendezvous or range (default: ring)\n"
+		<< "  --virtual-nodes <n>    Points per node for ring and bounded placement (default: 1000)\n"
+		<< "  --split-keys <k1,k2..> Keys starting a new range for range placement (default: 64 equal ranges of key prefixes)\n"
+		<< "  --replication <mode>   How PUTs reach replicas: 2pc from the client, or chain through the storage nodes (default: 2pc)\n"
+		<< "  --metrics-port <n>     Serve Prometheus metrics over HTTP on port n (default: none)\n";
+}
+
 int main(int argc, char** argv) {
-	if (argc != 3) {
-		std::cerr << "Usage: " << argv[0] << " <num_nodes> <num_replicas>" << std::endl;
+	static struct option long_options[] = {
+		{"placement", required_argument, 0, 'p'},
+		{"virtual-nodes", required_argument, 0, 'v'},
+		{"split-keys", required_argument, 0, 'k'},
+		{"replication", required_argument, 0, 'r'},
+		{"metrics-port", required_argument, 0, 'm'},
+		{"help", no_argument, 0, 'h'},
+		{0, 0, 0, 0}
+	};
+
+	GTStoreManagerOptions options;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "p:v:k:r:m:h", long_options, nullptr)) != -1) {
+		switch (opt) {
+			case 'p':
+				if (string(optarg) == "ring") {
+					options.placement = GTStorePlacement::RING;
+				}
+				else if (string(optarg) == "bounded") {
+					options.placement = GTStorePlacement::BOUNDED;
+				}
+				else if (string(optarg) == "jump") {
+					options.placement = GTStorePlacement::JUMP;
+				}
+				else if (string(optarg) == "rendezvous") {
+					options.placement = GTStorePlacement::RENDEZVOUS;
+				}
+				else if (string(optarg) == "range") {
+					options.placement = GTStorePlacement::RANGE;
+				}
+				else {
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'v':
+				options.virtual_nodes = std::stoi(optarg);
+				break;
+			case 'k': {
+				std::stringstream keys(optarg);
+				std::string key;
+				while (std::getline(keys, key, ',')) {
+					if (!key.empty()) {
+						options.split_keys.push_back(key);
+					}
+				}
+				break;
+			}
+			case 'r':
+				if (string(optarg) == "2pc") {
+					options.replication = GTStoreReplication::TWO_PHASE;
+				}
+				else if (string(optarg) == "chain") {
+					options.replication = GTStoreReplication::CHAIN;
+				}
+				else {
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'm':
+				options.metrics_port = std::stoi(optarg);
+				break;
+			case 'h':
+				print_usage(argv[0]);
+				return 0;
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind != argc - 2 || options.virtual_nodes < 1 || options.metrics_port < 0) {
+		print_usage(argv[0]);
 		return 1;
 	}
 
-	int num_nodes = std::stoi(argv[1]);
-	int num_replicas = std::stoi(argv[2]);
+	int num_nodes = std::stoi(argv[optind]);
+	int num_replicas = std::stoi(argv[optind + 1]);
 
 	GTStoreManager manager;
-	manager.init(num_nodes, num_replicas);
+	manager.init(num_nodes, num_replicas, options);
     return 0;
 }
@@ -0,0 +1,363 @@
+#ifndef GTSTORE_METRICS
+#define GTSTORE_METRICS
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+// Per-thread slots in each metric; threads past this many share them
+#define METRICS_SLOTS 64
+// Histogram buckets: bucket i holds values up to 2^i, the last one everything above
+#define METRICS_BUCKETS 28
+
+// Slot of the calling thread in every metric
+inline size_t metrics_slot() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t slot = next.fetch_add(1, std::memory_order_relaxed) % METRICS_SLOTS;
+    return slot;
+}
+
+// A count each thread adds to in a cache line of its own, summed when read
+class MetricCounter {
+    public:
+        void add(uint64_t n = 1) {
+            slots[metrics_slot()].value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        uint64_t value() const {
+            uint64_t total = 0;
+            for (const Slot& slot : slots) {
+                total += slot.value.load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+
+    private:
+        struct alignas(64) Slot {
+            std::atomic<uint64_t> value{0};
+        };
+
+        Slot slots[METRICS_SLOTS];
+};
+
+// Counts of values in power-of-two buckets, kept per thread like MetricCounter. Meant for
+// latencies in microseconds, up to about two minutes before the last bucket.
+class MetricHistogram {
+    public:
+        void record(uint64_t value) {
+            Slot& slot = slots[metrics_slot()];
+            slot.buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+            slot.sum.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        // Counts per bucket and the sum of all values, over every thread
+        void snapshot(std::vector<uint64_t>& counts, uint64_t& sum) const {
+            counts.assign(METRICS_BUCKETS, 0);
+            sum = 0;
+            for (const Slot& slot : slots) {
+                for (size_t i = 0; i < METRICS_BUCKETS; i++) {
+                    counts[i] += slot.buckets[i].load(std::memory_order_relaxed);
+                }
+                sum += slot.sum.load(std::memory_order_relaxed);
+            }
+        }
+
+        // Largest value in a bucket; the last bucket has no bound
+        static uint64_t bound(size_t bucket) {
+            return bucket + 1 < METRICS_BUCKETS ? 1ull << bucket : UINT64_MAX;
+        }
+
+        static size_t bucket_of(uint64_t value) {
+            if (value <= 1) {
+                return 0;
+            }
+            return std::min<size_t>(METRICS_BUCKETS - 1, 64 - __builtin_clzll(value - 1));
+        }
+
+    private:
+        struct alignas(64) Slot {
+            std::atomic<uint64_t> buckets[METRICS_BUCKETS] = {};
+            std::atomic<uint64_t> sum{0};
+        };
+
+        Slot slots[METRICS_SLOTS];
+};
+
+// Records the microseconds from construction to destruction
+class MetricTimer {
+    public:
+        MetricTimer(MetricHistogram& histogram) : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+
+        ~MetricTimer() {
+            histogram.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count());
+        }
+
+    private:
+        MetricHistogram& histogram;
+        std::chrono::steady_clock::time_point start;
+};
+
+// How often one lock, or one kind of lock striped over many mutexes, was taken and how long
+// takers waited when it was held
+struct LockMetrics {
+    MetricCounter acquired;
+    MetricCounter contended;
+    MetricCounter wait_ns;
+};
+
+// Take a lock of type Lock on mutex, timing the wait only when it is held by someone else, so
+// an uncontended lock costs one try_lock more than usual
+template <class Lock, class Mutex>
+Lock acquire_metered(Mutex& mutex, LockMetrics& metrics) {
+    Lock lock(mutex, std::try_to_lock);
+    metrics.acquired.add();
+
+    if (!lock.owns_lock()) {
+        auto start = std::chrono::steady_clock::now();
+        lock.lock();
+        metrics.contended.add();
+        metrics.wait_ns.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+    return lock;
+}
+
+template <class Mutex>
+std::unique_lock<Mutex> lock_metered(Mutex& mutex, LockMetrics& metrics) {
+    return acquire_metered<std::unique_lock<Mutex>>(mutex, metrics);
+}
+
+template <class Mutex>
+std::shared_lock<Mutex> lock_shared_metered(Mutex& mutex, LockMetrics& metrics) {
+    return acquire_metered<std::shared_lock<Mutex>>(mutex, metrics);
+}
+
+// Named metrics of a server, read out as Prometheus text or into a stats response. Metrics are
+// registered while the server starts; reading them is safe from any thread after that.
+class MetricsRegistry {
+    public:
+        using Labels = std::vector<std::pair<std::string, std::string>>;
+
+        void counter(const std::string& name, const std::string& help, Labels labels, std::function<double()> read) {
+            family(name, help, "counter").series.push_back({std::move(labels), std::move(read), nullptr});
+        }
+
+        void gauge(const std::string& name, const std::string& help, Labels labels, std::function<double()> read) {
+            family(name, help, "gauge").series.push_back({std::move(labels), std::move(read), nullptr});
+        }
+
+        void histogram(const std::string& name, const std::string& help, Labels labels, const MetricHistogram& histogram) {
+            family(name, help, "histogram").series.push_back({std::move(labels), nullptr, &histogram});
+        }
+
+        void counter(const std::string& name, const std::string& help, Labels labels, const MetricCounter& counter) {
+            this->counter(name, help, std::move(labels), [&counter] { return static_cast<double>(counter.value()); });
+        }
+
+        void lock(const std::string& lock, const LockMetrics& metrics) {
+            counter("gtstore_lock_acquired_total", "Times a lock was taken", {{"lock", lock}}, metrics.acquired);
+            counter("gtstore_lock_contended_total", "Times a lock was held by another thread when taken",
+                    {{"lock", lock}}, metrics.contended);
+            counter("gtstore_lock_wait_us_total", "Microseconds spent waiting for a lock held by another thread",
+                    {{"lock", lock}}, [&metrics] { return metrics.wait_ns.value() / 1e3; });
+        }
+
+        // The text exposition format, version 0.0.4
+        std::string prometheus() const {
+            std::string out;
+            std::vector<uint64_t> counts;
+            uint64_t sum;
+
+            for (const Family& family : families) {
+                out += "# HELP " + family.name + " " + family.help + "\n";
+                out += "# TYPE " + family.name + " " + family.type + "\n";
+
+                for (const Series& series : family.series) {
+                    if (!series.histogram) {
+                        out += family.name + format_labels(series.labels, "") + " " + format_number(series.read()) + "\n";
+                        continue;
+                    }
+
+                    series.histogram->snapshot(counts, sum);
+                    uint64_t cumulative = 0;
+                    for (size_t i = 0; i < METRICS_BUCKETS; i++) {
+                        cumulative += counts[i];
+                        std::string le = i + 1 < METRICS_BUCKETS ? std::to_string(MetricHistogram::bound(i)) : "+Inf";
+                        out += family.name + "_bucket" + format_labels(series.labels, le) + " " + std::to_string(cumulative) + "\n";
+                    }
+                    out += family.name + "_sum" + format_labels(series.labels, "") + " " + std::to_string(sum) + "\n";
+                    out += family.name + "_count" + format_labels(series.labels, "") + " " + std::to_string(cumulative) + "\n";
+                }
+            }
+            return out;
+        }
+
+        // Add every series to a ManagerStatsResponse or StorageStatsResponse
+        template <class Response>
+        void fill(Response* response) const {
+            std::vector<uint64_t> counts;
+            uint64_t sum;
+
+            for (const Family& family : families) {
+                for (const Series& series : family.series) {
+                    auto* metric = response->add_metrics();
+                    metric->set_name(family.name);
+                    for (const auto& [label, value] : series.labels) {
+                        (*metric->mutable_labels())[label] = value;
+                    }
+
+                    if (!series.histogram) {
+                        metric->set_value(series.read());
+                        continue;
+                    }
+
+                    series.histogram->snapshot(counts, sum);
+                    uint64_t total = 0;
+                    for (size_t i = 0; i < METRICS_BUCKETS; i++) {
+                        metric->add_bucket_bounds(MetricHistogram::bound(i));
+                        metric->add_bucket_counts(counts[i]);
+                        total += counts[i];
+                    }
+                    metric->set_count(total);
+                    metric->set_sum(sum);
+                }
+            }
+        }
+
+    private:
+        struct Series {
+            Labels labels;
+            std::function<double()> read;
+            const MetricHistogram* histogram;
+        };
+
+        struct Family {
+            std::string name;
+            std::string help;
+            std::string type;
+            std::vector<Series> series;
+        };
+
+        // In order of registration, so the output is stable
+        std::vector<Family> families;
+
+        Family& family(const std::string& name, const std::string& help, const std::string& type) {
+            for (Family& family : families) {
+                if (family.name == name) {
+                    return family;
+                }
+            }
+            families.push_back({name, help, type, {}});
+            return families.back();
+        }
+
+        static std::string format_labels(const Labels& labels, const std::string& le) {
+            if (labels.empty() && le.empty()) {
+                return "";
+            }
+
+            std::string out = "{";
+            for (const auto& [label, value] : labels) {
+                out += label + "=\"" + value + "\",";
+            }
+            if (!le.empty()) {
+                out += "le=\"" + le + "\",";
+            }
+            out.back() = '}';
+            return out;
+        }
+
+        static std::string format_number(double value) {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+            return buffer;
+        }
+};
+
+// Serves a registry as Prometheus text on GET /metrics, from a thread of its own that takes
+// one connection at a time; scrapes are rare, so nothing fancier is needed
+class MetricsHttpServer {
+    public:
+        // Start serving on port for the life of the process; false if the port can't be bound
+        bool start(int port, const MetricsRegistry& registry) {
+            int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0) {
+                return false;
+            }
+
+            int reuse = 1;
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_ANY);
+            address.sin_port = htons(port);
+            if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 16) != 0) {
+                ::close(fd);
+                return false;
+            }
+
+            std::thread([fd, &registry] { serve(fd, registry); }).detach();
+            return true;
+        }
+
+    private:
+        static void serve(int fd, const MetricsRegistry& registry) {
+            while (true) {
+                int connection = ::accept(fd, nullptr, nullptr);
+                if (connection < 0) {
+                    continue;
+                }
+
+                // Don't let a client that never finishes its request hold up the next scrape
+                timeval timeout{1, 0};
+                ::setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+                std::string request;
+                char buffer[4096];
+                while (request.find("\r\n\r\n") == std::string::npos && request.size() < 65536) {
+                    ssize_t n = ::recv(connection, buffer, sizeof(buffer), 0);
+                    if (n <= 0) {
+                        break;
+                    }
+                    request.append(buffer, n);
+                }
+
+                std::string response;
+                if (request.rfind("GET /metrics ", 0) == 0 || request.rfind("GET /metrics?", 0) == 0) {
+                    std::string body = registry.prometheus();
+                    response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                               "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+                }
+                else {
+                    response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+                }
+
+                size_t sent = 0;
+                while (sent < response.size()) {
+                    ssize_t n = ::send(connection, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                    if (n <= 0) {
+                        break;
+                    }
+                    sent += n;
+                }
+                ::close(connection);
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef GTSTORE_ORDERED_INDEX
+#define GTSTORE_ORDERED_INDEX
+
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <functional>
+#include <new>
+#include <cstdint>
+
+// Levels of the skiplist; with a 1/4 chance of each extra level, enough for billions of keys
+#define INDEX_MAX_HEIGHT 16
+
+// Every key an engine holds, in sorted order, for range scans. A skiplist in the style of
+// LevelDB's memtable: inserts take a mutex, while readers walk the list with no lock at all,
+// since a node is linked in bottom level first and only once it is fully built. Engines never
+// drop keys, so nodes are freed only with the index.
+class OrderedIndex {
+    public:
+        OrderedIndex() : head(new_node("", INDEX_MAX_HEIGHT)) {}
+
+        ~OrderedIndex() {
+            Node* node = head;
+            while (node) {
+                Node* next = node->next(0);
+                free_node(node);
+                node = next;
+            }
+        }
+
+        OrderedIndex(const OrderedIndex&) = delete;
+        OrderedIndex& operator=(const OrderedIndex&) = delete;
+
+        // Add a key the engine did not hold before. Adding one twice is harmless.
+        void insert(const std::string& key) {
+            std::lock_guard<std::mutex> lock(insert_mutex);
+            Node* prev[INDEX_MAX_HEIGHT];
+            Node* found = find_greater_or_equal(key, prev);
+            if (found && found->key == key) {
+                return;
+            }
+
+            int node_height = random_height();
+            int current = height.load(std::memory_order_relaxed);
+            for (int level = current; level < node_height; level++) {
+                prev[level] = head;
+            }
+            if (node_height > current) {
+                // Readers seeing the new height before the node find head's null links there
+                height.store(node_height, std::memory_order_relaxed);
+            }
+
+            Node* node = new_node(key, node_height);
+            for (int level = 0; level < node_height; level++) {
+                node->set_next_relaxed(level, prev[level]->next_relaxed(level));
+                prev[level]->set_next(level, node);
+            }
+            count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Call fn for every key from start, until end (excluded; empty for no bound) or until
+        // fn returns false. Keys inserted meanwhile may or may not be visited.
+        void scan(const std::string& start, const std::string& end, const std::function<bool(const std::string&)>& fn) const {
+            for (Node* node = find_greater_or_equal(start, nullptr); node; node = node->next(0)) {
+                if ((!end.empty() && node->key >= end) || !fn(node->key)) {
+                    return;
+                }
+            }
+        }
+
+        size_t size() const {
+            return count.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct Node {
+            std::string key;
+            // Really as many links as the node's height, allocated with it
+            std::atomic<Node*> links[1];
+
+            Node* next(int level) const {
+                return links[level].load(std::memory_order_acquire);
+            }
+
+            void set_next(int level, Node* node) {
+                links[level].store(node, std::memory_order_release);
+            }
+
+            Node* next_relaxed(int level) const {
+                return links[level].load(std::memory_order_relaxed);
+            }
+
+            void set_next_relaxed(int level, Node* node) {
+                links[level].store(node, std::memory_order_relaxed);
+            }
+        };
+
+        Node* const head;
+        std::atomic<int> height{1};
+        std::atomic<size_t> count{0};
+        std::mutex insert_mutex;
+        // Used under insert_mutex only
+        std::minstd_rand rng{0x5eed};
+
+        static Node* new_node(const std::string& key, int height) {
+            void* memory = ::operator new(sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1));
+            Node* node = static_cast<Node*>(memory);
+            new (&node->key) std::string(key);
+            for (int level = 0; level < height; level++) {
+                new (&node->links[level]) std::atomic<Node*>(nullptr);
+            }
+            return node;
+        }
+
+        static void free_node(Node* node) {
+            node->key.~basic_string();
+            ::operator delete(node);
+        }
+
+        int random_height() {
+            int node_height = 1;
+            while (node_height < INDEX_MAX_HEIGHT && rng() % 4 == 0) {
+                node_height++;
+            }
+            return node_height;
+        }
+
+        // The first node with a key at or after key, or null; fills prev[level], if given, with
+        // the last node before it on each level
+        Node* find_greater_or_equal(const std::string& key, Node** prev) const {
+            Node* node = head;
+            int level = height.load(std::memory_order_relaxed) - 1;
+            while (true) {
+                Node* next = node->next(level);
+                if (next && next->key < key) {
+                    node = next;
+                    continue;
+                }
+                if (prev) {
+                    prev[level] = node;
+                }
+                if (level == 0) {
+                    return next;
+                }
+                level--;
+            }
+        }
+};
+
+#endif
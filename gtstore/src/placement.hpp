@@ -0,0 +1,394 @@
+#ifndef GTSTORE_PLACEMENT
+#define GTSTORE_PLACEMENT
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include "hash.hpp"
+
+// Hash space is cut into this many equal slices for strategies that do not place keys by
+// ring intervals, a power of two, so each slice moves between nodes as a whole
+#define PLACEMENT_SLICE_BITS 20
+// A node may own at most this times its fair share of hash space under bounded loads
+#define BOUNDED_LOAD_FACTOR 1.25
+// Equal ranges of key positions range placement starts with when given no split keys
+#define DEFAULT_KEY_RANGES 64
+
+// How keys map to storage nodes. Nodes are numbered in the order they joined and are never
+// removed: a failed node keeps its number and is skipped by HashRing while it is down.
+// Strategies are not changed once shared; adding nodes returns a new one.
+class PlacementStrategy {
+    public:
+        virtual ~PlacementStrategy() {}
+
+        // A copy with nodes appended, numbered after the existing ones
+        virtual std::shared_ptr<const PlacementStrategy> add_nodes(const std::vector<std::string>& nodes) const = 0;
+
+        // The first count distinct nodes in preference order for a key hash, or every node if
+        // there are fewer
+        virtual void preference(uint64_t key_hash, size_t count, std::vector<int>& order) const = 0;
+
+        // What placement calls a key's hash: stable_hash, unless the strategy keeps keys in order
+        virtual uint64_t position(const std::string& key) const {
+            return stable_hash(key);
+        }
+
+        // Sorted ends of the hash intervals placement is constant on. Each interval runs from
+        // just past the previous end, and the first one wraps around from the last end.
+        virtual std::vector<uint64_t> boundaries() const = 0;
+
+        // Bytes kept to place keys
+        virtual size_t memory_bytes() const = 0;
+};
+
+// Consistent hashing: every node has virtual_nodes points on a ring of hashes, and a key
+// belongs to the owners of the points clockwise from it. Points are kept in one sorted
+// array, with owners[i] numbering the node that owns hashes[i], so a lookup is a binary
+// search over contiguous memory.
+//
+// With bounded loads, a point whose owner would exceed BOUNDED_LOAD_FACTOR times its fair
+// share of the ring is handed to the owner of the next point with room (Mirrokni et al.,
+// "Consistent Hashing with Bounded Loads", applied to hash space rather than live keys).
+class RingPlacement final : public PlacementStrategy {
+    public:
+        std::vector<uint64_t> hashes;
+        std::vector<int> owners;
+
+        RingPlacement(int num_replicas, int virtual_nodes, bool bounded = false)
+            : num_replicas(num_replicas), virtual_nodes(virtual_nodes), bounded(bounded) {}
+
+        // A ring received from the manager, with the owners it settled on
+        RingPlacement(int num_replicas, int num_nodes, std::vector<uint64_t> hashes, std::vector<int> owners)
+            : hashes(std::move(hashes)), owners(std::move(owners)), num_replicas(num_replicas), num_nodes(num_nodes) {
+            build_successors();
+        }
+
+        std::shared_ptr<const PlacementStrategy> add_nodes(const std::vector<std::string>& nodes) const override {
+            auto ring = std::make_shared<RingPlacement>(*this);
+            std::vector<std::pair<uint64_t, int>> points;
+            points.reserve(hashes.size() + nodes.size() * virtual_nodes);
+            for (size_t i = 0; i < hashes.size(); i++) {
+                points.emplace_back(hashes[i], base_owners[i]);
+            }
+
+            for (const auto& node : nodes) {
+                int owner = ring->num_nodes++;
+                for (int j = 0; j < virtual_nodes; j++) {
+                    points.emplace_back(stable_hash(node + "_" + std::to_string(j)), owner);
+                }
+            }
+
+            // Stable, so an existing point sorts before a new one with the same hash, which
+            // it keeps
+            std::stable_sort(points.begin(), points.end(), [](const auto& a, const auto& b) {
+                return a.first < b.first;
+            });
+
+            ring->hashes.clear();
+            ring->base_owners.clear();
+            for (const auto& [hash, owner] : points) {
+                if (ring->hashes.empty() || ring->hashes.back() != hash) {
+                    ring->hashes.push_back(hash);
+                    ring->base_owners.push_back(owner);
+                }
+            }
+
+            ring->owners = ring->base_owners;
+            if (bounded) {
+                ring->bound_loads();
+            }
+            ring->build_successors();
+            return ring;
+        }
+
+        void preference(uint64_t key_hash, size_t count, std::vector<int>& order) const override {
+            order.clear();
+            if (hashes.empty()) {
+                return;
+            }
+
+            auto it = std::lower_bound(hashes.begin(), hashes.end(), key_hash);
+            size_t begin = it == hashes.end() ? 0 : it - hashes.begin();
+
+            if (count <= width) {
+                order.assign(&successors[begin * width], &successors[begin * width] + count);
+                return;
+            }
+
+            size_t i = begin;
+            do {
+                if (std::find(order.begin(), order.end(), owners[i]) == order.end()) {
+                    order.push_back(owners[i]);
+                }
+                i = (i + 1) % hashes.size();
+            }
+            while (i != begin && order.size() < count);
+        }
+
+        std::vector<uint64_t> boundaries() const override {
+            return hashes;
+        }
+
+        size_t memory_bytes() const override {
+            return hashes.capacity() * sizeof(uint64_t) + owners.capacity() * sizeof(int)
+                + base_owners.capacity() * sizeof(int) + successors.capacity() * sizeof(int);
+        }
+
+    private:
+        int num_replicas;
+        int virtual_nodes = 0;
+        bool bounded = false;
+        int num_nodes = 0;
+
+        // Owners before bounding loads; only kept where nodes are added
+        std::vector<int> base_owners;
+
+        // successors[i * width + r] is the r-th distinct node clockwise from hashes[i]; width
+        // is num_replicas, or fewer if the ring has fewer nodes
+        std::vector<int> successors;
+        size_t width = 0;
+
+        void build_successors() {
+            std::vector<bool> present(num_nodes);
+            for (int owner : owners) {
+                present[owner] = true;
+            }
+            width = std::min<size_t>(num_replicas, std::count(present.begin(), present.end(), true));
+
+            successors.assign(hashes.size() * width, 0);
+            for (size_t i = 0; i < hashes.size(); i++) {
+                int* row = &successors[i * width];
+                size_t found = 0;
+                for (size_t it = i; found < width; it = (it + 1) % hashes.size()) {
+                    if (std::find(row, row + found, owners[it]) == row + found) {
+                        row[found++] = owners[it];
+                    }
+                }
+            }
+        }
+
+        // Walk the ring once, giving each point to the first owner from it clockwise whose
+        // share of hash space stays within the bound
+        void bound_loads() {
+            long double capacity = BOUNDED_LOAD_FACTOR * 18446744073709551616.0L / num_nodes;
+            std::vector<long double> load(num_nodes);
+
+            for (size_t i = 0; i < hashes.size(); i++) {
+                // The interval ending at hashes[i], wrapping past zero for the first point
+                long double length = i == 0 ? hashes[0] + (18446744073709551616.0L - hashes.back()) : hashes[i] - hashes[i - 1];
+                size_t j = i;
+                do {
+                    if (load[base_owners[j]] + length <= capacity) {
+                        break;
+                    }
+                    j = (j + 1) % hashes.size();
+                }
+                while (j != i);
+
+                owners[i] = base_owners[j];
+                load[owners[i]] += length;
+            }
+        }
+};
+
+// Places each slice of hash space with a function of the slice and the node count or node
+// names, keeping no per-point state
+class SlicedPlacement : public PlacementStrategy {
+    public:
+        std::vector<uint64_t> boundaries() const override {
+            std::vector<uint64_t> ends(1ull << PLACEMENT_SLICE_BITS);
+            for (size_t slice = 0; slice < ends.size(); slice++) {
+                ends[slice] = ((slice + 1) << (64 - PLACEMENT_SLICE_BITS)) - 1;
+            }
+            return ends;
+        }
+
+    protected:
+        static uint64_t slice_key(uint64_t key_hash) {
+            return hash_u64(key_hash >> (64 - PLACEMENT_SLICE_BITS));
+        }
+};
+
+// Jump consistent hash (Lamping and Veach): a slice goes to one of the n nodes with no
+// lookup table, and only 1/(n+1) of slices move when a node is added. Replicas are the
+// jumps of the slice rehashed with 1, 2, ... until enough distinct nodes come up.
+class JumpPlacement final : public SlicedPlacement {
+    public:
+        JumpPlacement(int num_nodes = 0) : num_nodes(num_nodes) {}
+
+        std::shared_ptr<const PlacementStrategy> add_nodes(const std::vector<std::string>& nodes) const override {
+            return std::make_shared<JumpPlacement>(num_nodes + nodes.size());
+        }
+
+        void preference(uint64_t key_hash, size_t count, std::vector<int>& order) const override {
+            order.clear();
+            count = std::min<size_t>(count, num_nodes);
+            uint64_t key = slice_key(key_hash);
+
+            for (uint64_t seed = 0; order.size() < count && seed < 8 * count; seed++) {
+                int node = jump(seed == 0 ? key : hash_u64(key, seed), num_nodes);
+                if (std::find(order.begin(), order.end(), node) == order.end()) {
+                    order.push_back(node);
+                }
+            }
+
+            // Rarely, rehashing keeps landing on taken nodes; take the rest in order
+            for (int node = 0; order.size() < count; node++) {
+                if (std::find(order.begin(), order.end(), node) == order.end()) {
+                    order.push_back(node);
+                }
+            }
+        }
+
+        size_t memory_bytes() const override {
+            return 0;
+        }
+
+    private:
+        int num_nodes;
+
+        static int jump(uint64_t key, int num_buckets) {
+            int64_t bucket = -1;
+            int64_t next = 0;
+            while (next < num_buckets) {
+                bucket = next;
+                key = key * 2862933555777941757ull + 1;
+                next = (bucket + 1) * (static_cast<double>(1ll << 31) / static_cast<double>((key >> 33) + 1));
+            }
+            return bucket;
+        }
+};
+
+// Rendezvous (highest random weight) hashing: every node scores the slice, and the highest
+// scores win. Adding a node only moves the slices it wins, at the cost of scoring every node
+// on each lookup.
+class RendezvousPlacement final : public SlicedPlacement {
+    public:
+        std::shared_ptr<const PlacementStrategy> add_nodes(const std::vector<std::string>& nodes) const override {
+            auto placement = std::make_shared<RendezvousPlacement>(*this);
+            for (const auto& node : nodes) {
+                placement->node_seeds.push_back(stable_hash(node));
+            }
+            return placement;
+        }
+
+        void preference(uint64_t key_hash, size_t count, std::vector<int>& order) const override {
+            order.clear();
+            count = std::min(count, node_seeds.size());
+            uint64_t key = slice_key(key_hash);
+
+            // The count best (score, node) so far, best first
+            std::vector<std::pair<uint64_t, int>> best;
+            best.reserve(count + 1);
+            for (size_t node = 0; node < node_seeds.size(); node++) {
+                uint64_t score = hash_u64(key, node_seeds[node]);
+                if (best.size() == count && (count == 0 || score <= best.back().first)) {
+                    continue;
+                }
+                auto it = std::find_if(best.begin(), best.end(), [score](const auto& entry) { return entry.first < score; });
+                best.insert(it, {score, static_cast<int>(node)});
+                if (best.size() > count) {
+                    best.pop_back();
+                }
+            }
+
+            for (const auto& [score, node] : best) {
+                order.push_back(node);
+            }
+        }
+
+        size_t memory_bytes() const override {
+            return node_seeds.capacity() * sizeof(uint64_t);
+        }
+
+    private:
+        std::vector<uint64_t> node_seeds;
+};
+
+// Range partitioning: keys stay in order and are cut into ranges at split keys, so a range
+// of keys, and a scan over it, lives on few nodes. Keys are placed by key_position instead of
+// their hash; each split key starts a new range. With n nodes, range i of m belongs to node
+// i * n / m, so a node owns a run of neighbouring ranges, and its replicas go to the nodes
+// owning the ranges after it. Lookups use a ring whose points are the ends of the ranges.
+//
+// Ranges are fixed by the split keys, so they should follow the keys in use: without split
+// keys there are DEFAULT_KEY_RANGES equal ranges of positions, which only spread keys whose
+// leading bytes are uniform, such as hex or binary ones. Only a key's first 8 bytes place
+// it, so keys sharing those always share a range. There should be at least as many ranges as
+// nodes times replicas, or some nodes own little or nothing.
+//
+// Ranges are dealt out in order, so adding a node moves the boundary between most
+// neighbouring owners: going from n to n + 1 nodes reassigns about half of all ranges, not
+// the 1 / (n + 1) a hash ring moves. Range placement suits a fixed set of nodes.
+class RangePlacement final : public PlacementStrategy {
+    public:
+        RangePlacement(int num_replicas, const std::vector<std::string>& split_keys) : num_replicas(num_replicas) {
+            if (split_keys.empty()) {
+                for (uint64_t i = 1; i < DEFAULT_KEY_RANGES; i++) {
+                    ends.push_back(i * (UINT64_MAX / DEFAULT_KEY_RANGES));
+                }
+            }
+            for (const auto& key : split_keys) {
+                if (key_position(key) > 0) {
+                    ends.push_back(key_position(key) - 1);
+                }
+            }
+            ends.push_back(UINT64_MAX);
+            std::sort(ends.begin(), ends.end());
+            ends.erase(std::unique(ends.begin(), ends.end()), ends.end());
+            ring = std::make_shared<RingPlacement>(num_replicas, 0, std::vector<uint64_t>(), std::vector<int>());
+        }
+
+        // Ranges received from the manager, by the ends sent as ring points
+        RangePlacement(int num_replicas, int num_nodes, std::vector<uint64_t> hashes, std::vector<int> owners)
+            : num_replicas(num_replicas), num_nodes(num_nodes), ends(hashes),
+              ring(std::make_shared<RingPlacement>(num_replicas, num_nodes, std::move(hashes), std::move(owners))) {}
+
+        std::shared_ptr<const PlacementStrategy> add_nodes(const std::vector<std::string>& nodes) const override {
+            auto placement = std::make_shared<RangePlacement>(*this);
+            placement->num_nodes += nodes.size();
+
+            std::vector<int> owners(ends.size());
+            for (size_t i = 0; i < ends.size(); i++) {
+                owners[i] = i * placement->num_nodes / ends.size();
+            }
+            placement->ring = std::make_shared<RingPlacement>(num_replicas, placement->num_nodes, ends, std::move(owners));
+            return placement;
+        }
+
+        void preference(uint64_t key_hash, size_t count, std::vector<int>& order) const override {
+            ring->preference(key_hash, count, order);
+        }
+
+        uint64_t position(const std::string& key) const override {
+            return key_position(key);
+        }
+
+        std::vector<uint64_t> boundaries() const override {
+            return ring->boundaries();
+        }
+
+        size_t memory_bytes() const override {
+            return ends.capacity() * sizeof(uint64_t) + ring->memory_bytes();
+        }
+
+        size_t num_ranges() const {
+            return ends.size();
+        }
+
+        // The ranges as ring points, as the manager sends them
+        const RingPlacement& points() const {
+            return *ring;
+        }
+
+    private:
+        int num_replicas;
+        int num_nodes = 0;
+        // Sorted last positions of the ranges; the last one is UINT64_MAX
+        std::vector<uint64_t> ends;
+        std::shared_ptr<const RingPlacement> ring;
+};
+
+#endif
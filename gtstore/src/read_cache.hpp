@@ -0,0 +1,110 @@
+#ifndef GTSTORE_READ_CACHE
+#define GTSTORE_READ_CACHE
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <functional>
+
+// Independently locked parts of a read cache, a power of two
+#define READ_CACHE_SHARDS 16
+// Bookkeeping charged to each cached entry on top of its key and value bytes
+#define READ_CACHE_ENTRY_OVERHEAD 64
+
+// Values a client read under a lease, kept until the lease runs out. Each shard is an LRU
+// list with its own lock and an equal part of the byte budget; inserting past the budget
+// evicts the least recently read entries of the shard.
+class ReadCache {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        ReadCache(size_t budget_bytes) : shard_budget(budget_bytes / READ_CACHE_SHARDS) {}
+
+        // The cached value of key, if its lease has not run out
+        bool get(const std::string& key, std::vector<std::string>& value) {
+            Shard& shard = shard_for(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(key);
+            if (it == shard.index.end()) {
+                return false;
+            }
+
+            if (it->second->expires <= Clock::now()) {
+                remove(shard, it->second);
+                return false;
+            }
+
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            value = it->second->value;
+            return true;
+        }
+
+        void put(const std::string& key, std::vector<std::string> value, Clock::time_point expires) {
+            size_t bytes = READ_CACHE_ENTRY_OVERHEAD + key.size();
+            for (const auto& element : value) {
+                bytes += element.size();
+            }
+            if (bytes > shard_budget) {
+                return;
+            }
+
+            Shard& shard = shard_for(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(key);
+            if (it != shard.index.end()) {
+                remove(shard, it->second);
+            }
+
+            while (shard.bytes + bytes > shard_budget) {
+                remove(shard, std::prev(shard.entries.end()));
+            }
+
+            shard.entries.push_front(Entry{key, std::move(value), expires, bytes});
+            shard.index[key] = shard.entries.begin();
+            shard.bytes += bytes;
+        }
+
+        void erase(const std::string& key) {
+            Shard& shard = shard_for(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(key);
+            if (it != shard.index.end()) {
+                remove(shard, it->second);
+            }
+        }
+
+    private:
+        struct Entry {
+            std::string key;
+            std::vector<std::string> value;
+            Clock::time_point expires;
+            size_t bytes;
+        };
+
+        // Most recently read first
+        struct Shard {
+            std::list<Entry> entries;
+            std::unordered_map<std::string, std::list<Entry>::iterator> index;
+            size_t bytes = 0;
+            std::mutex mutex;
+        };
+
+        size_t shard_budget;
+        Shard shards[READ_CACHE_SHARDS];
+        std::hash<std::string> hasher;
+
+        Shard& shard_for(const std::string& key) {
+            return shards[hasher(key) & (READ_CACHE_SHARDS - 1)];
+        }
+
+        static void remove(Shard& shard, std::list<Entry>::iterator entry) {
+            shard.bytes -= entry->bytes;
+            shard.index.erase(entry->key);
+            shard.entries.erase(entry);
+        }
+};
+
+#endif
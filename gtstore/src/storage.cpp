@@ -3,11 +3,839 @@
 #include <shared_mutex>
 #include <mutex>
 #include <condition_variable>
+#include <unordered_map>
+#include <map>
+#include <set>
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <future>
+#include <getopt.h>
 #include "gtstore.hpp"
+#include "value.hpp"
+#include "hash.hpp"
+#include "wal.hpp"
+#include "storage_engine.hpp"
+#include "log_engine.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+// Number of lock stripes the key space is split into, a power of two
+#define NUM_SHARDS 64
+// Transaction id repairs hold a key under; clients never use it
+#define REPAIR_TXN_ID 0
+// Set in the transaction ids of chain writes, which count up from it on each node
+#define CHAIN_TXN_ID_BIT (1ULL << 63)
+// Hinted keys handed off to a recovered node per request
+#define HANDOFF_BATCH 100
+// Keys streamed to a new owner per request when ranges change owners
+#define STREAM_CHUNK 500
+// Attempts, a second apart, to deliver a chunk to a node that may still be starting
+#define STREAM_RETRIES 30
+// A shard drops expired read leases once it holds at least this many
+#define LEASE_SWEEP_MIN 1024
+// Deadline of a chain write passed to the next node, covering the rest of the chain
+#define CHAIN_FORWARD_TIMEOUT_MS 2000
+// Each node of a chain gives its successor this much less time than it has itself, so a
+// node hears back from a slow successor in time to name it
+#define CHAIN_HOP_MARGIN_MS 100
+// Deadline of each attempt to tell the manager a transfer is done
+#define TRANSFER_DONE_TIMEOUT_MS 1000
+// Attempts, a second apart, to tell the manager a transfer is done
+#define TRANSFER_DONE_RETRIES 10
+// Entries per message of a streamed scan
+#define SCAN_BATCH 100
+
+// Runs functions at given times on a thread of its own, so that waits, such as a commit's
+// for read leases to run out, hold no server thread
+class DelayQueue {
+    public:
+        DelayQueue() : thread(&DelayQueue::run, this) {}
+
+        ~DelayQueue() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            cv.notify_one();
+            thread.join();
+        }
+
+        void at(std::chrono::steady_clock::time_point when, std::function<void()> fn) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.emplace(when, std::move(fn));
+            }
+            cv.notify_one();
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> queue;
+        bool stopping = false;
+        // Last, so it starts once the rest is built
+        std::thread thread;
+
+        void run() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!stopping) {
+                if (queue.empty()) {
+                    cv.wait(lock);
+                    continue;
+                }
+                auto first = queue.begin();
+                if (first->first > std::chrono::steady_clock::now()) {
+                    cv.wait_until(lock, first->first);
+                    continue;
+                }
+
+                std::function<void()> fn = std::move(first->second);
+                queue.erase(first);
+                lock.unlock();
+                fn();
+                lock.lock();
+            }
+        }
+};
+
+// Transactional front of a storage node's StorageEngine, striped into independently locked
+// shards. Each shard owns the per-key transaction locks for its slice of the keys, so
+// requests for keys in different shards never contend on a lock.
+//
+// A prepared transaction holds its keys until commit or abort. Prepares that find a key
+// held queue on that key alone and are handed the key, values included, in FIFO order
+// when it is released; releasing a key wakes only the waiter it was handed to.
+//
+// Replicas are prepared in parallel, so two writers can each hold a key on a different
+// node. Queuing follows wait-die: a prepare may only wait behind transactions younger than
+// itself (by priority, the start time of the write) and otherwise fails at once with a
+// retryable conflict. Wait-for edges then always point from older to younger, so no cycle
+// can form, and a retried write keeps its age until it wins.
+//
+// With a WriteAheadLog attached, commits are logged before they become visible and the
+// store can be snapshotted to the log while it serves requests.
+//
+// Clients may cache a value under a read lease, a promise that the key will not change here
+// for a while. Leases are only granted on keys no write holds, and a write that reaches
+// publish waits out the leases of its keys first, so no client caches a value this node has
+// replaced. That wait holds no thread: writes report back through a callback, which a write
+// waiting for leases calls from the lease timer's thread.
+class ShardedStore {
+    public:
+        ShardedStore(std::unique_ptr<StorageEngine> engine) : engine(std::move(engine)) {}
+
+        bool get(const std::string& key, Value& value) {
+            return engine->get(key, value);
+        }
+
+        // Lease key for duration, or grant nothing (zero) if a write holds it. Taken before the
+        // value is read, so no write can slip in between.
+        std::chrono::milliseconds grant_lease(const std::string& key, std::chrono::milliseconds duration) {
+            Shard& shard = shard_for(key);
+            auto lock = lock_metered(shard.locks_mutex, shard_locks);
+            if (shard.locks.count(key)) {
+                return std::chrono::milliseconds(0);
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (shard.leases.size() >= shard.lease_sweep_at) {
+                for (auto it = shard.leases.begin(); it != shard.leases.end();) {
+                    it = it->second <= now ? shard.leases.erase(it) : std::next(it);
+                }
+                shard.lease_sweep_at = std::max<size_t>(LEASE_SWEEP_MIN, 2 * shard.leases.size());
+            }
+
+            auto& expires = shard.leases[key];
+            expires = std::max(expires, now + duration);
+            return duration;
+        }
+
+        // Every committed key and value, see StorageEngine::for_each
+        void for_each(const std::function<void(const std::string&, const Value&)>& fn) {
+            engine->for_each(fn);
+        }
+
+        // Committed keys in a range, in order, see StorageEngine::scan
+        void scan(const std::string& start, const std::string& end, const std::function<bool(const std::string&, const Value&)>& fn) {
+            engine->scan(start, end, fn);
+        }
+
+        // Versions are microseconds since the epoch, bumped past the last one handed out or
+        // stored here, so they increase on this node and roughly follow real time across
+        // nodes. A prepare proposes one once it holds its keys, so it is above the version of
+        // every write committed to them here before.
+        uint64_t next_version() {
+            uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            uint64_t last = last_version.load();
+            uint64_t next;
+            do {
+                next = std::max(now, last + 1);
+            } while (!last_version.compare_exchange_weak(last, next));
+            return next;
+        }
+
+        struct Prepare;
+
+        // A prepare's place in the key queues of the shard it is parked in, with the values
+        // it will stage for the keys not yet handed to it
+        struct Waiter {
+            Prepare* owner;
+            std::unordered_map<string, Value> staged;
+        };
+
+        // A prepare in flight. It takes the shards of its keys in index order (so two batches
+        // never wait on each other in a cycle) and may park in key queues between them; done
+        // is called exactly once, with whether every key was reserved for txn_id.
+        struct Prepare : std::enable_shared_from_this<Prepare> {
+            vector<std::pair<string, Value>> entries;
+            uint64_t txn_id;
+            uint64_t priority;
+            std::function<void(bool)> done;
+            // Queue behind any holder instead of following wait-die, see chain_write
+            bool always_waits = false;
+
+            vector<std::pair<size_t, vector<size_t>>> shard_entries;
+            size_t acquired = 0;
+            Waiter waiter;
+            std::chrono::steady_clock::time_point parked;
+            // Span of the request behind the prepare, for its wait in key queues
+            TraceContext trace;
+            std::atomic<int> waiting_shard{-1};
+            std::atomic<bool> cancelled{false};
+            std::atomic<bool> finished{false};
+        };
+
+        // Stage the values of entries (moved in) under txn_id. Nothing runs until start().
+        std::shared_ptr<Prepare> make_prepare(vector<std::pair<string, Value>> entries, uint64_t txn_id,
+                                              uint64_t priority, std::function<void(bool)> done) {
+            auto prepare = std::make_shared<Prepare>();
+            prepare->entries = std::move(entries);
+            prepare->txn_id = txn_id;
+            prepare->priority = priority;
+            prepare->done = std::move(done);
+            prepare->waiter.owner = prepare.get();
+            prepare->trace = TraceSpan::current();
+
+            std::map<size_t, vector<size_t>> shard_entries;
+            for (size_t i = 0; i < prepare->entries.size(); i++) {
+                shard_entries[shard_index(prepare->entries[i].first)].push_back(i);
+            }
+            prepare->shard_entries.assign(shard_entries.begin(), shard_entries.end());
+            return prepare;
+        }
+
+        void start(const std::shared_ptr<Prepare>& prepare) {
+            advance(prepare);
+        }
+
+        // Give up on a prepare, e.g. because its RPC was cancelled. A parked prepare leaves its
+        // queues and rolls back at once; a running one notices the flag itself.
+        void cancel(const std::shared_ptr<Prepare>& prepare) {
+            prepare->cancelled = true;
+            int index = prepare->waiting_shard;
+            if (index < 0) {
+                return;
+            }
+
+            vector<std::shared_ptr<Prepare>> resumed;
+            {
+                auto lock = lock_metered(shards[index].locks_mutex, shard_locks);
+                if (prepare->waiting_shard != index) {
+                    return;
+                }
+                withdraw(shards[index], *prepare, resumed);
+            }
+            resume(resumed);
+            fail(prepare);
+        }
+
+        // Blocking prepare for the sync server: reserve every key, all or nothing, waiting in
+        // the queues of keys held by younger transactions but not past the deadline.
+        bool prepare(vector<std::pair<string, Value>> entries, uint64_t txn_id, uint64_t priority,
+                     std::chrono::system_clock::time_point deadline) {
+            std::mutex mutex;
+            std::condition_variable cv;
+            bool finished = false;
+            bool prepared = false;
+
+            auto pending = make_prepare(std::move(entries), txn_id, priority, [&](bool result) {
+                std::lock_guard<std::mutex> lock(mutex);
+                prepared = result;
+                finished = true;
+                cv.notify_one();
+            });
+            start(pending);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            if (deadline == std::chrono::system_clock::time_point::max()) {
+                cv.wait(lock, [&finished] { return finished; });
+            }
+            else if (!cv.wait_until(lock, deadline, [&finished] { return finished; })) {
+                lock.unlock();
+                cancel(pending);
+                lock.lock();
+                cv.wait(lock, [&finished] { return finished; });
+            }
+            return prepared;
+        }
+
+        // Publish the staged values of txn_id for every key in [first, last) at version, then
+        // call done with whether all of them were prepared for txn_id. The client picks the
+        // version, the highest its replicas proposed, so every replica stores the write at
+        // the same one. A replica that committed a newer write first, as a lagging one may
+        // under QUORUM, keeps that one. A key stays locked until its value is visible, so the
+        // lock table and engine locks are never held together.
+        template <class KeyIt>
+        void commit(KeyIt first, KeyIt last, uint64_t txn_id, uint64_t version, std::function<void(bool)> done) {
+            bool committed = true;
+            vector<std::pair<const std::string*, Value>> values;
+
+            for (KeyIt key = first; key != last; ++key) {
+                Shard& shard = shard_for(*key);
+                auto lock = lock_metered(shard.locks_mutex, shard_locks);
+                auto it = shard.locks.find(*key);
+                if (it == shard.locks.end() || it->second.txn_id != txn_id || it->second.committing) {
+                    committed = false;
+                    continue;
+                }
+                it->second.committing = true;
+                values.emplace_back(&*key, std::move(it->second.values));
+                values.back().second.stamp(version);
+            }
+
+            vector<std::pair<const std::string*, Value>> newer;
+            for (auto& [key, value] : values) {
+                Value current;
+                if (!engine->get(*key, current) || current.version() < version) {
+                    newer.emplace_back(key, std::move(value));
+                    continue;
+                }
+                Shard& shard = shard_for(*key);
+                vector<std::shared_ptr<Prepare>> resumed;
+                {
+                    auto lock = lock_metered(shard.locks_mutex, shard_locks);
+                    release(shard, *key, txn_id, resumed);
+                }
+                resume(resumed);
+            }
+
+            publish(newer, txn_id, [committed, done] {
+                done(committed);
+            });
+        }
+
+        // Write key in one step if no transaction holds it, as a prepare under txn_id and its
+        // commit would, with one pass through the lock table, and call done with true once it
+        // is visible. Only a key's sole replica takes one-phase writes, so the version it
+        // stamps is the write's only one. Calls done with false at once, changing nothing, if the key is held.
+        // Like a repair, the write is committing from the start, so any prepare may queue
+        // behind it.
+        void put_if_free(const std::string& key, Value value, uint64_t txn_id, std::function<void(bool)> done) {
+            Shard& shard = shard_for(key);
+            {
+                auto lock = lock_metered(shard.locks_mutex, shard_locks);
+                auto [it, inserted] = shard.locks.try_emplace(key);
+                if (!inserted) {
+                    lock.unlock();
+                    done(false);
+                    return;
+                }
+                it->second.txn_id = txn_id;
+                it->second.priority = UINT64_MAX;
+                it->second.committing = true;
+            }
+
+            value.stamp(next_version());
+            vector<std::pair<const std::string*, Value>> values;
+            values.emplace_back(&key, std::move(value));
+            publish(values, txn_id, [done] {
+                done(true);
+            });
+        }
+
+        // Write key for chain replication, then call done with whether it was written and the
+        // value's version. The write queues on the key like a prepare, behind any holder: it
+        // is the youngest of writes, so transactions may queue behind it, and as it holds no
+        // other key it never closes a cycle. It holds no thread while it waits; cancel the
+        // returned prepare to give up. The head of the chain (stamp set) gives the value a new
+        // version; the nodes after it keep the head's, and only replace an older copy, so
+        // every replica ends up with the newest write the head ordered.
+        std::shared_ptr<Prepare> chain_write(const std::string& key, Value value, bool stamp, std::function<void(bool, uint64_t)> done) {
+            vector<std::pair<string, Value>> entries;
+            entries.emplace_back(key, std::move(value));
+            uint64_t txn_id = CHAIN_TXN_ID_BIT | next_chain_txn_id++;
+            auto prepare = make_prepare(std::move(entries), txn_id, UINT64_MAX, [this, key, stamp, txn_id, done](bool prepared) {
+                if (!prepared) {
+                    done(false, 0);
+                    return;
+                }
+                commit_chain_write(key, stamp, txn_id, done);
+            });
+            prepare->always_waits = true;
+            start(prepare);
+            return prepare;
+        }
+
+        // Apply a chain write that holds its key
+        void commit_chain_write(const std::string& key, bool stamp, uint64_t txn_id, std::function<void(bool, uint64_t)> done) {
+            Shard& shard = shard_for(key);
+            Value value;
+            {
+                auto lock = lock_metered(shard.locks_mutex, shard_locks);
+                KeyLock& key_lock = shard.locks[key];
+                key_lock.committing = true;
+                value = std::move(key_lock.values);
+            }
+
+            if (stamp) {
+                value.stamp(next_version());
+            }
+            uint64_t version = value.version();
+
+            Value current;
+            if (!stamp && engine->get(key, current) && current.version() >= version) {
+                vector<std::shared_ptr<Prepare>> resumed;
+                {
+                    auto lock = lock_metered(shard.locks_mutex, shard_locks);
+                    release(shard, key, txn_id, resumed);
+                }
+                resume(resumed);
+                done(true, version);
+                return;
+            }
+
+            vector<std::pair<const std::string*, Value>> values;
+            values.emplace_back(&key, std::move(value));
+            publish(values, txn_id, [done, version] {
+                done(true, version);
+            });
+        }
+
+        // Apply a copy of key committed on another replica, keeping its version, if it is
+        // newer than ours, then call done with whether it was. A key locked by a write in
+        // flight is left alone, as that write is newer still; the repair holds the key the
+        // same way meanwhile.
+        void repair(const std::string& key, Value value, std::function<void(bool)> done) {
+            Shard& shard = shard_for(key);
+            {
+                auto lock = lock_metered(shard.locks_mutex, shard_locks);
+                auto [it, inserted] = shard.locks.try_emplace(key);
+                if (!inserted) {
+                    lock.unlock();
+                    done(false);
+                    return;
+                }
+                it->second.txn_id = REPAIR_TXN_ID;
+                it->second.priority = UINT64_MAX;
+                it->second.committing = true;
+            }
+
+            Value current;
+            if (engine->get(key, current) && current.version() >= value.version()) {
+                vector<std::shared_ptr<Prepare>> resumed;
+                {
+                    auto lock = lock_metered(shard.locks_mutex, shard_locks);
+                    release(shard, key, REPAIR_TXN_ID, resumed);
+                }
+                resume(resumed);
+                done(false);
+                return;
+            }
+
+            vector<std::pair<const std::string*, Value>> values;
+            values.emplace_back(&key, std::move(value));
+            publish(values, REPAIR_TXN_ID, [done] {
+                done(true);
+            });
+        }
+
+        void abort(const std::string& key, uint64_t txn_id) {
+            Shard& shard = shard_for(key);
+            vector<std::shared_ptr<Prepare>> resumed;
+            {
+                auto lock = lock_metered(shard.locks_mutex, shard_locks);
+                auto it = shard.locks.find(key);
+                if (it != shard.locks.end() && it->second.txn_id == txn_id && !it->second.committing) {
+                    release(shard, key, txn_id, resumed);
+                }
+            }
+            resume(resumed);
+        }
+
+        // Load the data a log holds, then log every commit to it. Returns the records replayed.
+        size_t recover(WriteAheadLog& log) {
+            size_t replayed = log.recover([this](const std::string& key, Value value) {
+                see_version(value.version());
+                engine->put(key, std::move(value));
+            });
+            this->log = &log;
+            return replayed;
+        }
+
+        // Write a snapshot of the store to the log and drop the segments it replaces, while
+        // commits go on
+        void snapshot() {
+            WriteAheadLog::SnapshotWriter writer = log->begin_snapshot(log->rotate());
+            engine->for_each([&writer](const std::string& key, const Value& value) {
+                writer.add(key, value);
+            });
+            writer.finish();
+        }
+
+        // Keys held by transactions, prepared or committing, over every shard
+        size_t locked_keys() {
+            size_t count = 0;
+            for (Shard& shard : shards) {
+                std::unique_lock<std::mutex> lock(shard.locks_mutex);
+                count += shard.locks.size();
+            }
+            return count;
+        }
+
+        void usage(uint64_t& keys, uint64_t& bytes) {
+            engine->usage(keys, bytes);
+        }
+
+        const LockMetrics& engine_locks() const {
+            return engine->stripe_locks;
+        }
+
+        // Waits on the shards' lock tables
+        LockMetrics shard_locks;
+        // How long prepares sat in key queues before they were handed the keys
+        MetricHistogram queue_wait_us;
+        // Prepares failed at once by wait-die
+        MetricCounter conflicts;
+        // How long commits waited for read leases to run out, and for the log to sync
+        MetricHistogram lease_wait_us;
+        MetricHistogram log_sync_us;
+
+    private:
+        struct KeyLock {
+            uint64_t txn_id;
+            uint64_t priority;
+            bool committing = false;
+            Value values;
+            std::deque<Waiter*> waiters;
+        };
+
+        struct Shard {
+            std::unordered_map<string, KeyLock> locks;
+            // When the read leases granted on each key run out
+            std::unordered_map<string, std::chrono::steady_clock::time_point> leases;
+            size_t lease_sweep_at = LEASE_SWEEP_MIN;
+            std::mutex locks_mutex;
+        };
+
+        std::unique_ptr<StorageEngine> engine;
+        Shard shards[NUM_SHARDS];
+        std::hash<std::string> hasher;
+        WriteAheadLog* log = nullptr;
+        std::atomic<uint64_t> last_version{0};
+        std::atomic<uint64_t> next_chain_txn_id{1};
+        // Runs the writes that waited for read leases
+        DelayQueue lease_timer;
+
+        size_t shard_index(const std::string& key) {
+            return hasher(key) & (NUM_SHARDS - 1);
+        }
+
+        Shard& shard_for(const std::string& key) {
+            return shards[shard_index(key)];
+        }
+
+        // Make values, held under txn_id, visible and release their keys, then call done. The
+        // values wait for the read leases on their keys to run out; as the keys are held, no
+        // new ones are granted meanwhile. Values with leases to wait for are handed to the
+        // lease timer with their own copy of the keys, and done is called from its thread.
+        void publish(vector<std::pair<const std::string*, Value>>& values, uint64_t txn_id, std::function<void()> done) {
+            auto leases_end = std::chrono::steady_clock::time_point::min();
+            for (const auto& [key, value] : values) {
+                Shard& shard = shard_for(*key);
+                auto lock = lock_metered(shard.locks_mutex, shard_locks);
+                auto it = shard.leases.find(*key);
+                if (it != shard.leases.end()) {
+                    leases_end = std::max(leases_end, it->second);
+                    shard.leases.erase(it);
+                }
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            if (leases_end <= start) {
+                apply(values, txn_id);
+                done();
+                return;
+            }
+
+            auto owned = std::make_shared<vector<std::pair<string, Value>>>();
+            for (auto& [key, value] : values) {
+                owned->emplace_back(*key, std::move(value));
+            }
+            TraceContext trace = TraceSpan::current();
+            uint64_t start_us = Tracer::now_us();
+            lease_timer.at(leases_end, [this, owned, txn_id, done, trace, start, start_us] {
+                lease_wait_us.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+                if (trace.sampled()) {
+                    Tracer::instance().record_child(trace, "lease_wait", start_us, Tracer::now_us());
+                }
+
+                TraceScope scope(trace);
+                vector<std::pair<const std::string*, Value>> values;
+                for (auto& [key, value] : *owned) {
+                    values.emplace_back(&key, std::move(value));
+                }
+                apply(values, txn_id);
+                done();
+            });
+        }
+
+        // The rest of publish, once no lease is left to wait for. With a log attached the
+        // values are logged, and as durable as its mode promises, before any of them is
+        // visible; the batch shares one sync.
+        void apply(vector<std::pair<const std::string*, Value>>& values, uint64_t txn_id) {
+            vector<WriteAheadLog::Position> positions;
+            if (log) {
+                for (const auto& [key, value] : values) {
+                    positions.push_back(log->append(*key, value));
+                }
+                if (!positions.empty()) {
+                    MetricTimer timer(log_sync_us);
+                    TraceSpan span("log_sync");
+                    log->sync(positions.back().lsn);
+                }
+            }
+
+            for (auto& [key, value] : values) {
+                Shard& shard = shard_for(*key);
+                see_version(value.version());
+                engine->put(*key, std::move(value));
+                vector<std::shared_ptr<Prepare>> resumed;
+                {
+                    auto lock = lock_metered(shard.locks_mutex, shard_locks);
+                    release(shard, *key, txn_id, resumed);
+                }
+                resume(resumed);
+            }
+
+            for (const auto& position : positions) {
+                log->applied(position);
+            }
+        }
+
+        // Keep versions handed out later above one stored here, which may come from another node
+        void see_version(uint64_t version) {
+            uint64_t last = last_version.load();
+            while (last < version && !last_version.compare_exchange_weak(last, version)) {}
+        }
+
+        // Wait-die: only a transaction older than the holder and every queued waiter may wait
+        static bool may_wait(const KeyLock& key_lock, uint64_t priority) {
+            if (priority >= key_lock.priority) {
+                return false;
+            }
+            for (const Waiter* waiter : key_lock.waiters) {
+                if (priority >= waiter->owner->priority) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Hand the key held by txn_id to the first waiter in its queue, or unlock it. A waiter
+        // that now holds all its keys in the shard is added to resumed, to be advanced by the
+        // caller once the shard's locks_mutex (held here) is released.
+        void release(Shard& shard, const std::string& key, uint64_t txn_id, vector<std::shared_ptr<Prepare>>& resumed) {
+            auto it = shard.locks.find(key);
+            if (it == shard.locks.end() || it->second.txn_id != txn_id) {
+                return;
+            }
+
+            KeyLock& key_lock = it->second;
+            if (key_lock.waiters.empty()) {
+                shard.locks.erase(it);
+                return;
+            }
+
+            Waiter* waiter = key_lock.waiters.front();
+            key_lock.waiters.pop_front();
+
+            auto staged = waiter->staged.find(key);
+            key_lock.txn_id = waiter->owner->txn_id;
+            key_lock.priority = waiter->owner->priority;
+            key_lock.committing = false;
+            key_lock.values = std::move(staged->second);
+            waiter->staged.erase(staged);
+
+            if (waiter->staged.empty()) {
+                Prepare* prepare = waiter->owner;
+                uint64_t waited_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - prepare->parked).count();
+                queue_wait_us.record(waited_us);
+                if (prepare->trace.sampled()) {
+                    uint64_t now = Tracer::now_us();
+                    Tracer::instance().record_child(prepare->trace, "key_queue", now - waited_us, now);
+                }
+                prepare->waiting_shard = -1;
+                prepare->acquired++;
+                resumed.push_back(prepare->shared_from_this());
+            }
+        }
+
+        void resume(const vector<std::shared_ptr<Prepare>>& resumed) {
+            for (const auto& prepare : resumed) {
+                advance(prepare);
+            }
+        }
+
+        // Take the remaining shards of a prepare until it holds every key, has to park, or fails
+        void advance(const std::shared_ptr<Prepare>& prepare) {
+            while (prepare->acquired < prepare->shard_entries.size()) {
+                if (prepare->cancelled) {
+                    fail(prepare);
+                    return;
+                }
+
+                auto& [index, entry_indices] = prepare->shard_entries[prepare->acquired];
+                Shard& shard = shards[index];
+                auto lock = lock_metered(shard.locks_mutex, shard_locks);
+
+                for (size_t i : entry_indices) {
+                    auto it = shard.locks.find(prepare->entries[i].first);
+                    if (it != shard.locks.end() && it->second.txn_id != prepare->txn_id && !prepare->always_waits &&
+                        !may_wait(it->second, prepare->priority)) {
+                        lock.unlock();
+                        conflicts.add();
+                        fail(prepare);
+                        return;
+                    }
+                }
+
+                for (size_t i : entry_indices) {
+                    auto [it, inserted] = shard.locks.try_emplace(prepare->entries[i].first);
+                    KeyLock& key_lock = it->second;
+
+                    if (inserted || key_lock.txn_id == prepare->txn_id) {
+                        key_lock.txn_id = prepare->txn_id;
+                        key_lock.priority = prepare->priority;
+                        key_lock.values = std::move(prepare->entries[i].second);
+                    }
+                    else {
+                        key_lock.waiters.push_back(&prepare->waiter);
+                        prepare->waiter.staged[prepare->entries[i].first] = std::move(prepare->entries[i].second);
+                    }
+                }
+
+                if (!prepare->waiter.staged.empty()) {
+                    // Park; release() hands over the keys and resumes us
+                    prepare->parked = std::chrono::steady_clock::now();
+                    prepare->waiting_shard = index;
+                    if (prepare->cancelled) {
+                        vector<std::shared_ptr<Prepare>> resumed;
+                        withdraw(shard, *prepare, resumed);
+                        lock.unlock();
+                        resume(resumed);
+                        fail(prepare);
+                    }
+                    return;
+                }
+
+                prepare->acquired++;
+            }
+
+            finish(prepare, true);
+        }
+
+        // Leave the key queues of the shard a prepare is parked in and pass on the keys of
+        // that shard it was already handed. Called with the shard's locks_mutex held.
+        void withdraw(Shard& shard, Prepare& prepare, vector<std::shared_ptr<Prepare>>& resumed) {
+            for (auto& [key, values] : prepare.waiter.staged) {
+                auto& waiters = shard.locks[key].waiters;
+                waiters.erase(std::find(waiters.begin(), waiters.end(), &prepare.waiter));
+            }
+
+            for (size_t i : prepare.shard_entries[prepare.acquired].second) {
+                const std::string& key = prepare.entries[i].first;
+                if (prepare.waiter.staged.find(key) == prepare.waiter.staged.end()) {
+                    release(shard, key, prepare.txn_id, resumed);
+                }
+            }
+
+            prepare.waiter.staged.clear();
+            prepare.waiting_shard = -1;
+        }
+
+        // Roll back the shards a prepare fully holds and report the failure
+        void fail(const std::shared_ptr<Prepare>& prepare) {
+            for (size_t n = 0; n < prepare->acquired; n++) {
+                for (size_t i : prepare->shard_entries[n].second) {
+                    abort(prepare->entries[i].first, prepare->txn_id);
+                }
+            }
+            prepare->acquired = 0;
+            finish(prepare, false);
+        }
+
+        void finish(const std::shared_ptr<Prepare>& prepare, bool prepared) {
+            if (!prepare->finished.exchange(true)) {
+                prepare->done(prepared);
+            }
+        }
+};
+
+// Key hash ranges of a transfer, each (start, end] and wrapping past zero when start >= end,
+// tested by binary search over their ends
+class HashRanges {
+    public:
+        HashRanges(const google::protobuf::RepeatedPtrField<StorageHashRange>& ranges) {
+            for (const auto& range : ranges) {
+                if (range.start() < range.end()) {
+                    ends.emplace_back(range.end(), range.start());
+                    continue;
+                }
+                // Split a wrapping range into its part below zero and its part above
+                wraps = true;
+                low_end = range.end();
+                if (range.start() < UINT64_MAX) {
+                    ends.emplace_back(UINT64_MAX, range.start());
+                }
+            }
+            std::sort(ends.begin(), ends.end());
+        }
+
+        bool contains(uint64_t hash) const {
+            if (wraps && hash <= low_end) {
+                return true;
+            }
+            auto it = std::lower_bound(ends.begin(), ends.end(), std::make_pair(hash, (uint64_t) 0));
+            return it != ends.end() && hash > it->second;
+        }
+
+    private:
+        // (end, start) of each range that does not wrap
+        vector<std::pair<uint64_t, uint64_t>> ends;
+        bool wraps = false;
+        uint64_t low_end = 0;
+};
 
 class GTStoreStorageImpl final : public GTStoreStorageService::Service {
     public:
-        GTStoreStorageImpl(string node_address, std::shared_ptr<Channel> channel) : node_address(node_address), manager_stub(GTStoreManagerService::NewStub(channel)) {
+        GTStoreStorageImpl(string node_address, std::shared_ptr<Channel> channel, std::unique_ptr<StorageEngine> engine, WriteAheadLog* log = nullptr,
+                           int lease_ms = 0)
+            : node_address(node_address), log(log), lease(lease_ms), store(std::move(engine)), manager_stub(GTStoreManagerService::NewStub(channel)) {
+            // Reload the node's data before it announces itself to the manager
+            if (log) {
+                auto start = std::chrono::steady_clock::now();
+                size_t replayed = store.recover(*log);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                std::cout << "Recovered " << replayed << " records in " << ms << " ms ("
+                          << (replayed ? ms * 1000000 / replayed : 0) << " ms per million records)" << std::endl;
+            }
+
+            register_metrics();
+
             ManagerUpdateStatusRequest request;
             request.set_storage_node(node_address);
             ManagerUpdateStatusResponse response;
@@ -15,90 +843,1141 @@ class GTStoreStorageImpl final : public GTStoreStorageService::Service {
             Status status = manager_stub->update_status(&context, request, &response);
         }
 
-        Status get(ServerContext* context, const StorageGetRequest* request, StorageGetResponse* response) override {
-            std::string key = request->key();
-            std::shared_lock<std::shared_mutex> lock(kv_store_mutex);
+        // Serve the node's metrics as Prometheus text on port
+        bool serve_metrics(int port) {
+            return metrics_server.start(port, metrics);
+        }
+
+        Status stats(ServerContext* context, const StorageStatsRequest* request, StorageStatsResponse* response) override {
+            metrics.fill(response);
+            return Status::OK;
+        }
+
+        Status trace(ServerContext* context, const StorageTraceRequest* request, StorageTraceResponse* response) override {
+            Tracer::instance().fill(response);
+            return Status::OK;
+        }
+
+        Status get(ServerContext* context, const StorageGetRequest* request, StorageGetResponse* response) override {
+            RpcScope scope(this, RPC_GET, context);
+            Value value;
+
+			if (!store.get(request->key(), value)) {
+				response->set_success(false);
+				return Status::OK;
+			}
+
+            // Missing keys get no lease, which would only delay their first write. A lease only
+            // covers values read after it was granted, so read again under it; keys are never
+            // removed, so the key is still there.
+            if (request->lease() && lease.count() > 0) {
+                response->set_lease_ms(store.grant_lease(request->key(), lease).count());
+                if (response->lease_ms() > 0) {
+                    store.get(request->key(), value);
+                }
+            }
+
+            add_values(value, response);
+
+            response->set_success(true);
+            return Status::OK;
+        }
+
+        Status prepare_put(ServerContext* context, const StoragePutRequest* request, StoragePutResponse* response) override {
+            RpcScope scope(this, RPC_PREPARE_PUT, context);
+            // Concurrent writers prepare replicas in parallel, so never wait past the client's deadline
+            vector<std::pair<string, Value>> entries = put_entries(request);
+            vector<string> hinted = hinted_keys(entries);
+            response->set_success(store.prepare(std::move(entries), request->txn_id(), request->priority(), context->deadline()));
+            if (!response->success()) {
+                settle_hints(hinted.begin(), hinted.end(), request->txn_id(), false);
+            }
+            else {
+                response->set_version(store.next_version());
+            }
+            return Status::OK;
+        }
+
+        Status commit_put(ServerContext* context, const StorageCommitPutRequest* request, StorageCommitPutResponse* response) override {
+            TraceScope scope(trace_extract(context));
+            wait_for(&GTStoreStorageImpl::start_commit_put, request, response);
+            return Status::OK;
+        }
+
+        // Commits, like every write that publishes values, call done once the values are
+        // visible, which may be from the lease timer's thread
+        void start_commit_put(const StorageCommitPutRequest* request, StorageCommitPutResponse* response, std::function<void()> done) {
+            done = timed(RPC_COMMIT_PUT, std::move(done));
+            store.commit(&request->key(), &request->key() + 1, request->txn_id(), request->version(), [this, request, response, done](bool committed) {
+                settle_hints(&request->key(), &request->key() + 1, request->txn_id(), true);
+                response->set_success(committed);
+                done();
+            });
+        }
+
+        Status put(ServerContext* context, const StoragePutRequest* request, StoragePutResponse* response) override {
+            TraceScope scope(trace_extract(context));
+            wait_for(&GTStoreStorageImpl::start_put, request, response);
+            return Status::OK;
+        }
+
+        // One-phase write of a key this node is the only replica of. Fails if a transaction holds
+        // the key, and the client falls back to prepare and commit.
+        void start_put(const StoragePutRequest* request, StoragePutResponse* response, std::function<void()> done) {
+            done = timed(RPC_PUT, std::move(done));
+            vector<std::pair<string, Value>> entries = put_entries(request);
+            store.put_if_free(entries[0].first, std::move(entries[0].second), request->txn_id(), [this, request, response, done](bool written) {
+                settle_hints(&request->key(), &request->key() + 1, request->txn_id(), written);
+                response->set_success(written);
+                done();
+            });
+        }
+
+        // Waits for the key no longer than the caller does, like prepare_put
+        Status chain_put(ServerContext* context, const StorageChainPutRequest* request, StorageChainPutResponse* response) override {
+            TraceScope scope(trace_extract(context));
+            std::promise<void> answered;
+            std::future<void> answer = answered.get_future();
+            auto write = start_chain_put(context, request, response, [&answered] {
+                answered.set_value();
+            });
+
+            auto deadline = context->deadline();
+            if (deadline != std::chrono::system_clock::time_point::max() && answer.wait_until(deadline) == std::future_status::timeout) {
+                store.cancel(write);
+            }
+            answer.wait();
+            return Status::OK;
+        }
+
+        // Write a chain replication PUT here, then pass it to the next node of the chain and
+        // call done once that answered, or at once on the tail. The head stamps the version the
+        // rest of the chain keeps. If the next node is unreachable, the response names it as
+        // failed_node; if it does not answer before the caller's deadline, less a margin, as
+        // slow_node. Cancel the returned write if the caller gives up while it waits for the key.
+        std::shared_ptr<ShardedStore::Prepare> start_chain_put(ServerContext* context, const StorageChainPutRequest* request,
+                                                               StorageChainPutResponse* response, std::function<void()> done) {
+            done = timed(RPC_CHAIN_PUT, std::move(done));
+            auto deadline = context->deadline();
+            return store.chain_write(request->key(), Value::copy_of(request->values(), request->version(), request->encoding()), request->version() == 0,
+                                     [this, request, response, done, deadline](bool written, uint64_t version) {
+                if (!written) {
+                    response->set_success(false);
+                    done();
+                    return;
+                }
+                forward_chain_put(request, response, version, deadline, done);
+            });
+        }
+
+        // Pass a chain write applied here on to the next node, or answer it on the tail
+        void forward_chain_put(const StorageChainPutRequest* request, StorageChainPutResponse* response, uint64_t version,
+                               std::chrono::system_clock::time_point deadline, std::function<void()> done) {
+            if (!request->hint_for().empty()) {
+                auto lock = lock_metered(hints_mutex, hints_locks);
+                hints[request->hint_for()].insert(request->key());
+            }
+
+            if (request->successors().empty()) {
+                response->set_success(true);
+                response->set_version(version);
+                done();
+                return;
+            }
+
+            auto call = new ForwardCall();
+            call->request.set_key(request->key());
+            *call->request.mutable_values() = request->values();
+            call->request.set_encoding(request->encoding());
+            call->request.set_version(version);
+            call->request.set_hint_for(request->successors(0).hint_for());
+            call->request.mutable_successors()->CopyFrom(request->successors());
+            call->request.mutable_successors()->erase(call->request.mutable_successors()->begin());
+            auto hop_deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(CHAIN_FORWARD_TIMEOUT_MS);
+            if (deadline != std::chrono::system_clock::time_point::max()) {
+                hop_deadline = std::min(hop_deadline, deadline - std::chrono::milliseconds(CHAIN_HOP_MARGIN_MS));
+            }
+            call->context.set_deadline(hop_deadline);
+
+            string next = request->successors(0).storage_node();
+            call->trace.start("chain_put", next, call->context);
+            call->done = [call, response, done, next] {
+                call->trace.finish();
+                if (call->status.ok()) {
+                    *response = call->response;
+                }
+                else {
+                    response->set_success(false);
+                    if (call->status.error_code() == grpc::StatusCode::DEADLINE_EXCEEDED) {
+                        response->set_slow_node(next);
+                    }
+                    else {
+                        response->set_failed_node(next);
+                    }
+                }
+                done();
+            };
+
+            call->reader = peer_stub(next)->PrepareAsyncchain_put(&call->context, call->request, &forward_cq);
+            call->reader->StartCall();
+            call->reader->Finish(&call->response, &call->status, call);
+        }
+
+        // Finish chain writes as the nodes they were passed to answer. Never returns.
+        void run_forwarding() {
+            void* tag;
+            bool ok;
+            while (forward_cq.Next(&tag, &ok)) {
+                ForwardCall* call = static_cast<ForwardCall*>(tag);
+                call->done();
+                delete call;
+            }
+        }
+
+        Status abort_put(ServerContext* context, const StorageAbortPutRequest* request, StorageAbortPutResponse* response) override {
+            RpcScope scope(this, RPC_ABORT_PUT, context);
+            store.abort(request->key(), request->txn_id());
+            settle_hints(&request->key(), &request->key() + 1, request->txn_id(), false);
+            response->set_success(true);
+            return Status::OK;
+        }
+
+        Status multi_get(ServerContext* context, const StorageMultiGetRequest* request, StorageMultiGetResponse* response) override {
+            RpcScope scope(this, RPC_MULTI_GET, context);
+            for (const auto& key : request->keys()) {
+                StorageGetResponse* result = response->add_results();
+                Value value;
+
+                if (!store.get(key, value)) {
+                    result->set_success(false);
+                    continue;
+                }
+
+                add_values(value, result);
+                result->set_success(true);
+            }
+
+            response->set_success(true);
+            return Status::OK;
+        }
+
+        Status multi_prepare_put(ServerContext* context, const StorageMultiPutRequest* request, StorageMultiPutResponse* response) override {
+            RpcScope scope(this, RPC_MULTI_PREPARE_PUT, context);
+            vector<std::pair<string, Value>> entries = multi_put_entries(request);
+            vector<string> hinted = hinted_keys(entries);
+            response->set_success(store.prepare(std::move(entries), request->txn_id(), request->priority(), context->deadline()));
+            if (!response->success()) {
+                settle_hints(hinted.begin(), hinted.end(), request->txn_id(), false);
+            }
+            else {
+                response->set_version(store.next_version());
+            }
+            return Status::OK;
+        }
+
+        Status multi_commit_put(ServerContext* context, const StorageMultiCommitPutRequest* request, StorageMultiCommitPutResponse* response) override {
+            TraceScope scope(trace_extract(context));
+            wait_for(&GTStoreStorageImpl::start_multi_commit_put, request, response);
+            return Status::OK;
+        }
+
+        void start_multi_commit_put(const StorageMultiCommitPutRequest* request, StorageMultiCommitPutResponse* response, std::function<void()> done) {
+            done = timed(RPC_MULTI_COMMIT_PUT, std::move(done));
+            store.commit(request->keys().begin(), request->keys().end(), request->txn_id(), request->version(),
+                         [this, request, response, done](bool committed) {
+                settle_hints(request->keys().begin(), request->keys().end(), request->txn_id(), true);
+                response->set_success(committed);
+                done();
+            });
+        }
 
-			if (kv_store.find(key) == kv_store.end()) {
-				response->set_success(false);
-				return Status::OK;
-			}
+        Status multi_abort_put(ServerContext* context, const StorageMultiAbortPutRequest* request, StorageMultiAbortPutResponse* response) override {
+            RpcScope scope(this, RPC_MULTI_ABORT_PUT, context);
+            for (const auto& key : request->keys()) {
+                store.abort(key, request->txn_id());
+            }
+            settle_hints(request->keys().begin(), request->keys().end(), request->txn_id(), false);
 
-            std::vector<string> values = kv_store[key];
+            response->set_success(true);
+            return Status::OK;
+        }
+
+        Status repair(ServerContext* context, const StorageRepairRequest* request, StorageRepairResponse* response) override {
+            TraceScope scope(trace_extract(context));
+            wait_for(&GTStoreStorageImpl::start_repair, request, response);
+            return Status::OK;
+        }
+
+        // Answers once every entry was applied or found older than this node's copy
+        void start_repair(const StorageRepairRequest* request, StorageRepairResponse* response, std::function<void()> done) {
+            done = timed(RPC_REPAIR, std::move(done));
+            // One per entry, and one for the loop, so done runs once all entries are through
+            auto remaining = std::make_shared<std::atomic<int>>(request->entries_size() + 1);
+            auto finish_one = [response, done, remaining](bool) {
+                if (--*remaining == 0) {
+                    response->set_success(true);
+                    done();
+                }
+            };
 
-            for (auto& value : values) {
-                response->add_values(value);
+            for (const auto& entry : request->entries()) {
+                store.repair(entry.key(), Value::copy_of(entry.values(), entry.version(), entry.encoding()), finish_one);
             }
+            finish_one(true);
+        }
 
-            response->set_success(true);
+        // Stream the keys of a range in batches, each read from the engine once the previous
+        // one was handed to gRPC
+        Status scan(ServerContext* context, const StorageScanRequest* request, grpc::ServerWriter<StorageScanResponse>* writer) override {
+            RpcScope scope(this, RPC_SCAN, context);
+            std::string cursor = request->start_key();
+            uint32_t sent = 0;
+            bool more = true;
+
+            while (more) {
+                StorageScanResponse batch;
+                more = scan_batch(*request, cursor, sent, &batch);
+                if (batch.entries_size() > 0 && !writer->Write(batch)) {
+                    // The client went away
+                    return Status::CANCELLED;
+                }
+            }
             return Status::OK;
         }
 
-        Status prepare_put(ServerContext* context, const StoragePutRequest* request, StoragePutResponse* response) override {
-            std::string key = request->key();
-            std::vector<string> values;
+        // The next batch of a scan: up to SCAN_BATCH entries from cursor on, within the
+        // request's limit given the entries sent so far. Moves cursor past them, and returns
+        // false once nothing is left to send after this batch.
+        bool scan_batch(const StorageScanRequest& request, std::string& cursor, uint32_t& sent, StorageScanResponse* batch) {
+            int wanted = SCAN_BATCH;
+            if (request.limit() > 0) {
+                wanted = std::min<uint32_t>(wanted, request.limit() - sent);
+            }
+
+            store.scan(cursor, request.end_key(), [&](const std::string& key, const Value& value) {
+                // Dictionaries are the clients' own, not the application's, so they neither
+                // reach the client nor count toward the limit
+                if (key.compare(0, sizeof(DICTIONARY_KEY_PREFIX) - 1, DICTIONARY_KEY_PREFIX) == 0) {
+                    return true;
+                }
+                StorageScanEntry* entry = batch->add_entries();
+                entry->set_key(key);
+                entry->mutable_values()->Reserve(value.size());
+                for (size_t i = 0; i < value.size(); i++) {
+                    entry->add_values(value[i].data(), value[i].size());
+                }
+                entry->set_version(value.version());
+                entry->set_encoding(value.encoding());
+                return batch->entries_size() < wanted;
+            });
+
+            sent += batch->entries_size();
+            if (batch->entries_size() > 0) {
+                // The first key after the last one sent
+                cursor = batch->entries(batch->entries_size() - 1).key() + '\0';
+            }
+            return batch->entries_size() == wanted && (request.limit() == 0 || sent < request.limit());
+        }
+
+        // Async server counterpart of scan: the returned function, called once the scan is
+        // done, records it like timed does
+        std::function<void()> start_scan() {
+            return timed(RPC_SCAN, [] {});
+        }
+
+        // Async server counterparts of prepare_put and multi_prepare_put: queue the prepare and
+        // return at once, calling done with the response filled in once it resolves. The
+        // returned handle lets the caller cancel it.
+        std::shared_ptr<ShardedStore::Prepare> start_prepare_put(const StoragePutRequest* request, StoragePutResponse* response,
+                                                                 std::function<void()> done) {
+            return start_prepare(put_entries(request), request->txn_id(), request->priority(), response, timed(RPC_PREPARE_PUT, std::move(done)));
+        }
+
+        std::shared_ptr<ShardedStore::Prepare> start_multi_prepare_put(const StorageMultiPutRequest* request, StorageMultiPutResponse* response,
+                                                                       std::function<void()> done) {
+            return start_prepare(multi_put_entries(request), request->txn_id(), request->priority(), response,
+                                 timed(RPC_MULTI_PREPARE_PUT, std::move(done)));
+        }
+
+        void cancel_prepare(const std::shared_ptr<ShardedStore::Prepare>& prepare) {
+            store.cancel(prepare);
+        }
+
+        // Hand hinted writes to the nodes they were meant for once those answer again, in
+        // batches of their current values, dropping the hints that were delivered. Hints are
+        // kept in memory only. Never returns.
+        void run_handoff() {
+            while (true) {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+
+                std::map<string, vector<string>> batches;
+                {
+                    auto lock = lock_metered(hints_mutex, hints_locks);
+                    for (const auto& [storage_node, keys] : hints) {
+                        auto end = keys.begin();
+                        std::advance(end, std::min<size_t>(keys.size(), HANDOFF_BATCH));
+                        batches[storage_node].assign(keys.begin(), end);
+                    }
+                }
 
-            for (const auto& value : request->values()) {
-                values.push_back(value);
+                for (const auto& [storage_node, keys] : batches) {
+                    StorageRepairRequest request;
+                    for (const auto& key : keys) {
+                        Value value;
+                        if (store.get(key, value)) {
+                            add_repair_entry(request, key, value);
+                        }
+                    }
+
+                    if (!send_repair(storage_node, request)) {
+                        continue;
+                    }
+
+                    auto lock = lock_metered(hints_mutex, hints_locks);
+                    auto& pending = hints[storage_node];
+                    for (const auto& key : keys) {
+                        pending.erase(key);
+                    }
+                    if (pending.empty()) {
+                        hints.erase(storage_node);
+                    }
+                }
             }
+        }
 
+        Status transfer(ServerContext* context, const StorageTransferRequest* request, StorageTransferResponse* response) override {
+            RpcScope scope(this, RPC_TRANSFER, context);
             {
-                std::unique_lock<std::mutex> lock(transactions_mutex);
-                transaction_cv.wait(lock, [this, &key] { 
-                    return transactions.find(key) == transactions.end(); 
-                });
-                transactions[key] = values;
+                std::lock_guard<std::mutex> lock(transfers_mutex);
+                transfers.push_back(*request);
             }
+            transfers_cv.notify_one();
 
             response->set_success(true);
             return Status::OK;
         }
 
-        Status commit_put(ServerContext* context, const StorageCommitPutRequest* request, StorageCommitPutResponse* response) override {
-            std::string key = request->key();
-            {
-                std::unique_lock<std::mutex> trans_lock(transactions_mutex);
-                if (transactions.find(key) != transactions.end()) {
-                    std::unique_lock<std::shared_mutex> kv_lock(kv_store_mutex);
-                    kv_store[key] = transactions[key];
-                    transactions.erase(key);
+        // Stream queued transfers one at a time, at most stream_rate keys per second so
+        // foreground requests keep most of the node, and report each done to the manager.
+        // Never returns.
+        void run_transfers(int stream_rate) {
+            while (true) {
+                StorageTransferRequest request;
+                {
+                    std::unique_lock<std::mutex> lock(transfers_mutex);
+                    transfers_cv.wait(lock, [this] { return !transfers.empty(); });
+                    request = std::move(transfers.front());
+                    transfers.pop_front();
+                }
+
+                size_t streamed = stream(request, stream_rate);
+                std::cout << "Streamed " << streamed << " keys to " << request.target() << std::endl;
+
+                ManagerTransferDoneRequest done_request;
+                done_request.set_transfer_id(request.transfer_id());
+                for (int attempt = 0; attempt < TRANSFER_DONE_RETRIES; attempt++) {
+                    ManagerTransferDoneResponse done_response;
+                    ClientContext context;
+                    context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(TRANSFER_DONE_TIMEOUT_MS));
+                    if (manager_stub->transfer_done(&context, done_request, &done_response).ok()) {
+                        break;
+                    }
+                    std::this_thread::sleep_for(std::chrono::seconds(1));
                 }
-                transaction_cv.notify_all();
             }
-            response->set_success(true);
-            return Status::OK;
         }
 
-        Status abort_put(ServerContext* context, const StorageAbortPutRequest* request, StorageAbortPutResponse* response) override {
-            std::string key = request->key();
-            {
-                std::unique_lock<std::mutex> lock(transactions_mutex);
-                transactions.erase(key);
-                transaction_cv.notify_all();
+        // Snapshot the store whenever snapshot_records have been logged since the last
+        // snapshot, bounding both the log on disk and the replay on restart. Never returns.
+        void run_snapshots(uint64_t snapshot_records) {
+            while (true) {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                if (log->pending_records() >= snapshot_records) {
+                    store.snapshot();
+                }
             }
-            response->set_success(true);
-            return Status::OK;
         }
 
     private:
         string node_address;
-        std::unordered_map<string, vector<string>> kv_store;
-        std::unordered_map<string, vector<string>> transactions;
-        std::shared_mutex kv_store_mutex;
-        std::mutex transactions_mutex;
-        std::condition_variable transaction_cv;
+        WriteAheadLog* log;
+        // Longest read lease granted; zero grants none
+        std::chrono::milliseconds lease;
+        ShardedStore store;
         std::unique_ptr<GTStoreManagerService::Stub> manager_stub;
+
+        // Keys written here while the node they belong on was down, by that node
+        std::mutex hints_mutex;
+        std::map<string, std::set<string>> hints;
+        // Writes prepared here for a down node and not yet committed or aborted, by
+        // transaction and key, naming that node
+        std::map<std::pair<uint64_t, string>, string> prepared_hints;
+        std::atomic<size_t> num_prepared_hints{0};
+
+        // Transfers waiting for the streaming thread
+        std::mutex transfers_mutex;
+        std::condition_variable transfers_cv;
+        std::deque<StorageTransferRequest> transfers;
+
+        std::mutex peer_stubs_mutex;
+        std::map<string, std::unique_ptr<GTStoreStorageService::Stub>> peer_stubs;
+
+        // RPCs timed in rpc_latency, from arrival to response
+        enum StorageRpc {
+            RPC_GET,
+            RPC_PREPARE_PUT,
+            RPC_COMMIT_PUT,
+            RPC_ABORT_PUT,
+            RPC_PUT,
+            RPC_CHAIN_PUT,
+            RPC_MULTI_GET,
+            RPC_MULTI_PREPARE_PUT,
+            RPC_MULTI_COMMIT_PUT,
+            RPC_MULTI_ABORT_PUT,
+            RPC_REPAIR,
+            RPC_TRANSFER,
+            RPC_SCAN,
+            NUM_STORAGE_RPCS
+        };
+        static constexpr const char* rpc_names[NUM_STORAGE_RPCS] = {
+            "get", "prepare_put", "commit_put", "abort_put", "put", "chain_put", "multi_get",
+            "multi_prepare_put", "multi_commit_put", "multi_abort_put", "repair", "transfer", "scan"
+        };
+
+        MetricHistogram rpc_latency[NUM_STORAGE_RPCS];
+        LockMetrics hints_locks;
+        MetricsRegistry metrics;
+        MetricsHttpServer metrics_server;
+
+        void register_metrics() {
+            for (int rpc = 0; rpc < NUM_STORAGE_RPCS; rpc++) {
+                metrics.histogram("gtstore_rpc_latency_us", "Time from a request's arrival to its response, by RPC",
+                                  {{"rpc", rpc_names[rpc]}}, rpc_latency[rpc]);
+            }
+
+            metrics.lock("shard", store.shard_locks);
+            metrics.lock("engine", store.engine_locks());
+            metrics.lock("hints", hints_locks);
+            metrics.histogram("gtstore_key_queue_wait_us", "Time prepares waited in key queues for other transactions", {},
+                              store.queue_wait_us);
+            metrics.counter("gtstore_prepare_conflicts_total", "Prepares failed by wait-die instead of queuing", {}, store.conflicts);
+            metrics.histogram("gtstore_lease_wait_us", "Time commits waited for read leases on their keys to run out", {},
+                              store.lease_wait_us);
+            metrics.histogram("gtstore_log_sync_us", "Time commits waited for the write-ahead log to sync", {}, store.log_sync_us);
+
+            metrics.gauge("gtstore_locked_keys", "Keys held by prepared or committing transactions", {}, [this] {
+                return static_cast<double>(store.locked_keys());
+            });
+            metrics.gauge("gtstore_keys", "Keys stored", {}, [this] {
+                uint64_t keys, bytes;
+                store.usage(keys, bytes);
+                return static_cast<double>(keys);
+            });
+            metrics.gauge("gtstore_stored_bytes", "Bytes of the keys and values stored", {}, [this] {
+                uint64_t keys, bytes;
+                store.usage(keys, bytes);
+                return static_cast<double>(bytes);
+            });
+            metrics.gauge("gtstore_hinted_keys", "Keys waiting for handoff to a node that was down", {}, [this] {
+                auto lock = lock_metered(hints_mutex, hints_locks);
+                size_t count = 0;
+                for (const auto& [storage_node, keys] : hints) {
+                    count += keys.size();
+                }
+                return static_cast<double>(count);
+            });
+        }
+
+        // Run a handler that calls done when it finishes, which may be on another thread, to its
+        // end, for the sync server
+        template <class Request, class Response>
+        void wait_for(void (GTStoreStorageImpl::*start)(const Request*, Response*, std::function<void()>), const Request* request, Response* response) {
+            std::promise<void> answered;
+            (this->*start)(request, response, [&answered] {
+                answered.set_value();
+            });
+            answered.get_future().wait();
+        }
+
+        // done, recording the time from now until it is called as the latency of rpc and as a
+        // span under the thread's current one. The span becomes the current one, so the caller
+        // runs in a TraceScope that puts the thread back afterwards.
+        std::function<void()> timed(StorageRpc rpc, std::function<void()> done) {
+            auto start = std::chrono::steady_clock::now();
+            auto span = std::make_shared<DeferredSpan>(TraceSpan::current(), rpc_names[rpc]);
+            TraceSpan::current() = span->context();
+            return [this, rpc, start, span, done = std::move(done)] {
+                rpc_latency[rpc].record(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+                span->finish();
+                done();
+            };
+        }
+
+        // Times a handler into rpc_latency and traces it under the caller's span
+        class RpcScope {
+            public:
+                RpcScope(GTStoreStorageImpl* impl, StorageRpc rpc, const ServerContext* context)
+                    : timer(impl->rpc_latency[rpc]), span(trace_extract(context), rpc_names[rpc]) {}
+
+            private:
+                MetricTimer timer;
+                TraceSpan span;
+        };
+
+        // A chain write passed to the next node, finished by run_forwarding
+        struct ForwardCall {
+            ClientContext context;
+            StorageChainPutRequest request;
+            StorageChainPutResponse response;
+            Status status;
+            std::unique_ptr<grpc::ClientAsyncResponseReader<StorageChainPutResponse>> reader;
+            std::function<void()> done;
+            RpcTrace trace;
+        };
+        grpc::CompletionQueue forward_cq;
+
+        GTStoreStorageService::Stub* peer_stub(const std::string& storage_node) {
+            std::lock_guard<std::mutex> lock(peer_stubs_mutex);
+            auto& stub = peer_stubs[storage_node];
+            if (!stub) {
+                stub = GTStoreStorageService::NewStub(grpc::CreateChannel(storage_node, grpc::InsecureChannelCredentials()));
+            }
+            return stub.get();
+        }
+
+        static void add_repair_entry(StorageRepairRequest& request, const std::string& key, const Value& value) {
+            StorageRepairEntry* entry = request.add_entries();
+            entry->set_key(key);
+            for (size_t i = 0; i < value.size(); i++) {
+                entry->add_values(value[i].data(), value[i].size());
+            }
+            entry->set_version(value.version());
+            entry->set_encoding(value.encoding());
+        }
+
+        bool send_repair(const std::string& storage_node, const StorageRepairRequest& request) {
+            StorageRepairResponse response;
+            ClientContext context;
+            context.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(1));
+            return peer_stub(storage_node)->repair(&context, request, &response).ok();
+        }
+
+        // Send the target of a transfer every key in its ranges, in chunks paced to stream_rate
+        // keys per second. Returns the keys delivered.
+        size_t stream(const StorageTransferRequest& request, int stream_rate) {
+            HashRanges ranges(request.ranges());
+            StorageRepairRequest chunk;
+            size_t streamed = 0;
+            bool failed = false;
+            auto start = std::chrono::steady_clock::now();
+
+            auto send_chunk = [&] {
+                for (int attempt = 0; !failed && !send_repair(request.target(), chunk); attempt++) {
+                    if (attempt + 1 == STREAM_RETRIES) {
+                        std::cerr << "Giving up streaming to " << request.target() << std::endl;
+                        failed = true;
+                    }
+                    std::this_thread::sleep_for(std::chrono::seconds(1));
+                }
+                if (!failed) {
+                    streamed += chunk.entries_size();
+                }
+                chunk.Clear();
+                std::this_thread::sleep_until(start + std::chrono::microseconds(streamed * 1000000 / stream_rate));
+            };
+
+            store.for_each([&](const std::string& key, const Value& value) {
+                if (failed || !ranges.contains(request.key_order() ? key_position(key) : stable_hash(key))) {
+                    return;
+                }
+                add_repair_entry(chunk, key, value);
+                if (chunk.entries_size() >= STREAM_CHUNK) {
+                    send_chunk();
+                }
+            });
+
+            if (chunk.entries_size() > 0) {
+                send_chunk();
+            }
+            return streamed;
+        }
+
+        // A value is packed into its immutable buffer once, here; staging, commit and GETs
+        // after that only pass the buffer along. Writes this node takes for a down replica are
+        // noted when prepared, and only become hints to hand off once they commit.
+        void take_values(const StoragePutRequest& request, uint64_t txn_id, std::pair<string, Value>& entry) {
+            entry.first = request.key();
+            entry.second = Value::copy_of(request.values(), 0, request.encoding());
+
+            if (!request.hint_for().empty()) {
+                auto lock = lock_metered(hints_mutex, hints_locks);
+                if (prepared_hints.emplace(std::make_pair(txn_id, request.key()), request.hint_for()).second) {
+                    num_prepared_hints++;
+                }
+            }
+        }
+
+        vector<std::pair<string, Value>> put_entries(const StoragePutRequest* request) {
+            vector<std::pair<string, Value>> entries(1);
+            take_values(*request, request->txn_id(), entries[0]);
+            return entries;
+        }
+
+        vector<std::pair<string, Value>> multi_put_entries(const StorageMultiPutRequest* request) {
+            vector<std::pair<string, Value>> entries(request->entries_size());
+
+            for (int i = 0; i < request->entries_size(); i++) {
+                take_values(request->entries(i), request->txn_id(), entries[i]);
+            }
+            return entries;
+        }
+
+        // Keys of entries that may have been noted for hints, to drop if their prepare fails
+        vector<string> hinted_keys(const vector<std::pair<string, Value>>& entries) {
+            vector<string> keys;
+            if (num_prepared_hints > 0) {
+                for (const auto& entry : entries) {
+                    keys.push_back(entry.first);
+                }
+            }
+            return keys;
+        }
+
+        // Turn the noted hints of txn_id's writes of keys into hints to hand off if the writes
+        // committed, or drop them
+        template <class KeyIt>
+        void settle_hints(KeyIt first, KeyIt last, uint64_t txn_id, bool committed) {
+            if (num_prepared_hints == 0) {
+                return;
+            }
+            auto lock = lock_metered(hints_mutex, hints_locks);
+            for (KeyIt key = first; key != last; ++key) {
+                auto it = prepared_hints.find(std::make_pair(txn_id, *key));
+                if (it == prepared_hints.end()) {
+                    continue;
+                }
+                if (committed) {
+                    hints[it->second].insert(*key);
+                }
+                prepared_hints.erase(it);
+                num_prepared_hints--;
+            }
+        }
+
+        // Serialize a shared value straight into the response: the store is no longer
+        // locked, and each element is copied once, into the message gRPC sends
+        static void add_values(const Value& value, StorageGetResponse* response) {
+            response->mutable_values()->Reserve(value.size());
+            for (size_t i = 0; i < value.size(); i++) {
+                response->add_values(value[i].data(), value[i].size());
+            }
+            response->set_version(value.version());
+            response->set_encoding(value.encoding());
+        }
+
+        template <class Response>
+        std::shared_ptr<ShardedStore::Prepare> start_prepare(vector<std::pair<string, Value>> entries, uint64_t txn_id, uint64_t priority,
+                                                             Response* response, std::function<void()> done) {
+            vector<string> hinted = hinted_keys(entries);
+            auto prepare = store.make_prepare(std::move(entries), txn_id, priority, [this, response, done, hinted, txn_id](bool prepared) {
+                if (!prepared) {
+                    settle_hints(hinted.begin(), hinted.end(), txn_id, false);
+                }
+                else {
+                    response->set_version(store.next_version());
+                }
+                response->set_success(prepared);
+                done();
+            });
+            store.start(prepare);
+            return prepare;
+        }
+};
+
+// Completion-queue event handed back to an AsyncCall, identifying which of its operations finished
+class AsyncCall;
+struct AsyncTag {
+    AsyncCall* call;
+    void (AsyncCall::*event)(bool ok);
+};
+
+// One RPC of the async server, from the moment it is requested from the completion queue
+// until both its response has been sent and the call is done. A handler may finish the
+// call from any thread, so a prepare parked in a key queue holds no thread at all; if the
+// client cancels or its deadline passes first, the on_cancel hook withdraws the prepare.
+class AsyncCall {
+    public:
+        virtual ~AsyncCall() {}
+
+        void finish(const Status& status) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished) {
+                return;
+            }
+            finished = true;
+            send(status);
+        }
+
+        ServerContext* server_context() {
+            return &context;
+        }
+
+        // Run fn if the call is cancelled. Runs at once if that has already happened.
+        void set_on_cancel(std::function<void()> fn) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!cancelled) {
+                    on_cancel = std::move(fn);
+                    return;
+                }
+            }
+            fn();
+        }
+
+    protected:
+        ServerContext context;
+        AsyncTag request_tag{this, &AsyncCall::on_request};
+        AsyncTag finish_tag{this, &AsyncCall::on_finish};
+        AsyncTag done_tag{this, &AsyncCall::on_done};
+
+        // Finish tag, done tag
+        std::atomic<int> pending{2};
+
+        virtual void on_request(bool ok) = 0;
+        virtual void send(const Status& status) = 0;
+
+    private:
+        std::mutex mutex;
+        bool finished = false;
+        bool cancelled = false;
+        std::function<void()> on_cancel;
+
+        void on_finish(bool ok) {
+            unref();
+        }
+
+        void on_done(bool ok) {
+            std::function<void()> fn;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                cancelled = context.IsCancelled();
+                if (cancelled) {
+                    fn = std::move(on_cancel);
+                }
+                on_cancel = nullptr;
+            }
+            if (fn) {
+                fn();
+            }
+            unref();
+        }
+
+        void unref() {
+            if (--pending == 0) {
+                delete this;
+            }
+        }
+};
+
+// A scan on the async server. Each batch is read once the previous one was sent, so a scan
+// holds a polling thread only while it reads a batch, and a slow reader only holds memory
+// for one.
+class AsyncScanCall final : public AsyncCall {
+    public:
+        // Post a call waiting for the next scan on cq
+        static void listen(GTStoreStorageService::AsyncService* service, grpc::ServerCompletionQueue* cq, GTStoreStorageImpl* impl) {
+            new AsyncScanCall(service, cq, impl);
+        }
+
+    private:
+        GTStoreStorageService::AsyncService* service;
+        grpc::ServerCompletionQueue* cq;
+        GTStoreStorageImpl* impl;
+        grpc::ServerAsyncWriter<StorageScanResponse> writer;
+        AsyncTag write_tag{this, static_cast<void (AsyncCall::*)(bool)>(&AsyncScanCall::on_write)};
+
+        StorageScanRequest request;
+        StorageScanResponse batch;
+        std::string cursor;
+        uint32_t sent = 0;
+        bool more = true;
+        // Records the scan's latency and span, see GTStoreStorageImpl::start_scan
+        std::function<void()> scan_done;
+
+        AsyncScanCall(GTStoreStorageService::AsyncService* service, grpc::ServerCompletionQueue* cq, GTStoreStorageImpl* impl)
+            : service(service), cq(cq), impl(impl), writer(&context) {
+            context.AsyncNotifyWhenDone(&done_tag);
+            service->Requestscan(&context, &request, &writer, cq, cq, &request_tag);
+        }
+
+        void on_request(bool ok) override {
+            if (!ok) {
+                // Server shutting down; the call never started, so no done tag will follow
+                delete this;
+                return;
+            }
+            listen(service, cq, impl);
+
+            TraceScope scope(trace_extract(&context));
+            scan_done = impl->start_scan();
+            cursor = request.start_key();
+            write_next();
+        }
+
+        void write_next() {
+            batch.Clear();
+            more = impl->scan_batch(request, cursor, sent, &batch);
+            if (batch.entries_size() == 0) {
+                end(Status::OK);
+                return;
+            }
+            writer.Write(batch, &write_tag);
+        }
+
+        void on_write(bool ok) {
+            if (!ok) {
+                // The client went away
+                end(Status::CANCELLED);
+            }
+            else if (!more) {
+                end(Status::OK);
+            }
+            else {
+                write_next();
+            }
+        }
+
+        void end(const Status& status) {
+            scan_done();
+            finish(status);
+        }
+
+        void send(const Status& status) override {
+            writer.Finish(status, &finish_tag);
+        }
+};
+
+template <class Request, class Response>
+class AsyncUnaryCall final : public AsyncCall {
+    public:
+        using RequestMethod = void (GTStoreStorageService::AsyncService::*)(ServerContext*, Request*, grpc::ServerAsyncResponseWriter<Response>*,
+                                                                           grpc::CompletionQueue*, grpc::ServerCompletionQueue*, void*);
+        using Handler = std::function<void(AsyncUnaryCall*)>;
+
+        Request request;
+        Response response;
+
+        // Post a call waiting for the next request of this method on cq
+        static void listen(GTStoreStorageService::AsyncService* service, grpc::ServerCompletionQueue* cq, RequestMethod method, Handler handler) {
+            new AsyncUnaryCall(service, cq, method, std::move(handler));
+        }
+
+    private:
+        GTStoreStorageService::AsyncService* service;
+        grpc::ServerCompletionQueue* cq;
+        RequestMethod method;
+        Handler handler;
+        grpc::ServerAsyncResponseWriter<Response> responder;
+
+        AsyncUnaryCall(GTStoreStorageService::AsyncService* service, grpc::ServerCompletionQueue* cq, RequestMethod method, Handler handler)
+            : service(service), cq(cq), method(method), handler(std::move(handler)), responder(&context) {
+            context.AsyncNotifyWhenDone(&done_tag);
+            (service->*method)(&context, &request, &responder, cq, cq, &request_tag);
+        }
+
+        void on_request(bool ok) override {
+            if (!ok) {
+                // Server shutting down; the call never started, so no done tag will follow
+                delete this;
+                return;
+            }
+            listen(service, cq, method, handler);
+            handler(this);
+        }
+
+        void send(const Status& status) override {
+            responder.Finish(response, status, &finish_tag);
+        }
+};
+
+// Storage server on gRPC's async API. Every RPC is a heap object driven by completion-queue
+// events, polled by a fixed pool of threads, one completion queue each (so a call's events
+// never race with its own handler). Handlers that never
+// block run inline on the polling thread; prepares that have to wait in a key queue leave
+// the thread and are finished by whichever thread releases their keys.
+class GTStoreStorageAsyncServer {
+    public:
+        GTStoreStorageAsyncServer(GTStoreStorageImpl& impl, int num_threads) : impl(impl), num_threads(num_threads) {}
+
+        void run(ServerBuilder& builder) {
+            builder.RegisterService(&service);
+            for (int i = 0; i < num_threads; i++) {
+                cqs.push_back(builder.AddCompletionQueue());
+            }
+            server = builder.BuildAndStart();
+
+            for (auto& cq : cqs) {
+                listen(cq.get());
+            }
+
+            vector<std::thread> threads;
+            for (auto& cq : cqs) {
+                threads.emplace_back(&GTStoreStorageAsyncServer::poll, cq.get());
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        }
+
+    private:
+        GTStoreStorageImpl& impl;
+        int num_threads;
+        GTStoreStorageService::AsyncService service;
+        vector<std::unique_ptr<grpc::ServerCompletionQueue>> cqs;
+        std::unique_ptr<Server> server;
+
+        using AsyncService = GTStoreStorageService::AsyncService;
+
+        // Serve a method whose handler never blocks by running the sync handler inline
+        template <class Request, class Response>
+        void listen_inline(grpc::ServerCompletionQueue* cq, typename AsyncUnaryCall<Request, Response>::RequestMethod method,
+                           Status (GTStoreStorageImpl::*handler)(ServerContext*, const Request*, Response*)) {
+            GTStoreStorageImpl* impl = &this->impl;
+            AsyncUnaryCall<Request, Response>::listen(&service, cq, method, [impl, handler](AsyncUnaryCall<Request, Response>* call) {
+                call->finish((impl->*handler)(call->server_context(), &call->request, &call->response));
+            });
+        }
+
+        // Serve a prepare method, which finishes its call once the prepare resolves
+        template <class Request, class Response>
+        void listen_prepare(grpc::ServerCompletionQueue* cq, typename AsyncUnaryCall<Request, Response>::RequestMethod method,
+                            std::shared_ptr<ShardedStore::Prepare> (GTStoreStorageImpl::*start)(const Request*, Response*, std::function<void()>)) {
+            GTStoreStorageImpl* impl = &this->impl;
+            AsyncUnaryCall<Request, Response>::listen(&service, cq, method, [impl, start](AsyncUnaryCall<Request, Response>* call) {
+                TraceScope scope(trace_extract(call->server_context()));
+                auto prepare = (impl->*start)(&call->request, &call->response, [call] {
+                    call->finish(Status::OK);
+                });
+                call->set_on_cancel([impl, prepare] {
+                    impl->cancel_prepare(prepare);
+                });
+            });
+        }
+
+        // As above, for a handler that needs the call's context too, e.g. for its deadline
+        template <class Request, class Response>
+        void listen_prepare(grpc::ServerCompletionQueue* cq, typename AsyncUnaryCall<Request, Response>::RequestMethod method,
+                            std::shared_ptr<ShardedStore::Prepare> (GTStoreStorageImpl::*start)(ServerContext*, const Request*, Response*,
+                                                                                                std::function<void()>)) {
+            GTStoreStorageImpl* impl = &this->impl;
+            AsyncUnaryCall<Request, Response>::listen(&service, cq, method, [impl, start](AsyncUnaryCall<Request, Response>* call) {
+                TraceScope scope(trace_extract(call->server_context()));
+                auto prepare = (impl->*start)(call->server_context(), &call->request, &call->response, [call] {
+                    call->finish(Status::OK);
+                });
+                call->set_on_cancel([impl, prepare] {
+                    impl->cancel_prepare(prepare);
+                });
+            });
+        }
+
+        // Serve a method whose handler finishes the call later, from a callback
+        template <class Request, class Response>
+        void listen_deferred(grpc::ServerCompletionQueue* cq, typename AsyncUnaryCall<Request, Response>::RequestMethod method,
+                             void (GTStoreStorageImpl::*start)(const Request*, Response*, std::function<void()>)) {
+            GTStoreStorageImpl* impl = &this->impl;
+            AsyncUnaryCall<Request, Response>::listen(&service, cq, method, [impl, start](AsyncUnaryCall<Request, Response>* call) {
+                TraceScope scope(trace_extract(call->server_context()));
+                (impl->*start)(&call->request, &call->response, [call] {
+                    call->finish(Status::OK);
+                });
+            });
+        }
+
+        void listen(grpc::ServerCompletionQueue* cq) {
+            listen_inline(cq, &AsyncService::Requestget, &GTStoreStorageImpl::get);
+            listen_prepare(cq, &AsyncService::Requestprepare_put, &GTStoreStorageImpl::start_prepare_put);
+            listen_deferred(cq, &AsyncService::Requestcommit_put, &GTStoreStorageImpl::start_commit_put);
+            listen_inline(cq, &AsyncService::Requestabort_put, &GTStoreStorageImpl::abort_put);
+            listen_deferred(cq, &AsyncService::Requestput, &GTStoreStorageImpl::start_put);
+            listen_prepare(cq, &AsyncService::Requestchain_put, &GTStoreStorageImpl::start_chain_put);
+            listen_inline(cq, &AsyncService::Requestmulti_get, &GTStoreStorageImpl::multi_get);
+            listen_prepare(cq, &AsyncService::Requestmulti_prepare_put, &GTStoreStorageImpl::start_multi_prepare_put);
+            listen_deferred(cq, &AsyncService::Requestmulti_commit_put, &GTStoreStorageImpl::start_multi_commit_put);
+            listen_inline(cq, &AsyncService::Requestmulti_abort_put, &GTStoreStorageImpl::multi_abort_put);
+            listen_deferred(cq, &AsyncService::Requestrepair, &GTStoreStorageImpl::start_repair);
+            listen_inline(cq, &AsyncService::Requesttransfer, &GTStoreStorageImpl::transfer);
+            listen_inline(cq, &AsyncService::Requeststats, &GTStoreStorageImpl::stats);
+            listen_inline(cq, &AsyncService::Requesttrace, &GTStoreStorageImpl::trace);
+            AsyncScanCall::listen(&service, cq, &impl);
+        }
+
+        static void poll(grpc::ServerCompletionQueue* cq) {
+            void* tag;
+            bool ok;
+            while (cq->Next(&tag, &ok)) {
+                AsyncTag* event = static_cast<AsyncTag*>(tag);
+                (event->call->*event->event)(ok);
+            }
+        }
 };
 
-void GTStoreStorage::init(int node_id) {
+void GTStoreStorage::init(int node_id, const GTStoreStorageOptions& options) {
     string manager_address = "0.0.0.0:50000";
     string node_address = "0.0.0.0:" + std::to_string(50000 + node_id);
 
+    std::unique_ptr<StorageEngine> engine;
+    if (options.engine == GTStoreEngine::LOG) {
+        string engine_dir = options.engine_dir;
+        if (engine_dir.empty()) {
+            engine_dir = options.data_dir.empty() ? "gtstore_engine" : options.data_dir + "/engine";
+        }
+        engine.reset(new LogEngine(engine_dir + "/node" + std::to_string(node_id)));
+    }
+    else {
+        engine.reset(new MemoryEngine());
+    }
+
+    std::unique_ptr<WriteAheadLog> log;
+    if (!options.data_dir.empty()) {
+        log.reset(new WriteAheadLog(options.data_dir + "/node" + std::to_string(node_id), options.durability));
+    }
+
     auto channel = grpc::CreateChannel(manager_address, grpc::InsecureChannelCredentials());
-    GTStoreStorageImpl service(node_address, channel);
+    GTStoreStorageImpl service(node_address, channel, std::move(engine), log.get(), options.lease_ms);
+
+    if (log) {
+        std::thread(&GTStoreStorageImpl::run_snapshots, &service, options.snapshot_records).detach();
+    }
+    std::thread(&GTStoreStorageImpl::run_handoff, &service).detach();
+    std::thread(&GTStoreStorageImpl::run_transfers, &service, options.stream_rate).detach();
+    std::thread(&GTStoreStorageImpl::run_forwarding, &service).detach();
+
+    if (options.metrics_port > 0) {
+        int metrics_port = options.metrics_port + node_id;
+        if (service.serve_metrics(metrics_port)) {
+            std::cout << "Serving metrics on port " << metrics_port << std::endl;
+        }
+        else {
+            std::cerr << "Cannot serve metrics on port " << metrics_port << std::endl;
+        }
+    }
 
     ServerBuilder builder;
     builder.AddListeningPort(node_address, grpc::InsecureServerCredentials());
+    // Accept the keepalive pings of pooled client connections, with room for pings that
+    // arrive early, which the server would otherwise answer with GOAWAY too_many_pings
+    builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, 1);
+    builder.AddChannelArgument(GRPC_ARG_HTTP2_MIN_RECV_PING_INTERVAL_WITHOUT_DATA_MS, CHANNEL_KEEPALIVE_MS / 2);
+
+    if (options.async) {
+        GTStoreStorageAsyncServer server(service, options.cq_threads);
+        std::cout << "Storage node initialized on " << node_address << " (async, " << options.cq_threads << " completion queue threads)" << std::endl;
+        server.run(builder);
+        return;
+    }
+
     builder.RegisterService(&service);
 
     std::unique_ptr<Server> server(builder.BuildAndStart());
@@ -106,14 +1985,113 @@ void GTStoreStorage::init(int node_id) {
     server->Wait();
 }
 
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " <node_id> [options]\n"
+              << "Options:\n"
+              << "  --mode <sync|async>   gRPC server API to serve with (default: sync)\n"
+              << "  --cq-threads <n>      Completion queue threads in async mode (default: 4)\n"
+              << "  --data-dir <path>     Log commits and snapshots under <path>/node<id> and reload them on start\n"
+              << "  --durability <mode>   With --data-dir, when commits reach disk: none, batched or per-write (default: batched)\n"
+              << "  --snapshot-every <n>  With --data-dir, snapshot after n logged records (default: 1000000)\n"
+              << "  --engine <memory|log> Keep values on the heap, or in memory-mapped segment files (default: memory)\n"
+              << "  --engine-dir <path>   Segment files of the log engine go under <path>/node<id> (default: <data-dir>/engine, or ./gtstore_engine)\n"
+              << "  --stream-rate <n>     Keys per second streamed to nodes taking over ranges (default: 20000)\n"
+              << "  --lease-ms <n>        Read lease granted to caching clients, 0 for none (default: 20)\n"
+              << "  --metrics-port <n>    Serve Prometheus metrics over HTTP on port n + node_id (default: none)\n";
+}
+
 int main(int argc, char **argv) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <node_id>" << std::endl;
+    static struct option long_options[] = {
+        {"mode", required_argument, 0, 'm'},
+        {"cq-threads", required_argument, 0, 'q'},
+        {"data-dir", required_argument, 0, 'd'},
+        {"durability", required_argument, 0, 'u'},
+        {"snapshot-every", required_argument, 0, 's'},
+        {"engine", required_argument, 0, 'e'},
+        {"engine-dir", required_argument, 0, 'g'},
+        {"stream-rate", required_argument, 0, 'r'},
+        {"lease-ms", required_argument, 0, 'l'},
+        {"metrics-port", required_argument, 0, 'p'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    GTStoreStorageOptions options;
+
+    int opt;
+    int option_index = 0;
+    while ((opt = getopt_long(argc, argv, "m:q:d:u:s:e:g:r:l:p:h", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'm':
+                if (string(optarg) == "async") {
+                    options.async = true;
+                }
+                else if (string(optarg) != "sync") {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'q':
+                options.cq_threads = std::stoi(optarg);
+                break;
+            case 'd':
+                options.data_dir = optarg;
+                break;
+            case 'u':
+                if (string(optarg) == "none") {
+                    options.durability = GTStoreDurability::NONE;
+                }
+                else if (string(optarg) == "batched") {
+                    options.durability = GTStoreDurability::BATCHED;
+                }
+                else if (string(optarg) == "per-write") {
+                    options.durability = GTStoreDurability::PER_WRITE;
+                }
+                else {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 's':
+                options.snapshot_records = std::stoull(optarg);
+                break;
+            case 'e':
+                if (string(optarg) == "log") {
+                    options.engine = GTStoreEngine::LOG;
+                }
+                else if (string(optarg) != "memory") {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'g':
+                options.engine_dir = optarg;
+                break;
+            case 'r':
+                options.stream_rate = std::stoi(optarg);
+                break;
+            case 'l':
+                options.lease_ms = std::stoi(optarg);
+                break;
+            case 'p':
+                options.metrics_port = std::stoi(optarg);
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc - 1 || options.cq_threads < 1 || options.snapshot_records < 1 || options.stream_rate < 1 || options.lease_ms < 0 || options.metrics_port < 0) {
+        print_usage(argv[0]);
         return 1;
     }
 
-    int node_id = std::stoi(argv[1]);
+    int node_id = std::stoi(argv[optind]);
 
     GTStoreStorage storage;
-    storage.init(node_id);
+    storage.init(node_id, options);
 }
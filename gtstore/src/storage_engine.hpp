@@ -0,0 +1,126 @@
+#ifndef GTSTORE_STORAGE_ENGINE
+#define GTSTORE_STORAGE_ENGINE
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <functional>
+#include <utility>
+#include "value.hpp"
+#include "metrics.hpp"
+#include "ordered_index.hpp"
+
+// Number of independently locked stripes an engine splits its keys into, a power of two
+#define NUM_ENGINE_SHARDS 64
+
+// Where a storage node keeps its committed values. The node's transaction locks sit in
+// front of the engine, so an engine only sees whole committed values, and may see puts
+// for different keys from many threads at once.
+class StorageEngine {
+    public:
+        virtual ~StorageEngine() {}
+
+        virtual bool get(const std::string& key, Value& value) = 0;
+        virtual void put(const std::string& key, Value value) = 0;
+
+        // Call fn for every key and its value, with no engine lock held. Keys put while
+        // this runs may or may not be visited.
+        virtual void for_each(const std::function<void(const std::string&, const Value&)>& fn) = 0;
+
+        // Number of keys held, and bytes of their keys and values as the engine stores them
+        virtual void usage(uint64_t& keys, uint64_t& bytes) = 0;
+
+        // Call fn for the keys from start up to end (excluded; empty for no bound) in order, with
+        // their values, until fn returns false. Keys put while this runs may or may not be
+        // visited, and each value is read as the scan reaches it.
+        void scan(const std::string& start, const std::string& end, const std::function<bool(const std::string&, const Value&)>& fn) {
+            Value value;
+            ordered_keys.scan(start, end, [&](const std::string& key) {
+                return !get(key, value) || fn(key, value);
+            });
+        }
+
+        // Waits on the engine's stripe locks
+        LockMetrics stripe_locks;
+
+    protected:
+        // Every key held; engines add a key once its first value is visible to get. It lives
+        // on the heap whatever the engine, about 60 bytes per key plus keys past 15 bytes.
+        OrderedIndex ordered_keys;
+};
+
+// Every value on the heap, in a hash map per stripe
+class MemoryEngine final : public StorageEngine {
+    public:
+        bool get(const std::string& key, Value& value) override {
+            Shard& shard = shard_for(key);
+            auto lock = lock_shared_metered(shard.mutex, stripe_locks);
+            auto it = shard.kv_store.find(key);
+
+            if (it == shard.kv_store.end()) {
+                return false;
+            }
+
+            value = it->second;
+            return true;
+        }
+
+        void put(const std::string& key, Value value) override {
+            Shard& shard = shard_for(key);
+            bool inserted;
+            {
+                auto lock = lock_metered(shard.mutex, stripe_locks);
+                auto [it, added] = shard.kv_store.try_emplace(key);
+                shard.bytes += (added ? key.size() : 0) + value.bytes() - it->second.bytes();
+                it->second = std::move(value);
+                inserted = added;
+            }
+            if (inserted) {
+                ordered_keys.insert(key);
+            }
+        }
+
+        // Copies one stripe at a time, by reference to its values, so puts stall only briefly
+        void for_each(const std::function<void(const std::string&, const Value&)>& fn) override {
+            std::vector<std::pair<std::string, Value>> entries;
+
+            for (Shard& shard : shards) {
+                {
+                    auto lock = lock_shared_metered(shard.mutex, stripe_locks);
+                    entries.assign(shard.kv_store.begin(), shard.kv_store.end());
+                }
+                for (const auto& [key, value] : entries) {
+                    fn(key, value);
+                }
+            }
+        }
+
+        void usage(uint64_t& keys, uint64_t& bytes) override {
+            keys = 0;
+            bytes = 0;
+            for (Shard& shard : shards) {
+                std::shared_lock<std::shared_mutex> lock(shard.mutex);
+                keys += shard.kv_store.size();
+                bytes += shard.bytes;
+            }
+        }
+
+    private:
+        struct Shard {
+            std::unordered_map<std::string, Value> kv_store;
+            // Of every key and value in kv_store
+            size_t bytes = 0;
+            std::shared_mutex mutex;
+        };
+
+        Shard shards[NUM_ENGINE_SHARDS];
+        std::hash<std::string> hasher;
+
+        Shard& shard_for(const std::string& key) {
+            return shards[hasher(key) & (NUM_ENGINE_SHARDS - 1)];
+        }
+};
+
+#endif
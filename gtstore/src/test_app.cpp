@@ -12,6 +12,7 @@ void print_usage() {
               << "  --val <value>       Value for put operation (required with --put)\n"
               << "  --get <key>         Get a key\n"
               << "  --id <client_id>    Client ID (default: 1)\n"
+              << "  --consistency <level> Replicas that must answer: one, quorum or all (default: one for get, all for put)\n"
               << "  --verbose           Enable verbose output\n"
               << "  --help              Show this help message\n";
 }
@@ -22,6 +23,7 @@ int main(int argc, char** argv) {
         {"val", required_argument, 0, 'v'},
         {"get", required_argument, 0, 'g'},
         {"id", required_argument, 0, 'i'},
+        {"consistency", required_argument, 0, 'c'},
         {"verbose", no_argument, 0, 'V'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
@@ -33,10 +35,11 @@ int main(int argc, char** argv) {
     bool is_put = false;
     bool is_get = false;
     bool verbose = false;
+    std::string consistency;
 
     int opt;
     int option_index = 0;
-    while ((opt = getopt_long(argc, argv, "p:v:g:i:Vh", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "p:v:g:i:c:Vh", long_options, &option_index)) != -1) {
         switch (opt) {
             case 'p':
                 is_put = true;
@@ -52,6 +55,9 @@ int main(int argc, char** argv) {
             case 'i':
                 client_id = std::stoi(optarg);
                 break;
+            case 'c':
+                consistency = optarg;
+                break;
             case 'V':
                 verbose = true;
                 break;
@@ -80,13 +86,29 @@ int main(int argc, char** argv) {
         return 1;
     }
 
+    if (!consistency.empty() && consistency != "one" && consistency != "quorum" && consistency != "all") {
+        std::cerr << "Error: --consistency must be one, quorum or all\n";
+        return 1;
+    }
+    GTStoreConsistency get_consistency = GTStoreConsistency::ONE;
+    GTStoreConsistency put_consistency = GTStoreConsistency::ALL;
+    if (consistency == "one") {
+        get_consistency = put_consistency = GTStoreConsistency::ONE;
+    }
+    else if (consistency == "quorum") {
+        get_consistency = put_consistency = GTStoreConsistency::QUORUM;
+    }
+    else if (consistency == "all") {
+        get_consistency = put_consistency = GTStoreConsistency::ALL;
+    }
+
     // Initialize client
     GTStoreClient client;
     client.init(client_id, verbose);
 
     // Perform operation
     if (is_get) {
-        val_t result = client.get(key);
+        val_t result = client.get(key, get_consistency);
         if (!result.empty()) {
             return 0;
         } else {
@@ -94,7 +116,7 @@ int main(int argc, char** argv) {
             return 1;
         }
     } else if (is_put) {
-        if (!client.put(key, {value}).empty()) {
+        if (!client.put(key, {value}, put_consistency).empty()) {
             return 0;
         } else {
             std::cerr << "Error: Put operation failed\n";
@@ -0,0 +1,351 @@
+#ifndef GTSTORE_TRACE
+#define GTSTORE_TRACE
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <chrono>
+#include <unordered_set>
+#include <utility>
+#include <cstdint>
+#include <cstdio>
+#include <cinttypes>
+
+// Spans a process keeps, a power of two; older ones are overwritten
+#define TRACE_BUFFER_SPANS 16384
+// gRPC metadata entry carrying the caller's trace id and span id, as two hex numbers
+#define TRACE_METADATA_KEY "gtstore-trace"
+
+// Where a traced request is: the trace it belongs to and the span now running. A request not
+// sampled has no trace id and records nothing, on any process it reaches.
+struct TraceContext {
+    uint64_t trace_id = 0;
+    uint64_t span_id = 0;
+
+    bool sampled() const {
+        return trace_id != 0;
+    }
+};
+
+// One finished span, as read out of a Tracer
+struct SpanRecord {
+    uint64_t trace_id;
+    uint64_t span_id;
+    // Zero for the root of a trace
+    uint64_t parent_id;
+    std::string name;
+    // The other process of an RPC span, if any
+    std::string peer;
+    // Microseconds since the epoch, comparable across the processes of one host
+    uint64_t start_us;
+    uint64_t duration_us;
+    uint32_t thread;
+};
+
+// The spans a process recorded, in a ring buffer written without locks: a writer claims a
+// slot with one fetch_add and publishes it with a sequence number, and readers skip slots
+// being written. Span names must be string literals; peers are interned.
+class Tracer {
+    public:
+        static Tracer& instance() {
+            // Never destroyed, so threads still tracing at exit are safe
+            static Tracer* tracer = new Tracer();
+            return *tracer;
+        }
+
+        // Whether to trace a new request, for a share rate of requests from 0 to 1
+        static bool sample(double rate) {
+            return rate >= 1 || (rate > 0 && random_id() <= rate * static_cast<double>(UINT64_MAX));
+        }
+
+        static uint64_t random_id() {
+            thread_local std::mt19937_64 rng{std::random_device()()};
+            uint64_t id;
+            do {
+                id = rng();
+            } while (id == 0);
+            return id;
+        }
+
+        static uint64_t now_us() {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        void record(const TraceContext& span, uint64_t parent_id, const char* name, const char* peer,
+                    uint64_t start_us, uint64_t end_us) {
+            uint64_t n = next.fetch_add(1, std::memory_order_relaxed);
+            Slot& slot = slots[n & (TRACE_BUFFER_SPANS - 1)];
+
+            slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.trace_id.store(span.trace_id, std::memory_order_relaxed);
+            slot.span_id.store(span.span_id, std::memory_order_relaxed);
+            slot.parent_id.store(parent_id, std::memory_order_relaxed);
+            slot.name.store(name, std::memory_order_relaxed);
+            slot.peer.store(peer, std::memory_order_relaxed);
+            slot.start_us.store(start_us, std::memory_order_relaxed);
+            slot.duration_us.store(end_us > start_us ? end_us - start_us : 0, std::memory_order_relaxed);
+            slot.thread.store(thread_number(), std::memory_order_relaxed);
+            slot.sequence.store(2 * n + 2, std::memory_order_release);
+        }
+
+        // A span under parent that the caller timed itself
+        void record_child(const TraceContext& parent, const char* name, uint64_t start_us, uint64_t end_us) {
+            record({parent.trace_id, random_id()}, parent.span_id, name, nullptr, start_us, end_us);
+        }
+
+        // A copy of the peer name that lives as long as the process
+        const char* intern(const std::string& peer) {
+            std::lock_guard<std::mutex> lock(peers_mutex);
+            return peers.insert(peer).first->c_str();
+        }
+
+        // Every span still in the buffer
+        std::vector<SpanRecord> spans() const {
+            std::vector<SpanRecord> result;
+            for (const Slot& slot : slots) {
+                uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+                if (sequence == 0 || sequence % 2 == 1) {
+                    continue;
+                }
+
+                const char* name = slot.name.load(std::memory_order_relaxed);
+                const char* peer = slot.peer.load(std::memory_order_relaxed);
+                SpanRecord span{slot.trace_id.load(std::memory_order_relaxed), slot.span_id.load(std::memory_order_relaxed),
+                                slot.parent_id.load(std::memory_order_relaxed), name ? name : "", peer ? peer : "",
+                                slot.start_us.load(std::memory_order_relaxed), slot.duration_us.load(std::memory_order_relaxed),
+                                slot.thread.load(std::memory_order_relaxed)};
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) == sequence) {
+                    result.push_back(std::move(span));
+                }
+            }
+            return result;
+        }
+
+        // Add every span to a ManagerTraceResponse or StorageTraceResponse
+        template <class Response>
+        void fill(Response* response) const {
+            for (const SpanRecord& record : spans()) {
+                auto* span = response->add_spans();
+                span->set_trace_id(record.trace_id);
+                span->set_span_id(record.span_id);
+                span->set_parent_id(record.parent_id);
+                span->set_name(record.name);
+                span->set_peer(record.peer);
+                span->set_start_us(record.start_us);
+                span->set_duration_us(record.duration_us);
+                span->set_thread(record.thread);
+            }
+        }
+
+    private:
+        struct Slot {
+            std::atomic<uint64_t> sequence{0};
+            std::atomic<uint64_t> trace_id{0};
+            std::atomic<uint64_t> span_id{0};
+            std::atomic<uint64_t> parent_id{0};
+            std::atomic<const char*> name{nullptr};
+            std::atomic<const char*> peer{nullptr};
+            std::atomic<uint64_t> start_us{0};
+            std::atomic<uint64_t> duration_us{0};
+            std::atomic<uint32_t> thread{0};
+        };
+
+        Slot slots[TRACE_BUFFER_SPANS];
+        std::atomic<uint64_t> next{0};
+
+        std::mutex peers_mutex;
+        std::unordered_set<std::string> peers;
+
+        // Small numbers for threads, in the order they first record a span
+        static uint32_t thread_number() {
+            static std::atomic<uint32_t> threads{0};
+            thread_local uint32_t number = ++threads;
+            return number;
+        }
+};
+
+// A span from construction to destruction, made the current one of its thread meanwhile so
+// spans started inside it become its children. Records nothing unless its trace is sampled.
+class TraceSpan {
+    public:
+        // A child of the thread's current span if one is running, otherwise the root of a new
+        // trace if sample is set
+        TraceSpan(const char* name, bool sample = false) : TraceSpan(current().sampled() ? current() : root(sample), name) {}
+
+        // A child of parent, e.g. of the caller of an RPC
+        TraceSpan(const TraceContext& parent, const char* name) : name(name), saved(current()) {
+            if (!parent.sampled()) {
+                return;
+            }
+            parent_id = parent.span_id;
+            context.trace_id = parent.trace_id;
+            context.span_id = Tracer::random_id();
+            start_us = Tracer::now_us();
+            current() = context;
+        }
+
+        ~TraceSpan() {
+            if (context.sampled()) {
+                Tracer::instance().record(context, parent_id, name, nullptr, start_us, Tracer::now_us());
+            }
+            current() = saved;
+        }
+
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+
+        // The running span of this thread; unsampled if none
+        static TraceContext& current() {
+            thread_local TraceContext context;
+            return context;
+        }
+
+    private:
+        const char* name;
+        TraceContext saved;
+        TraceContext context;
+        uint64_t parent_id = 0;
+        uint64_t start_us = 0;
+
+        static TraceContext root(bool sample) {
+            TraceContext context;
+            if (sample) {
+                context.trace_id = Tracer::random_id();
+            }
+            return context;
+        }
+};
+
+// Makes a context the current one of its thread for a scope, e.g. one carried over from the
+// thread that started an asynchronous step
+class TraceScope {
+    public:
+        TraceScope(const TraceContext& context) : saved(TraceSpan::current()) {
+            TraceSpan::current() = context;
+        }
+
+        ~TraceScope() {
+            TraceSpan::current() = saved;
+        }
+
+    private:
+        TraceContext saved;
+};
+
+// A span started on one thread and finished on any, e.g. when an RPC answered on a
+// completion queue. Unlike TraceSpan it leaves the thread's current span alone; finish(), or
+// destruction, records it once.
+class DeferredSpan {
+    public:
+        DeferredSpan() = default;
+
+        DeferredSpan(const TraceContext& parent, const char* name, const char* peer = nullptr) : name(name), peer(peer) {
+            if (!parent.sampled()) {
+                return;
+            }
+            parent_id = parent.span_id;
+            span.trace_id = parent.trace_id;
+            span.span_id = Tracer::random_id();
+            start_us = Tracer::now_us();
+        }
+
+        ~DeferredSpan() {
+            finish();
+        }
+
+        DeferredSpan(DeferredSpan&& other) noexcept {
+            *this = std::move(other);
+        }
+
+        DeferredSpan& operator=(DeferredSpan&& other) noexcept {
+            std::swap(name, other.name);
+            std::swap(peer, other.peer);
+            std::swap(span, other.span);
+            std::swap(parent_id, other.parent_id);
+            std::swap(start_us, other.start_us);
+            return *this;
+        }
+
+        const TraceContext& context() const {
+            return span;
+        }
+
+        void finish() {
+            if (span.sampled()) {
+                Tracer::instance().record(span, parent_id, name, peer, start_us, Tracer::now_us());
+                span = TraceContext();
+            }
+        }
+
+    private:
+        const char* name = nullptr;
+        const char* peer = nullptr;
+        TraceContext span;
+        uint64_t parent_id = 0;
+        uint64_t start_us = 0;
+};
+
+// Send a span with a request, as the parent of the server's span
+template <class ClientContext>
+void trace_inject(ClientContext& context, const TraceContext& trace) {
+    char value[40];
+    std::snprintf(value, sizeof(value), "%016" PRIx64 "-%016" PRIx64, trace.trace_id, trace.span_id);
+    context.AddMetadata(TRACE_METADATA_KEY, value);
+}
+
+// The span of one outgoing RPC to peer, a child of the thread's current span. start() sends
+// it with the call, so the server's span becomes its child; it is recorded once finished.
+class RpcTrace {
+    public:
+        RpcTrace() = default;
+
+        template <class ClientContext>
+        RpcTrace(const char* name, const std::string& peer, ClientContext& context) {
+            start(name, peer, context);
+        }
+
+        template <class ClientContext>
+        void start(const char* name, const std::string& peer, ClientContext& context) {
+            if (!TraceSpan::current().sampled()) {
+                return;
+            }
+            span = DeferredSpan(TraceSpan::current(), name, Tracer::instance().intern(peer));
+            trace_inject(context, span.context());
+        }
+
+        void finish() {
+            span.finish();
+        }
+
+    private:
+        DeferredSpan span;
+};
+
+// The caller's span sent with a request, or an unsampled context if there is none
+template <class ServerContext>
+TraceContext trace_extract(const ServerContext* context) {
+    TraceContext trace;
+    if (!context) {
+        return trace;
+    }
+
+    const auto& metadata = context->client_metadata();
+    auto it = metadata.find(TRACE_METADATA_KEY);
+    if (it == metadata.end()) {
+        return trace;
+    }
+
+    std::string value(it->second.data(), it->second.size());
+    if (std::sscanf(value.c_str(), "%" SCNx64 "-%" SCNx64, &trace.trace_id, &trace.span_id) != 2) {
+        return TraceContext();
+    }
+    return trace;
+}
+
+#endif
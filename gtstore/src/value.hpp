@@ -0,0 +1,128 @@
+#ifndef GTSTORE_VALUE
+#define GTSTORE_VALUE
+
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+
+// Immutable value held by a storage node: all elements of a val_t packed into one
+// reference-counted allocation (header, element offsets, bytes). Built once from the
+// request that carries it; after that prepare, commit and every GET share the same buffer,
+// and copying a Value only bumps the count.
+//
+// The header also carries the value's version, stamped at commit, which orders copies of a
+// key held by different replicas (last writer wins). Every replica stamps a write with the
+// same version: the highest its prepares proposed, or the chain head's. It also carries the encoding the
+// writing client gave its elements (see ValueEncoding), which the node only keeps.
+class Value {
+    public:
+        Value() = default;
+
+        // Pack elements, any range of string-like values, into a new buffer
+        template <class Strings>
+        static Value copy_of(const Strings& elements, uint64_t version = 0, uint32_t encoding = 0) {
+            uint32_t count = 0;
+            size_t bytes = 0;
+            for (const auto& element : elements) {
+                count++;
+                bytes += std::string_view(element).size();
+            }
+
+            Value value;
+            value.header = static_cast<Header*>(::operator new(sizeof(Header) + (count + 1) * sizeof(uint32_t) + bytes));
+            new (value.header) Header{{1}, count, encoding, version};
+
+            uint32_t* offsets = value.offsets();
+            char* data = value.data();
+            uint32_t offset = 0;
+            uint32_t i = 0;
+            for (const auto& element : elements) {
+                std::string_view view(element);
+                offsets[i++] = offset;
+                std::memcpy(data + offset, view.data(), view.size());
+                offset += view.size();
+            }
+            offsets[count] = offset;
+            return value;
+        }
+
+        Value(const Value& other) : header(other.header) {
+            if (header) {
+                header->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        Value(Value&& other) noexcept : header(std::exchange(other.header, nullptr)) {}
+
+        Value& operator=(Value other) noexcept {
+            std::swap(header, other.header);
+            return *this;
+        }
+
+        ~Value() {
+            if (header && header->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                header->~Header();
+                ::operator delete(header);
+            }
+        }
+
+        size_t size() const {
+            return header ? header->count : 0;
+        }
+
+        std::string_view operator[](size_t i) const {
+            const uint32_t* offsets = this->offsets();
+            return std::string_view(data() + offsets[i], offsets[i + 1] - offsets[i]);
+        }
+
+        // Total bytes of all elements
+        size_t bytes() const {
+            return header ? offsets()[header->count] : 0;
+        }
+
+        uint64_t version() const {
+            return header ? header->version : 0;
+        }
+
+        uint32_t encoding() const {
+            return header ? header->encoding : 0;
+        }
+
+        // Set the version at commit. Only the value's sole owner may do this, before the
+        // value is shared.
+        void stamp(uint64_t version) {
+            header->version = version;
+        }
+
+    private:
+        struct Header {
+            std::atomic<uint32_t> refs;
+            uint32_t count;
+            uint32_t encoding;
+            uint64_t version;
+        };
+
+        Header* header = nullptr;
+
+        uint32_t* offsets() {
+            return reinterpret_cast<uint32_t*>(header + 1);
+        }
+
+        const uint32_t* offsets() const {
+            return reinterpret_cast<const uint32_t*>(header + 1);
+        }
+
+        char* data() {
+            return reinterpret_cast<char*>(offsets() + header->count + 1);
+        }
+
+        const char* data() const {
+            return reinterpret_cast<const char*>(offsets() + header->count + 1);
+        }
+};
+
+#endif
@@ -0,0 +1,441 @@
+#ifndef GTSTORE_WAL
+#define GTSTORE_WAL
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "gtstore.hpp"
+#include "value.hpp"
+
+// Append-only log of committed values, plus snapshots of the whole store, for one storage
+// node. The log is split into numbered segments; a snapshot numbered g holds every value
+// committed before segment g was started, so recovery loads the newest snapshot and
+// replays segments g, g+1, ... on top of it.
+//
+// Files are sequences of records: a u32 payload length, the CRC-32 of the payload, then
+// the payload (u64 version, u32 key length, key, u32 element count, u32 length + bytes per
+// element, and the u32 encoding of the elements; a record written before encodings existed
+// ends without it and holds raw elements).
+// Replay stops at the first record that is torn or fails its checksum.
+//
+// Durability modes, see GTStoreDurability:
+// - NONE: records go to the OS page cache on append and are never fsynced
+// - BATCHED: records are buffered; sync() writes and fsyncs everything appended so far,
+//   so concurrent committers share one fsync (group commit)
+// - PER_WRITE: every append is written and fsynced on its own before it returns
+class WriteAheadLog {
+    public:
+        WriteAheadLog(const std::string& dir, GTStoreDurability durability) : dir(dir), durability(durability) {
+            make_dirs(dir);
+        }
+
+        ~WriteAheadLog() {
+            if (fd >= 0) {
+                sync(appended_lsn);
+                ::close(fd);
+            }
+        }
+
+        // Load the newest snapshot and replay the log after it through apply, in commit
+        // order, then open a fresh segment for appends. Returns the number of records applied.
+        size_t recover(const std::function<void(const std::string&, Value)>& apply) {
+            std::vector<uint64_t> snapshots;
+            std::vector<uint64_t> segments;
+            list(snapshots, segments);
+
+            size_t applied = 0;
+            uint64_t first_segment = 0;
+            if (!snapshots.empty()) {
+                first_segment = snapshots.back();
+                applied += replay(snapshot_path(first_segment), apply);
+            }
+
+            for (uint64_t segment : segments) {
+                if (segment >= first_segment) {
+                    applied += replay(segment_path(segment), apply);
+                }
+                generation = std::max(generation, segment);
+            }
+            generation = std::max(generation, first_segment);
+
+            remove_before(first_segment);
+            open_segment(generation + 1);
+            return applied;
+        }
+
+        // Where a record went: its log sequence number, for sync(), and its segment, for applied()
+        struct Position {
+            uint64_t lsn;
+            uint64_t segment;
+        };
+
+        // Add a record for key. The caller passes the position to applied() once the value
+        // is visible in the store.
+        Position append(const std::string& key, const Value& value) {
+            std::unique_lock<std::mutex> lock(mutex);
+            encode(buffer, key, value);
+            appended_lsn++;
+            unapplied[generation]++;
+
+            if (durability != GTStoreDurability::BATCHED) {
+                write_all(fd, buffer);
+                buffer.clear();
+                if (durability == GTStoreDurability::PER_WRITE) {
+                    ::fdatasync(fd);
+                }
+                durable_lsn = appended_lsn;
+            }
+            return Position{appended_lsn, generation};
+        }
+
+        // Wait until the record at lsn is as durable as the mode promises. In batched mode
+        // the first waiter becomes the leader and flushes every record buffered so far with
+        // one fsync; records appended meanwhile go out with the next leader's batch.
+        void sync(uint64_t lsn) {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (durable_lsn < lsn) {
+                if (flushing) {
+                    flushed.wait(lock);
+                    continue;
+                }
+                flush(lock);
+            }
+        }
+
+        void applied(const Position& position) {
+            std::unique_lock<std::mutex> lock(mutex);
+            auto it = unapplied.find(position.segment);
+            if (--it->second == 0) {
+                unapplied.erase(it);
+                drained.notify_all();
+            }
+        }
+
+        // Start a new segment and return its number, once every record in the older segments
+        // is written out and visible in the store, so a snapshot taken now covers them all.
+        uint64_t rotate() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (flushing || durable_lsn < appended_lsn) {
+                if (flushing) {
+                    flushed.wait(lock);
+                    continue;
+                }
+                flush(lock);
+            }
+            ::close(fd);
+            open_segment(generation + 1);
+            snapshot_lsn = appended_lsn;
+
+            drained.wait(lock, [this] {
+                return unapplied.empty() || unapplied.begin()->first >= generation;
+            });
+            return generation;
+        }
+
+        // Records appended since the last rotation for a snapshot
+        uint64_t pending_records() {
+            std::unique_lock<std::mutex> lock(mutex);
+            return appended_lsn - snapshot_lsn;
+        }
+
+        // Writes a snapshot covering every segment before the one it is numbered after. It
+        // only replaces the previous snapshot, and drops the segments it covers, in finish().
+        class SnapshotWriter {
+            public:
+                SnapshotWriter(WriteAheadLog& log, uint64_t segment) : log(log), segment(segment) {
+                    fd = ::open((log.snapshot_path(segment) + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                    if (fd < 0) {
+                        throw std::runtime_error("cannot create snapshot in " + log.dir);
+                    }
+                }
+
+                ~SnapshotWriter() {
+                    if (fd >= 0) {
+                        ::close(fd);
+                    }
+                }
+
+                void add(const std::string& key, const Value& value) {
+                    encode(buffer, key, value);
+                    if (buffer.size() >= (1 << 20)) {
+                        write_all(fd, buffer);
+                        buffer.clear();
+                    }
+                }
+
+                void finish() {
+                    write_all(fd, buffer);
+                    ::fsync(fd);
+                    ::close(fd);
+                    fd = -1;
+
+                    std::string path = log.snapshot_path(segment);
+                    ::rename((path + ".tmp").c_str(), path.c_str());
+                    log.sync_dir();
+                    log.remove_before(segment);
+                }
+
+            private:
+                WriteAheadLog& log;
+                uint64_t segment;
+                int fd;
+                std::string buffer;
+        };
+
+        SnapshotWriter begin_snapshot(uint64_t segment) {
+            return SnapshotWriter(*this, segment);
+        }
+
+    private:
+        std::string dir;
+        GTStoreDurability durability;
+        int fd = -1;
+        uint64_t generation = 0;
+
+        std::mutex mutex;
+        std::condition_variable flushed;
+        std::condition_variable drained;
+        std::string buffer;
+        uint64_t appended_lsn = 0;
+        uint64_t durable_lsn = 0;
+        uint64_t snapshot_lsn = 0;
+        bool flushing = false;
+        // Appended records not yet visible in the store, by segment
+        std::map<uint64_t, uint64_t> unapplied;
+
+        // Write out and fsync the buffer with the mutex released, as the group's leader
+        void flush(std::unique_lock<std::mutex>& lock) {
+            flushing = true;
+            std::string batch;
+            batch.swap(buffer);
+            uint64_t batch_lsn = appended_lsn;
+            int batch_fd = fd;
+
+            lock.unlock();
+            write_all(batch_fd, batch);
+            ::fdatasync(batch_fd);
+            lock.lock();
+
+            durable_lsn = batch_lsn;
+            flushing = false;
+            flushed.notify_all();
+        }
+
+        std::string segment_path(uint64_t segment) const {
+            char name[64];
+            std::snprintf(name, sizeof(name), "/wal-%020lu.log", (unsigned long) segment);
+            return dir + name;
+        }
+
+        std::string snapshot_path(uint64_t segment) const {
+            char name[64];
+            std::snprintf(name, sizeof(name), "/snapshot-%020lu.dat", (unsigned long) segment);
+            return dir + name;
+        }
+
+        void open_segment(uint64_t segment) {
+            generation = segment;
+            fd = ::open(segment_path(segment).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (fd < 0) {
+                throw std::runtime_error("cannot open log segment in " + dir);
+            }
+            sync_dir();
+        }
+
+        void sync_dir() {
+            int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+            if (dir_fd >= 0) {
+                ::fsync(dir_fd);
+                ::close(dir_fd);
+            }
+        }
+
+        // Snapshot and segment numbers present in dir, ascending
+        void list(std::vector<uint64_t>& snapshots, std::vector<uint64_t>& segments) {
+            DIR* d = ::opendir(dir.c_str());
+            if (!d) {
+                return;
+            }
+            while (struct dirent* entry = ::readdir(d)) {
+                unsigned long number;
+                char suffix[8];
+                if (std::sscanf(entry->d_name, "wal-%lu.%3s", &number, suffix) == 2 && std::string(suffix) == "log") {
+                    segments.push_back(number);
+                }
+                else if (std::sscanf(entry->d_name, "snapshot-%lu.%3s", &number, suffix) == 2 && std::string(entry->d_name).find(".tmp") == std::string::npos) {
+                    snapshots.push_back(number);
+                }
+            }
+            ::closedir(d);
+            std::sort(snapshots.begin(), snapshots.end());
+            std::sort(segments.begin(), segments.end());
+        }
+
+        // Drop the snapshots and segments made obsolete by the snapshot numbered segment
+        void remove_before(uint64_t segment) {
+            std::vector<uint64_t> snapshots;
+            std::vector<uint64_t> segments;
+            list(snapshots, segments);
+            for (uint64_t number : snapshots) {
+                if (number < segment) {
+                    ::unlink(snapshot_path(number).c_str());
+                }
+            }
+            for (uint64_t number : segments) {
+                if (number < segment) {
+                    ::unlink(segment_path(number).c_str());
+                }
+            }
+        }
+
+        static size_t replay(const std::string& path, const std::function<void(const std::string&, Value)>& apply) {
+            std::string data;
+            if (!read_file(path, data)) {
+                return 0;
+            }
+
+            size_t applied = 0;
+            size_t offset = 0;
+            std::string key;
+            std::vector<std::string_view> elements;
+
+            while (offset + 8 <= data.size()) {
+                uint32_t length = read_u32(data, offset);
+                uint32_t crc = read_u32(data, offset + 4);
+                if (offset + 8 + length > data.size() || crc32(data.data() + offset + 8, length) != crc) {
+                    std::cerr << "Stopping replay of " << path << " at torn record, offset " << offset << std::endl;
+                    break;
+                }
+
+                size_t pos = offset + 8;
+                uint64_t version;
+                std::memcpy(&version, data.data() + pos, 8);
+                pos += 8;
+                uint32_t key_length = read_u32(data, pos);
+                key.assign(data, pos + 4, key_length);
+                pos += 4 + key_length;
+
+                uint32_t count = read_u32(data, pos);
+                pos += 4;
+                elements.clear();
+                for (uint32_t i = 0; i < count; i++) {
+                    uint32_t element_length = read_u32(data, pos);
+                    elements.emplace_back(data.data() + pos + 4, element_length);
+                    pos += 4 + element_length;
+                }
+                uint32_t encoding = pos + 4 <= offset + 8 + length ? read_u32(data, pos) : 0;
+
+                apply(key, Value::copy_of(elements, version, encoding));
+                applied++;
+                offset += 8 + length;
+            }
+            return applied;
+        }
+
+        static void encode(std::string& out, const std::string& key, const Value& value) {
+            size_t start = out.size();
+            out.append(8, '\0');
+            uint64_t version = value.version();
+            out.append(reinterpret_cast<const char*>(&version), 8);
+            append_u32(out, key.size());
+            out.append(key);
+            append_u32(out, value.size());
+            for (size_t i = 0; i < value.size(); i++) {
+                append_u32(out, value[i].size());
+                out.append(value[i]);
+            }
+            append_u32(out, value.encoding());
+
+            uint32_t length = out.size() - start - 8;
+            uint32_t crc = crc32(out.data() + start + 8, length);
+            std::memcpy(&out[start], &length, 4);
+            std::memcpy(&out[start + 4], &crc, 4);
+        }
+
+        static void append_u32(std::string& out, uint32_t n) {
+            out.append(reinterpret_cast<const char*>(&n), 4);
+        }
+
+        static uint32_t read_u32(const std::string& data, size_t pos) {
+            uint32_t n;
+            std::memcpy(&n, data.data() + pos, 4);
+            return n;
+        }
+
+        static uint32_t crc32(const char* data, size_t length) {
+            static const std::vector<uint32_t> table = [] {
+                std::vector<uint32_t> table(256);
+                for (uint32_t i = 0; i < 256; i++) {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; k++) {
+                        c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+                    }
+                    table[i] = c;
+                }
+                return table;
+            }();
+
+            uint32_t crc = 0xFFFFFFFF;
+            for (size_t i = 0; i < length; i++) {
+                crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+            }
+            return crc ^ 0xFFFFFFFF;
+        }
+
+        static void write_all(int fd, const std::string& data) {
+            size_t written = 0;
+            while (written < data.size()) {
+                ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+                if (n < 0) {
+                    throw std::runtime_error("write to log failed");
+                }
+                written += n;
+            }
+        }
+
+        static bool read_file(const std::string& path, std::string& data) {
+            int file = ::open(path.c_str(), O_RDONLY);
+            if (file < 0) {
+                return false;
+            }
+            struct stat st;
+            ::fstat(file, &st);
+            data.resize(st.st_size);
+
+            size_t read_bytes = 0;
+            while (read_bytes < data.size()) {
+                ssize_t n = ::read(file, &data[read_bytes], data.size() - read_bytes);
+                if (n <= 0) {
+                    break;
+                }
+                read_bytes += n;
+            }
+            data.resize(read_bytes);
+            ::close(file);
+            return true;
+        }
+
+        static void make_dirs(const std::string& path) {
+            for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+                ::mkdir(path.substr(0, pos).c_str(), 0755);
+                if (pos == std::string::npos) {
+                    break;
+                }
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,311 @@
+#ifndef GTSTORE_WORKLOAD
+#define GTSTORE_WORKLOAD
+
+#include <string>
+#include <vector>
+#include <random>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Latencies are kept in buckets this many bits wide, so a recorded value is within
+// 1/2^(LATENCY_PRECISION_BITS - 1), under 1%, of the value reported for it
+#define LATENCY_PRECISION_BITS 8
+// Share of keys that are hot, and of operations that go to them, under the hotspot distribution
+#define HOTSPOT_KEY_FRACTION 0.2
+#define HOTSPOT_OP_FRACTION 0.8
+
+// Zipfian key chooser over [0, n) following Gray et al., "Quickly Generating
+// Billion-Record Synthetic Databases" (the generator YCSB uses). Low ids are hot.
+class ZipfianGenerator {
+    public:
+        ZipfianGenerator(uint64_t n, double theta = 0.99) : n(n), theta(theta) {
+            zetan = zeta(n, theta);
+            double zeta2 = zeta(2, theta);
+            alpha = 1.0 / (1.0 - theta);
+            eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+        }
+
+        template <class Rng>
+        uint64_t next(Rng& rng) const {
+            double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+            double uz = u * zetan;
+
+            if (uz < 1.0) {
+                return 0;
+            }
+            if (uz < 1.0 + std::pow(0.5, theta)) {
+                return 1;
+            }
+            return std::min<uint64_t>(n - 1, n * std::pow(eta * u - eta + 1, alpha));
+        }
+
+    private:
+        uint64_t n;
+        double theta;
+        double zetan;
+        double alpha;
+        double eta;
+
+        static double zeta(uint64_t n, double theta) {
+            double sum = 0;
+            for (uint64_t i = 1; i <= n; i++) {
+                sum += 1 / std::pow(i, theta);
+            }
+            return sum;
+        }
+};
+
+// Counts of latencies in log-linear buckets, as in HdrHistogram: values below
+// 2^LATENCY_PRECISION_BITS have a bucket each, and every power of two above that is cut into
+// 2^(LATENCY_PRECISION_BITS - 1) equal buckets. Recording is an increment, so each thread keeps
+// its own histogram and they are merged at the end.
+class LatencyHistogram {
+    public:
+        LatencyHistogram() : counts(index_of(UINT64_MAX) + 1) {}
+
+        void record(uint64_t value) {
+            counts[index_of(value)]++;
+            total++;
+            sum += value;
+            max_value = std::max(max_value, value);
+        }
+
+        void merge(const LatencyHistogram& other) {
+            for (size_t i = 0; i < counts.size(); i++) {
+                counts[i] += other.counts[i];
+            }
+            total += other.total;
+            sum += other.sum;
+            max_value = std::max(max_value, other.max_value);
+        }
+
+        uint64_t count() const {
+            return total;
+        }
+
+        uint64_t max() const {
+            return max_value;
+        }
+
+        double mean() const {
+            return total == 0 ? 0 : static_cast<double>(sum) / total;
+        }
+
+        // The smallest recorded value that p percent of values are at or below, reported as the
+        // top of its bucket
+        uint64_t percentile(double p) const {
+            if (total == 0) {
+                return 0;
+            }
+
+            uint64_t rank = std::max<uint64_t>(1, std::ceil(p / 100.0 * total));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < counts.size(); i++) {
+                seen += counts[i];
+                if (seen >= rank) {
+                    return std::min(highest_equivalent(i), max_value);
+                }
+            }
+            return max_value;
+        }
+
+        // (top of bucket, count) for every bucket with values, smallest first
+        std::vector<std::pair<uint64_t, uint64_t>> buckets() const {
+            std::vector<std::pair<uint64_t, uint64_t>> result;
+            for (size_t i = 0; i < counts.size(); i++) {
+                if (counts[i] > 0) {
+                    result.emplace_back(highest_equivalent(i), counts[i]);
+                }
+            }
+            return result;
+        }
+
+    private:
+        static constexpr uint64_t linear = 1ull << LATENCY_PRECISION_BITS;
+        static constexpr uint64_t half = linear / 2;
+
+        std::vector<uint64_t> counts;
+        uint64_t total = 0;
+        uint64_t sum = 0;
+        uint64_t max_value = 0;
+
+        static size_t index_of(uint64_t value) {
+            if (value < linear) {
+                return value;
+            }
+            // Drop low bits until the value has LATENCY_PRECISION_BITS - 1 bits below its top one
+            int shift = 63 - __builtin_clzll(value) - (LATENCY_PRECISION_BITS - 1);
+            return shift * half + (value >> shift);
+        }
+
+        static uint64_t highest_equivalent(size_t index) {
+            if (index < linear) {
+                return index;
+            }
+            int shift = index / half - 1;
+            uint64_t low = (index - shift * half) << shift;
+            return low + ((1ull << shift) - 1);
+        }
+};
+
+enum class KeyDistribution {
+    UNIFORM,
+    ZIPFIAN,
+    // Zipfian over keys counted back from the newest insert
+    LATEST,
+    // HOTSPOT_OP_FRACTION of operations to the first HOTSPOT_KEY_FRACTION of keys
+    HOTSPOT
+};
+
+enum class SizeDistribution {
+    FIXED,
+    UNIFORM,
+    // Zipfian over [min, max], so most values are near min
+    ZIPFIAN
+};
+
+// What a workload does, in the terms of the YCSB core workloads. Updates take the share
+// of operations reads and inserts leave.
+struct WorkloadSpec {
+    std::string name = "a";
+    double read_proportion = 0.5;
+    double insert_proportion = 0;
+    KeyDistribution key_distribution = KeyDistribution::ZIPFIAN;
+    // Keys loaded before the run; inserts add keys after them
+    uint64_t records = 10000;
+    SizeDistribution size_distribution = SizeDistribution::FIXED;
+    size_t min_value_size = 100;
+    size_t max_value_size = 100;
+    int threads = 8;
+    // Operations per second over all threads, arriving on a fixed schedule whether or not
+    // earlier ones finished; 0 runs closed loop, each thread sending as soon as it can
+    double target_ops = 0;
+    double warmup_s = 5;
+    double duration_s = 30;
+
+    // The YCSB core workloads that need no scans: a update heavy, b read mostly, c read only,
+    // d read latest. Returns false for any other name.
+    bool preset(const std::string& workload) {
+        name = workload;
+        insert_proportion = 0;
+        key_distribution = KeyDistribution::ZIPFIAN;
+        if (workload == "a") {
+            read_proportion = 0.5;
+        }
+        else if (workload == "b") {
+            read_proportion = 0.95;
+        }
+        else if (workload == "c") {
+            read_proportion = 1;
+        }
+        else if (workload == "d") {
+            read_proportion = 0.95;
+            insert_proportion = 0.05;
+            key_distribution = KeyDistribution::LATEST;
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+};
+
+// Draws operations, keys and value sizes for a WorkloadSpec. Shared by the threads that
+// run it, each with its own random engine.
+class Workload {
+    public:
+        enum Op {
+            READ,
+            UPDATE,
+            INSERT
+        };
+
+        const WorkloadSpec spec;
+
+        Workload(const WorkloadSpec& spec)
+            : spec(spec), keys(std::max<uint64_t>(spec.records, 1)),
+              hot_keys(std::max<uint64_t>(spec.records * HOTSPOT_KEY_FRACTION, 1)),
+              sizes(spec.max_value_size - spec.min_value_size + 1), inserted(spec.records) {}
+
+        static std::string key_name(uint64_t id) {
+            return "user" + std::to_string(id);
+        }
+
+        template <class Rng>
+        Op next_op(Rng& rng) const {
+            double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+            if (u < spec.read_proportion) {
+                return READ;
+            }
+            if (u < spec.read_proportion + spec.insert_proportion) {
+                return INSERT;
+            }
+            return UPDATE;
+        }
+
+        // A key that exists, for a read or update
+        template <class Rng>
+        uint64_t next_key(Rng& rng) const {
+            uint64_t count = std::max<uint64_t>(visible.load(std::memory_order_acquire), 1);
+
+            switch (spec.key_distribution) {
+                case KeyDistribution::UNIFORM:
+                    return std::uniform_int_distribution<uint64_t>(0, count - 1)(rng);
+                case KeyDistribution::LATEST:
+                    return count - 1 - std::min(keys.next(rng), count - 1);
+                case KeyDistribution::HOTSPOT: {
+                    uint64_t hot = std::min(hot_keys, count);
+                    if (hot == count || std::uniform_real_distribution<double>(0.0, 1.0)(rng) < HOTSPOT_OP_FRACTION) {
+                        return std::uniform_int_distribution<uint64_t>(0, hot - 1)(rng);
+                    }
+                    return std::uniform_int_distribution<uint64_t>(hot, count - 1)(rng);
+                }
+                default:
+                    return std::min(keys.next(rng), count - 1);
+            }
+        }
+
+        // The key for a new record. Reads see it once insert_done is called for it.
+        uint64_t next_insert() {
+            return inserted.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Let reads pick keys up to id, once every earlier insert has also finished; waits
+        // for those. Called for every id next_insert returns, written or not.
+        void insert_done(uint64_t id) {
+            while (visible.load(std::memory_order_acquire) != id) {
+                std::this_thread::yield();
+            }
+            visible.store(id + 1, std::memory_order_release);
+        }
+
+        // All records loaded; reads may pick any of them
+        void loaded() {
+            visible.store(spec.records, std::memory_order_release);
+        }
+
+        template <class Rng>
+        size_t next_value_size(Rng& rng) const {
+            switch (spec.size_distribution) {
+                case SizeDistribution::UNIFORM:
+                    return std::uniform_int_distribution<size_t>(spec.min_value_size, spec.max_value_size)(rng);
+                case SizeDistribution::ZIPFIAN:
+                    return spec.min_value_size + sizes.next(rng);
+                default:
+                    return spec.min_value_size;
+            }
+        }
+
+    private:
+        ZipfianGenerator keys;
+        uint64_t hot_keys;
+        ZipfianGenerator sizes;
+        std::atomic<uint64_t> inserted;
+        // Keys below this are written
+        std::atomic<uint64_t> visible{0};
+};
+
+#endif
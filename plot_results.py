@@ -1,5 +1,6 @@
 #!/usr/bin/env python3
 
+import json
 import matplotlib.pyplot as plt
 import numpy as np
 
@@ -73,6 +74,43 @@ def plot_concurrent():
     plt.savefig('concurrent_throughput.png')
     plt.close()
 
+def plot_batch():
+    print("Plotting batch results...")
+    batch_sizes = []
+    put_throughputs = []
+    get_throughputs = []
+
+    with open('batch_results.txt', 'r') as f:
+        for line in f:
+            r, b, pt, gt = map(float, line.strip().split())
+            batch_sizes.append(int(b))
+            put_throughputs.append(pt)
+            get_throughputs.append(gt)
+
+    plt.figure(figsize=(10, 6))
+    x = np.arange(len(batch_sizes))
+    width = 0.35
+
+    plt.bar(x - width/2, put_throughputs, width, label='MULTI_PUT', color='skyblue')
+    plt.bar(x + width/2, get_throughputs, width, label='MULTI_GET', color='lightgreen')
+
+    plt.xlabel('Batch Size (keys)')
+    plt.ylabel('Throughput (Keys/s)')
+    plt.title('GTStore Batched Operations')
+    plt.xticks(x, batch_sizes)
+    plt.grid(True, axis='y', linestyle='--', alpha=0.7)
+    plt.legend()
+
+    # Add value labels on top of each bar
+    for i, v in enumerate(put_throughputs):
+        plt.text(i - width/2, v, f'{v:.0f}', ha='center', va='bottom')
+    for i, v in enumerate(get_throughputs):
+        plt.text(i + width/2, v, f'{v:.0f}', ha='center', va='bottom')
+
+    plt.tight_layout()
+    plt.savefig('batch_throughput.png')
+    plt.close()
+
 def plot_loadbalance():
     try:
         node_counts = {}
@@ -103,6 +141,63 @@ def plot_loadbalance():
     except FileNotFoundError:
         print("No load balance results found")
 
+def plot_workload():
+    print("Plotting workload results...")
+    runs = []
+    with open('workload_results.jsonl', 'r') as f:
+        for line in f:
+            if line.strip():
+                runs.append(json.loads(line))
+
+    # Percentiles of every operation of every run, side by side
+    labels = []
+    p50s = []
+    p99s = []
+    p999s = []
+    for run in runs:
+        for op, stats in run['ops'].items():
+            labels.append(f"{run['workload']} {op}\n{run['threads']} thr")
+            p50s.append(stats['p50_us'])
+            p99s.append(stats['p99_us'])
+            p999s.append(stats['p999_us'])
+
+    plt.figure(figsize=(max(10, len(labels)), 6))
+    x = np.arange(len(labels))
+    width = 0.25
+
+    plt.bar(x - width, p50s, width, label='p50', color='skyblue')
+    plt.bar(x, p99s, width, label='p99', color='lightgreen')
+    plt.bar(x + width, p999s, width, label='p99.9', color='salmon')
+
+    plt.yscale('log')
+    plt.xlabel('Workload and Operation')
+    plt.ylabel('Latency (us)')
+    plt.title('GTStore Workload Latency')
+    plt.xticks(x, labels)
+    plt.grid(True, axis='y', linestyle='--', alpha=0.7)
+    plt.legend()
+    plt.tight_layout()
+    plt.savefig('workload_latency.png')
+    plt.close()
+
+    # Latency distribution of each operation from its histogram buckets
+    plt.figure(figsize=(10, 6))
+    for run in runs:
+        for op, stats in run['ops'].items():
+            values = [bucket[0] for bucket in stats['histogram']]
+            counts = np.cumsum([bucket[1] for bucket in stats['histogram']])
+            plt.plot(values, counts / counts[-1], label=f"{run['workload']} {op} ({run['throughput']:.0f} ops/s)")
+
+    plt.xscale('log')
+    plt.xlabel('Latency (us)')
+    plt.ylabel('Fraction of Operations')
+    plt.title('GTStore Workload Latency Distribution')
+    plt.grid(True, linestyle='--', alpha=0.7)
+    plt.legend()
+    plt.tight_layout()
+    plt.savefig('workload_cdf.png')
+    plt.close()
+
 if __name__ == "__main__":
     try:
         plot_single_client()
@@ -114,7 +209,17 @@ if __name__ == "__main__":
     except FileNotFoundError:
         print("No concurrent results found")
     
+    try:
+        plot_batch()
+    except FileNotFoundError:
+        print("No batch results found")
+
     try:
         plot_loadbalance()
     except FileNotFoundError:
         print("No load balance results found")
+
+    try:
+        plot_workload()
+    except FileNotFoundError:
+        print("No workload results found")
@@ -1,15 +1,29 @@
-# Args: nodes, replicas
+# Args: nodes, replicas, [storage options, e.g. --mode async]; PLACEMENT and REPLICATION pick the manager's
+# placement strategy and replication mode, and SPLIT_KEYS the comma-separated split keys of range placement.
+# With METRICS_PORT set, the manager serves Prometheus metrics on that port and storage node <id> on
+# METRICS_PORT + <id>.
 nodes=$1
 replicas=$2
+shift 2
+
+split_keys=""
+if [ -n "$SPLIT_KEYS" ]; then
+    split_keys="--split-keys $SPLIT_KEYS"
+fi
+
+metrics=""
+if [ -n "$METRICS_PORT" ]; then
+    metrics="--metrics-port $METRICS_PORT"
+fi
 
 # Launch the GTStore Manager
-./build/manager $nodes $replicas &
+./build/manager $nodes $replicas --placement ${PLACEMENT:-ring} --replication ${REPLICATION:-2pc} $split_keys $metrics &
 sleep 3
 
 # Launch <nodes> storage nodes
 for id in $(seq 1 $nodes)
 do
-    ./build/storage $id &
+    ./build/storage $id $metrics "$@" &
 done
 
 sleep 3
\ No newline at end of file
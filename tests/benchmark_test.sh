@@ -55,6 +55,24 @@ run_single_client_test() {
     sleep 2
 }
 
+# Function to run single client test with async requests in flight
+run_window_test() {
+    local replicas=$1
+    local window=$2
+    echo -e "\n${GREEN}Running single client test with $replicas replicas and a window of $window...${NC}"
+
+    # Start service
+    ./start_service.sh 7 $replicas
+    sleep 3
+
+    # Run benchmark
+    ./build/benchmark --throughput $replicas --window $window
+
+    # Clean up
+    ./clean.sh
+    sleep 2
+}
+
 # Function to run concurrent test
 run_concurrent_test() {
     local replicas=$1
@@ -73,11 +91,242 @@ run_concurrent_test() {
     sleep 2
 }
 
+# Function to run batch test
+run_batch_test() {
+    local replicas=$1
+    echo -e "\n${GREEN}Running batch test with $replicas replicas...${NC}"
+
+    # Start service
+    ./start_service.sh 7 $replicas
+    sleep 3
+
+    # Run benchmark
+    ./build/benchmark --batch $replicas
+
+    # Clean up
+    ./clean.sh
+    sleep 2
+}
+
+# Function to run range scan test under one placement strategy
+run_scan_test() {
+    local placement=$1
+    local replicas=$2
+    echo -e "\n${GREEN}Running range scan test with $placement placement and $replicas replicas...${NC}"
+
+    # Start service, splitting the benchmark's keys into ranges under range placement
+    PLACEMENT=$placement SPLIT_KEYS=sc002500,sc005000,sc007500,sc010000,sc012500,sc015000,sc017500 ./start_service.sh 7 $replicas
+    sleep 3
+
+    # Run benchmark, moving its result lines into the per-placement results
+    ./build/benchmark --scan $replicas
+    sed "s/^/$placement /" scan_results.txt >> scan_placement_results.txt
+    rm -f scan_results.txt
+
+    # Clean up
+    ./clean.sh
+    sleep 2
+}
+
+# Function to run value compression test
+run_compression_test() {
+    local replicas=$1
+    echo -e "\n${GREEN}Running compression test with $replicas replicas...${NC}"
+
+    # Start service
+    ./start_service.sh 7 $replicas
+    sleep 3
+
+    # Run benchmark
+    ./build/benchmark --compression $replicas
+
+    # Clean up
+    ./clean.sh
+    sleep 2
+}
+
+# Function to run hot-key contention test
+run_contention_test() {
+    local replicas=$1
+    local clients=$2
+    echo -e "\n${GREEN}Running contention test with $replicas replicas and $clients clients...${NC}"
+
+    # Start service
+    ./start_service.sh 7 $replicas
+    sleep 3
+
+    # Run benchmark
+    ./build/benchmark --contention $replicas $clients
+
+    # Clean up
+    ./clean.sh
+    sleep 2
+}
+
+# Function to run 1 KB value test
+run_value_test() {
+    local replicas=$1
+    echo -e "\n${GREEN}Running 1 KB value test with $replicas replicas...${NC}"
+
+    # Start service
+    ./start_service.sh 7 $replicas
+    sleep 3
+
+    # Run benchmark
+    ./build/benchmark --values $replicas
+
+    # Clean up
+    ./clean.sh
+    sleep 2
+}
+
+# Function to compare the sync and async storage servers under many concurrent clients
+run_server_mode_test() {
+    local mode=$1
+    local replicas=$2
+    local clients=$3
+    echo -e "\n${GREEN}Running concurrent test on $mode storage servers with $replicas replicas and $clients clients...${NC}"
+
+    # Start service
+    ./start_service.sh 7 $replicas --mode $mode
+    sleep 3
+
+    # Run benchmark into a file of its own, then label its result lines with the mode
+    ./build/benchmark --concurrent $replicas $clients --results server_mode_run.txt
+    sed "s/^/$mode /" server_mode_run.txt >> server_mode_results.txt
+    rm -f server_mode_run.txt
+
+    # Clean up
+    ./clean.sh
+    sleep 2
+}
+
+# Function to measure PUT throughput and restart recovery time for one durability mode
+run_durability_test() {
+    local mode=$1
+    local replicas=$2
+    local clients=$3
+    local data_dir=/tmp/gtstore_durability
+    echo -e "\n${GREEN}Running durability test in $mode mode with $replicas replicas and $clients clients...${NC}"
+
+    # Start service on an empty data directory
+    rm -rf $data_dir
+    ./start_service.sh 7 $replicas --data-dir $data_dir --durability $mode
+    sleep 3
+
+    # Run benchmark
+    ./build/benchmark --durability $replicas $clients
+
+    # Restart node 1 from its log and record how long it took to reload
+    pkill -f "storage 1 "
+    sleep 2
+    ./build/storage 1 --data-dir $data_dir --durability $mode > storage_recovery.log &
+    sleep 5
+    echo "$mode $(tail -n 1 durability_results.txt) $(grep -o 'Recovered.*' storage_recovery.log)" >> durability_mode_results.txt
+
+    # Clean up
+    ./clean.sh
+    rm -rf $data_dir storage_recovery.log
+    sleep 2
+}
+
+# Function to compare PUT-only and mixed throughput under one replication mode
+run_replication_test() {
+    local mode=$1
+    local replicas=$2
+    local clients=$3
+    echo -e "\n${GREEN}Running replication test in $mode mode with $replicas replicas and $clients clients...${NC}"
+
+    # Start service
+    REPLICATION=$mode ./start_service.sh 7 $replicas
+    sleep 3
+
+    # Run benchmarks into files of their own, then label their result lines with the mode and workload
+    ./build/benchmark --durability $replicas $clients --results replication_run.txt
+    sed "s/^/$mode put /" replication_run.txt >> replication_results.txt
+    rm -f replication_run.txt
+    ./build/benchmark --concurrent $replicas $clients --results replication_run.txt
+    sed "s/^/$mode mixed /" replication_run.txt >> replication_results.txt
+    rm -f replication_run.txt
+
+    # Clean up
+    ./clean.sh
+    sleep 2
+}
+
+run_consistency_test() {
+    local replicas=$1
+    local clients=$2
+    echo -e "\n${GREEN}Running consistency test with $replicas replicas and $clients clients...${NC}"
+
+    # Start service
+    ./start_service.sh 7 $replicas
+    sleep 3
+
+    # Run benchmark
+    ./build/benchmark --consistency $replicas $clients
+
+    # Clean up
+    ./clean.sh
+    sleep 2
+}
+
+run_workload_test() {
+    local workload=$1
+    shift
+    echo -e "\n${GREEN}Running workload $workload $@...${NC}"
+
+    # Start service
+    ./start_service.sh 7 3
+    sleep 3
+
+    # Run benchmark
+    ./build/benchmark --workload $workload "$@" --stats
+
+    # Clean up
+    ./clean.sh
+    sleep 2
+}
+
+run_skew_test() {
+    local replicas=$1
+    local clients=$2
+    echo -e "\n${GREEN}Running skewed read test with $replicas replicas and $clients clients...${NC}"
+
+    # Start service
+    ./start_service.sh 7 $replicas
+    sleep 3
+
+    # Run benchmark
+    ./build/benchmark --skew $replicas $clients
+
+    # Clean up
+    ./clean.sh
+    sleep 2
+}
+
+run_rebalance_test() {
+    local replicas=$1
+    local clients=$2
+    echo -e "\n${GREEN}Running rebalance test with $replicas replicas and $clients clients...${NC}"
+
+    # Start service
+    ./start_service.sh 7 $replicas
+    sleep 3
+
+    # Run benchmark, which starts storage node 8
+    ./build/benchmark --rebalance $replicas $clients
+
+    # Clean up
+    ./clean.sh
+    sleep 2
+}
+
 # Main execution
 echo -e "${GREEN}Starting GTStore Performance Benchmarks${NC}"
 
 # Remove old results
-rm -f throughput_results.txt loadbalance_results.txt single_client_results.txt
+rm -f throughput_results.txt loadbalance_results.txt single_client_results.txt batch_results.txt contention_results.txt server_mode_results.txt value_results.txt durability_results.txt durability_mode_results.txt rebalance_results.txt ring_results.txt placement_results.txt consistency_results.txt skew_results.txt replication_results.txt window_results.txt workload_results.jsonl stats_results.jsonl workload_trace.json scan_results.txt scan_placement_results.txt compression_results.txt
 
 # Run single client tests for different replica counts
 echo -e "${GREEN}Running single client tests...${NC}"
@@ -85,12 +334,83 @@ for replicas in 1 3 5; do
     run_single_client_test $replicas
 done
 
+# Drive many requests in flight from one client thread
+echo -e "${GREEN}Running window tests...${NC}"
+for window in 16 256 4096; do
+    run_window_test 3 $window
+done
+
 # Run concurrent tests for different replica counts
 echo -e "${GREEN}Running concurrent tests...${NC}"
 for replicas in 1 3 5; do
     run_concurrent_test $replicas 8
 done
 
+# Compare sync and async storage servers
+echo -e "${GREEN}Running server mode tests...${NC}"
+for mode in sync async; do
+    run_server_mode_test $mode 3 64
+done
+
+# Run batch tests
+echo -e "${GREEN}Running batch tests...${NC}"
+run_batch_test 3
+
+# Compare range scans under hash and range placement
+echo -e "${GREEN}Running range scan tests...${NC}"
+for placement in ring range; do
+    run_scan_test $placement 3
+done
+
+# Compare value compression modes
+echo -e "${GREEN}Running compression tests...${NC}"
+run_compression_test 3
+
+# Run hot-key contention tests
+echo -e "${GREEN}Running contention tests...${NC}"
+for clients in 4 16; do
+    run_contention_test 3 $clients
+done
+
+# Run 1 KB value test
+echo -e "${GREEN}Running value tests...${NC}"
+run_value_test 3
+
+# Compare durability modes
+echo -e "${GREEN}Running durability tests...${NC}"
+for mode in none batched per-write; do
+    run_durability_test $mode 3 16
+done
+
+# Compare consistency levels
+echo -e "${GREEN}Running consistency tests...${NC}"
+run_consistency_test 3 16
+
+# Compare two-phase commit from the client with chain replication
+echo -e "${GREEN}Running replication tests...${NC}"
+for mode in 2pc chain; do
+    run_replication_test $mode 3 16
+done
+
+# Compare replica selection on hot-key reads
+echo -e "${GREEN}Running skewed read tests...${NC}"
+run_skew_test 3 32
+
+# Run the YCSB core workloads closed loop, then workload a open loop at a fixed rate
+echo -e "${GREEN}Running workload tests...${NC}"
+for workload in a b c d; do
+    run_workload_test $workload --threads 16
+done
+run_workload_test a --threads 16 --rate 5000 --trace workload_trace.json
+
+# Measure throughput while a node joins
+echo -e "${GREEN}Running rebalance tests...${NC}"
+run_rebalance_test 3 16
+
+# Measure ring lookups, which needs no service
+echo -e "${GREEN}Running ring lookup test...${NC}"
+./build/benchmark --ring
+
 # Run load balance test
 run_loadbalance_test
 